@@ -21,10 +21,8 @@ typedef VertexOut PixelIn;
 
 struct HullOut
 {
-	float4 PosL     : POSITION0;
-    float3 NormalL  : NORMAL0;
-	float2 TexC     : TEXCOORD0;
-	float3 TangentU : TANGENT0;
+	float4 PosL : POSITION0;
+	float2 TexC : TEXCOORD0;
 };
 
 typedef PixelIn DomainOut;
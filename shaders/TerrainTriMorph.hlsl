@@ -8,14 +8,9 @@
 #include "LightingUtil.hlsli"
 #include "Shadow.hlsli"
 #include "VirtualTexture.hlsli"
+#include "TerrainVertex.hlsli"
 
-struct VertexIn
-{
-	float4 PosL     : POSITION0;
-    float3 NormalL  : NORMAL0;
-	float2 TexC     : TEXCOORD0;
-	float3 TangentU : TANGENT0;
-};
+typedef TerrainVertexIn VertexIn;
 
 struct VertexOut
 {
@@ -40,7 +35,11 @@ struct HullIn
     uint PatchId : SV_PrimitiveID;
 };
 
-typedef VertexIn HullOut;
+struct HullOut
+{
+	float4 PosL : POSITION0;
+	float2 TexC : TEXCOORD0;
+};
 
 struct DomainIn
 {
@@ -63,8 +62,8 @@ VertexOut VS(VertexIn vin)
 {
     VertexOut vout = (VertexOut) 0.0f;
     
-    vout.PosL     = vin.PosL;
-    vout.TexC     = vin.TexC;
+    vout.PosL     = decode_terrain_position(vin.PosQ);
+    vout.TexC     = decode_terrain_texc(vin.PosQ);
 
     return vout;
 }
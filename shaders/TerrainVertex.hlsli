@@ -0,0 +1,27 @@
+#ifndef _TERRAIN_VERTEX_HLSLI_
+#define _TERRAIN_VERTEX_HLSLI_
+
+#include "Common.hlsli"
+
+// Mirrors ProTerGen::TerrainVertex (see TerrainVertex.h) and "TerrainInputLayout".
+struct TerrainVertexIn
+{
+    float4 PosQ : POSITION0;     // unorm16 x, y, z and 8.8 fixed point lod
+    uint2  Mask : BLENDINDICES0; // border and corner of the template the vertex comes from
+};
+
+float4 decode_terrain_position(float4 posQ)
+{
+    float4 pos;
+    pos.xz = (posQ.xz - 0.5f) * Ter_TerrainSize;
+    pos.y  = (posQ.y * 2.0f - 1.0f) * Ter_Height;
+    pos.w  = posQ.w * (65535.0f / 256.0f);
+    return pos;
+}
+
+float2 decode_terrain_texc(float4 posQ)
+{
+    return posQ.xz;
+}
+
+#endif
@@ -3,14 +3,9 @@
 
 #include "Common.hlsli"
 #include "VirtualTexture.hlsli"
+#include "TerrainVertex.hlsli"
 
-struct VertexIn
-{
-    float3 Pos : POSITION;
-    float3 Normal : NORMAL;
-    float2 TexC : TEXCOORD;
-    float3 Tangent : TANGENT;
-};
+typedef TerrainVertexIn VertexIn;
 
 struct VertexOut
 {
@@ -19,15 +14,16 @@ struct VertexOut
 };
 
 typedef VertexOut PixelIn;
-typedef float4 PixelOut;
+typedef uint PixelOut;
 
 VertexOut VS(VertexIn vin)
 {
     VertexOut vout = (VertexOut) 0.0f;
     
-    vout.TexC = mul(float4(vin.TexC, 0.0f, 1.0f), Obj_TexTransform).xy;
+    vout.TexC = mul(float4(decode_terrain_texc(vin.PosQ), 0.0f, 1.0f), Obj_TexTransform).xy;
 
-    const float4 posW = mul(float4(vin.Pos + float3(0.0f, iEyePosW.y - 50.0f, 0.0f), 1.0f), Obj_World);
+    const float3 pos  = decode_terrain_position(vin.PosQ).xyz;
+    const float4 posW = mul(float4(pos + float3(0.0f, iEyePosW.y - 50.0f, 0.0f), 1.0f), Obj_World);
     vout.PosH = mul(posW, iViewProj);
 	
     return vout;
@@ -39,7 +35,7 @@ PixelOut PS(PixelIn pin) : SV_Target
     mip = clamp(mip, 0, log2(VT_PageTableSize));
 
     const float2 offset = floor(pin.TexC * VT_PageTableSize);
-    return float4(float3(offset / exp2(mip), mip), 1.0);
+    return pack_feedback((uint2)(offset / exp2(mip)), (uint)mip);
 }
 
 #endif
\ No newline at end of file
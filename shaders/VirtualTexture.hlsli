@@ -15,6 +15,13 @@ float get_inter(float mip, out float minMip, out float maxMip)
     return max(0.0f, mip - minMip);
 }
 
+// Feedback pixel, the layout FeedbackAnalyzer decodes: x in bits 0-12, y in 13-25, mip in 26-29 and bit 31 set
+// on every written pixel, so the cleared target reads as no request.
+uint pack_feedback(uint2 page, uint mip)
+{
+    return (page.x & 0x1FFF) | ((page.y & 0x1FFF) << 13) | ((mip & 0xF) << 26) | 0x80000000;
+}
+
 float mip_level(float2 uv, float size)
 {
     const float2 dx = ddx(uv * size);
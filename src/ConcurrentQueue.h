@@ -1,8 +1,10 @@
 #pragma once
 
-#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include <deque>
-#include "CommonHeaders.h"
+#include <memory>
+#include <mutex>
 
 namespace ProTerGen
 {
@@ -40,111 +42,120 @@ namespace ProTerGen
 		std::mutex mLocker;
 	};
 
+	// Allocations made by every NBConcurrentQueue. The rings are only allocated by SetMaxSize.
+	struct ConcurrentQueueMetrics
+	{
+		static inline std::atomic<uint64_t> sMetricAllocations = 0;
+	};
+
+	// Bounded ring of MaxSize elements, any number of threads can enqueue and dequeue without locking. Each slot
+	// carries a sequence number telling whether it is free for the enqueue or holds a value for the dequeue of
+	// that lap, so nothing is allocated per element.
 	template<typename T>
 	class NBConcurrentQueue
 	{
 	public:
-		explicit NBConcurrentQueue() { mHead = new Node(); mTail = mHead; }
-		~NBConcurrentQueue()
+		NBConcurrentQueue() = default;
+		NBConcurrentQueue(const NBConcurrentQueue&) = delete;
+		NBConcurrentQueue& operator=(const NBConcurrentQueue&) = delete;
+
+		inline bool IsEmpty() { return mSize.load() == 0; }
+		inline size_t Size() { return mSize.load(); }
+
+		// Allocates the ring, dropping the elements queued. Only while no other thread uses the queue.
+		inline void SetMaxSize(size_t max)
 		{
-			delete mHead;
-			mHead = nullptr;
-			mTail = nullptr;
+			if (max != mMaxSize)
+			{
+				mSlots.reset(max > 0 ? new Slot[max] : nullptr);
+				mMaxSize = max;
+				if (max > 0) ConcurrentQueueMetrics::sMetricAllocations.fetch_add(1);
+			}
+			for (size_t i = 0; i < mMaxSize; ++i)
+			{
+				mSlots[i].Value = T();
+				mSlots[i].Sequence.store(i, std::memory_order_relaxed);
+			}
+			mHead.store(0);
+			mTail.store(0);
+			mSize.store(0);
 		}
 
-		inline bool IsEmpty() { return mHead == mTail; }
-		inline size_t volatile Size() { return mSize.load(); }
-		inline void SetMaxSize(size_t max) { mMaxSize.store(max); }
-
 		inline bool Enqueue(T& value)
 		{
-			if (mSize.load() == mMaxSize.load()) return false;
+			if (mMaxSize == 0) return false;
 
-			Node* node = new Node();
-			node->value = value;
-
-			Node* volatile oldTail;
-			Node* volatile oldNext;
+			size_t position = mTail.load(std::memory_order_relaxed);
+			Slot* slot = nullptr;
 			while (true)
 			{
-				oldTail = mTail;
-				oldNext = (mTail) ? (mTail->next) : nullptr;
-
-				if (oldTail == mTail)
+				slot = &mSlots[position % mMaxSize];
+				const size_t sequence = slot->Sequence.load(std::memory_order_acquire);
+				const intptr_t lap = (intptr_t)sequence - (intptr_t)position;
+				if (lap == 0)
+				{
+					if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+				}
+				else if (lap < 0)
 				{
-					if (!oldNext)
-					{
-						void** _next = reinterpret_cast<void**>(&(mTail->next));
-						if (!InterlockedCompareExchangePointer(_next, node, nullptr))
-							break;
-					}
-					void** t = reinterpret_cast<void**>(&mTail);
-					InterlockedCompareExchangePointer(t, oldNext, oldTail);
+					return false;
+				}
+				else
+				{
+					position = mTail.load(std::memory_order_relaxed);
 				}
 			}
-			void** t = reinterpret_cast<void**>(&mTail);
-			InterlockedCompareExchangePointer(t, node, oldTail);
+
+			// Values are moved in and out, the queue owns them in between.
+			slot->Value = std::move(value);
+			slot->Sequence.store(position + 1, std::memory_order_release);
 			mSize.fetch_add(1);
 			return true;
 		}
 
 		inline bool TryDequeue(T& value)
 		{
-			Node* volatile oldHead;
-			Node* volatile oldNext;
-			Node* volatile oldTail;
+			if (mMaxSize == 0) return false;
 
+			size_t position = mHead.load(std::memory_order_relaxed);
+			Slot* slot = nullptr;
 			while (true)
 			{
-				oldHead = mHead;
-				oldTail = mTail;
-				oldNext = (mHead) ? (mHead->next) : nullptr;
-
-				if (oldHead == mHead)
+				slot = &mSlots[position % mMaxSize];
+				const size_t sequence = slot->Sequence.load(std::memory_order_acquire);
+				const intptr_t lap = (intptr_t)sequence - (intptr_t)(position + 1);
+				if (lap == 0)
+				{
+					if (mHead.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+				}
+				else if (lap < 0)
+				{
+					return false;
+				}
+				else
 				{
-					if (oldHead == oldTail)
-					{
-						return false;
-					}
-					else
-					{
-						value = oldNext->value;
-						void** h = reinterpret_cast<void**>(&mHead);
-						auto ptr = InterlockedCompareExchangePointer(h, oldNext, oldHead);
-						if (ptr == oldHead)
-						{
-							delete ptr;
-							break;
-						}
-					}
+					position = mHead.load(std::memory_order_relaxed);
 				}
 			}
 
+			value = std::move(slot->Value);
+			slot->Sequence.store(position + mMaxSize, std::memory_order_release);
 			mSize.fetch_sub(1);
 			return true;
 		}
 
 	private:
-		struct Node
+		struct Slot
 		{
-			T value;
-			Node* next = nullptr;
-
-			~Node()
-			{
-				if (next)
-				{
-					delete next;
-					next = nullptr;
-				}
-			}
-
+			std::atomic<size_t> Sequence = 0;
+			T Value = {};
 		};
 
-		std::atomic<size_t> mSize = 0;
-		std::atomic<size_t> mMaxSize = 0;
+		std::unique_ptr<Slot[]> mSlots;
+		size_t mMaxSize = 0;
 
-		Node* mHead = nullptr;
-		Node* mTail = nullptr;
+		std::atomic<size_t> mHead = 0;
+		std::atomic<size_t> mTail = 0;
+		std::atomic<size_t> mSize = 0;
 	};
-}
\ No newline at end of file
+}
@@ -31,6 +31,11 @@ namespace ProTerGen
 	   + gNumCascadeShadowMaps
 	   + gNumComputeTextures;
 
+   // Terrain pages generated on the CPU (PageCpuGen_Sdh) instead of with compute shaders (PageGpuGen_Sdh).
+   // Both cache the pages on disk, but only the CPU path caches each layer: editing one layer regenerates only that
+   // layer there, while the GPU path regenerates the whole page.
+   constexpr static bool     gCpuTerrainPages          = false;
+
    constexpr static uint32_t gMaxComputeLayers         = 8;
    constexpr static uint32_t gMaxTerrainMaterialLayers = 8;
    constexpr static uint32_t gWinMinWidth              = 200;
@@ -39,4 +44,5 @@ namespace ProTerGen
    const static std::wstring gTexturesPath = L"..\\res\\Textures\\";
    const static std::wstring gObjsPath     = L"..\\res\\Objs\\";
    const static std::string  gFontsPath    = "..\\res\\Fonts\\";
+   const static std::wstring gCachePath    = L".\\Cache\\";
 }
@@ -0,0 +1,172 @@
+#include "FeedbackAnalyzer.h"
+
+#include <bit>
+#include <cassert>
+#include <thread>
+
+#include "JobSystem.h"
+#include "MathHelpers.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROTERGEN_FEEDBACK_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	using ProTerGen::VT::FeedbackAnalyzer;
+	using ProTerGen::VT::Page;
+
+	// Fewer rows than this per band cost more to dispatch than to scan.
+	constexpr uint32_t MIN_ROWS_PER_BAND = 16;
+
+	constexpr bool RoundTrips(const Page& page)
+	{
+		const Page unpacked = FeedbackAnalyzer::UnpackPixel(FeedbackAnalyzer::PackPixel(page));
+		return FeedbackAnalyzer::IsValidPixel(FeedbackAnalyzer::PackPixel(page))
+			&& unpacked.X == page.X && unpacked.Y == page.Y && unpacked.Mip == page.Mip;
+	}
+
+	// The corners of every mip of a virtual texture of 2^exp pages per row.
+	constexpr bool RoundTripsAllMips(uint32_t exp)
+	{
+		for (uint32_t mip = 0; mip <= exp; ++mip)
+		{
+			const uint32_t last = (1u << (exp - mip)) - 1;
+			if (!RoundTrips({ .X = 0, .Y = 0, .Mip = mip }) || !RoundTrips({ .X = last, .Y = 0, .Mip = mip })
+				|| !RoundTrips({ .X = 0, .Y = last, .Mip = mip }) || !RoundTrips({ .X = last, .Y = last, .Mip = mip }))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	constexpr bool RoundTripsUpTo(uint32_t maxExp)
+	{
+		for (uint32_t exp = 0; exp <= maxExp; ++exp)
+		{
+			if (!RoundTripsAllMips(exp)) return false;
+		}
+		return true;
+	}
+
+	static_assert(RoundTripsUpTo(FeedbackAnalyzer::MAX_TILES_PER_ROW_EXP), "Feedback packing loses pages.");
+	static_assert(FeedbackAnalyzer::MAX_TILES_PER_ROW_EXP <= FeedbackAnalyzer::MIP_MASK, "Feedback packing loses mips.");
+	static_assert(!FeedbackAnalyzer::IsValidPixel(0), "The cleared feedback target must read as no request.");
+	static_assert(FeedbackAnalyzer::MIP_SHIFT + FeedbackAnalyzer::MIP_BITS <= 31, "Mip overlaps the valid bit.");
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::Init(const VTDesc& info, uint32_t width, uint32_t height)
+{
+	assert(info.VTTilesPerRowExp <= MAX_TILES_PER_ROW_EXP && "Virtual texture too large for the feedback packing.");
+	JobSystem::Initialize();
+
+	mIndexer.Init(info);
+	mMaxMip = info.VTTilesPerRowExp;
+	mWidth = width;
+	mHeight = height;
+
+	const uint32_t maxBands = max(1u, mHeight / MIN_ROWS_PER_BAND);
+	const uint32_t bandCount = ProTerGen_clamp(1u, maxBands, std::thread::hardware_concurrency());
+	mBands.resize(bandCount);
+	for (PageRequests& band : mBands)
+	{
+		band.Init(mIndexer.GetCount());
+	}
+	mRequests.Init(mIndexer.GetCount());
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::Analyze(const void* pixels, size_t rowPitch)
+{
+	const uint32_t bandCount = (uint32_t)mBands.size();
+	const uint32_t rowsPerBand = (mHeight + bandCount - 1) / bandCount;
+
+	JobSystem::Context ctx;
+	JobSystem::Dispatch(ctx, bandCount, 1, [&](JobSystem::JobDesc desc)
+		{
+			const uint32_t firstRow = desc.JobIndex * rowsPerBand;
+			const uint32_t lastRow = min(firstRow + rowsPerBand, mHeight);
+			AnalyzeRows((const uint8_t*)pixels, rowPitch, firstRow, lastRow, mBands[desc.JobIndex]);
+		});
+	JobSystem::Wait(ctx);
+
+	for (PageRequests& band : mBands)
+	{
+		Merge(band);
+	}
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::Clear()
+{
+	mRequests.Clear();
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::AnalyzeRows(const uint8_t* pixels, size_t rowPitch, uint32_t firstRow, uint32_t lastRow, PageRequests& band) const
+{
+	for (uint32_t y = firstRow; y < lastRow; ++y)
+	{
+		const uint32_t* row = (const uint32_t*)(pixels + rowPitch * y);
+		uint32_t x = 0;
+		while (x < mWidth)
+		{
+			const uint32_t pixel = row[x];
+			uint32_t end = x + 1;
+#if PROTERGEN_FEEDBACK_SSE2
+			// Four pixels per compare, up to the first one that differs.
+			const __m128i value = _mm_set1_epi32((int32_t)pixel);
+			while (end + 4 <= mWidth)
+			{
+				const __m128i next = _mm_loadu_si128((const __m128i*)(row + end));
+				const uint32_t equal = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(value, next)));
+				end += (uint32_t)std::countr_one(equal);
+				if (equal != 0xF) break;
+			}
+#endif
+			while (end < mWidth && row[end] == pixel)
+			{
+				++end;
+			}
+
+			AddRun(pixel, end - x, band);
+			x = end;
+		}
+	}
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::AddRun(uint32_t pixel, uint32_t count, PageRequests& band) const
+{
+	if (!IsValidPixel(pixel))
+	{
+		return;
+	}
+
+	const Page page = UnpackPixel(pixel);
+	if (!mIndexer.IsValid(page))
+	{
+		return;
+	}
+
+	band.Add(mIndexer.PageIndex(page), count);
+}
+
+void ProTerGen::VT::FeedbackAnalyzer::Merge(PageRequests& band)
+{
+	for (const PageIndex index : band.Touched())
+	{
+		const uint32_t count = band.Count(index);
+
+		// The page requested and every parent of it, up to the whole texture.
+		const Page request = mIndexer.GetPage(index);
+		for (uint32_t i = 0; request.Mip + i <= mMaxMip; ++i)
+		{
+			const Page page = { .X = request.X >> i, .Y = request.Y >> i, .Mip = request.Mip + i };
+			if (!mIndexer.IsValid(page))
+			{
+				break;
+			}
+			mRequests.Add(mIndexer.PageIndex(page), count);
+		}
+	}
+	band.Clear();
+}
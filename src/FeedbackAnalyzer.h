@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VirtualTextureCommon.h"
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		// Turns a feedback readback into page requests, every pixel counting once for its page and the parents of it.
+		// The rows are split in bands over the JobSystem. Each band counts pages in a dense array of its own, indexed
+		// by the PageIndexer, and the bands are merged at the end. A page covers many neighbouring pixels, so runs of
+		// equal pixels are found with SSE2 and counted at once.
+		class FeedbackAnalyzer
+		{
+		public:
+			// Pixels are packed as in pack_feedback of VirtualTexture.hlsli: x in bits 0-12, y in 13-25, mip in
+			// 26-29 and the valid bit 31, set on every pixel the feedback pass wrote.
+			static constexpr uint32_t COORD_BITS = 13;
+			static constexpr uint32_t MIP_BITS = 4;
+			static constexpr uint32_t Y_SHIFT = COORD_BITS;
+			static constexpr uint32_t MIP_SHIFT = 2 * COORD_BITS;
+			static constexpr uint32_t VALID_BIT = 1u << 31;
+			static constexpr uint32_t COORD_MASK = (1u << COORD_BITS) - 1;
+			static constexpr uint32_t MIP_MASK = (1u << MIP_BITS) - 1;
+			// Largest VTDesc::VTTilesPerRowExp whose pages fit in the packing.
+			static constexpr uint32_t MAX_TILES_PER_ROW_EXP = COORD_BITS;
+
+			static constexpr uint32_t PackPixel(const Page& page)
+			{
+				return (page.X & COORD_MASK) | ((page.Y & COORD_MASK) << Y_SHIFT) | ((page.Mip & MIP_MASK) << MIP_SHIFT) | VALID_BIT;
+			}
+			static constexpr bool IsValidPixel(uint32_t pixel) { return (pixel & VALID_BIT) != 0; }
+			static constexpr Page UnpackPixel(uint32_t pixel)
+			{
+				return Page{ .X = pixel & COORD_MASK, .Y = (pixel >> Y_SHIFT) & COORD_MASK, .Mip = (pixel >> MIP_SHIFT) & MIP_MASK };
+			}
+
+		public:
+			void Init(const VTDesc& info, uint32_t width, uint32_t height);
+
+			// pixels: height rows of width packed pixels, rowPitch bytes apart. Adds to the requests.
+			void Analyze(const void* pixels, size_t rowPitch);
+			void Clear();
+
+			inline const PageRequests& Requests() const { return mRequests; }
+
+		private:
+			void AnalyzeRows(const uint8_t* pixels, size_t rowPitch, uint32_t firstRow, uint32_t lastRow, PageRequests& band) const;
+			void AddRun(uint32_t pixel, uint32_t count, PageRequests& band) const;
+			void Merge(PageRequests& band);
+
+			PageIndexer mIndexer{};
+			uint32_t mMaxMip = 0;
+			uint32_t mWidth = 0;
+			uint32_t mHeight = 0;
+			std::vector<PageRequests> mBands; // Pixels per page requested, without the parents.
+
+			PageRequests mRequests{};
+		};
+	}
+}
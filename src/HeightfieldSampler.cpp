@@ -0,0 +1,28 @@
+#include "HeightfieldSampler.h"
+
+void ProTerGen::HeightfieldSampler::Init(const PerlinNoise* noise)
+{
+	mBatch.Init(noise);
+}
+
+void ProTerGen::HeightfieldSampler::SampleGrid(float originX, float originY, float step, uint32_t countX, uint32_t countY, const FBMDesc& fbm, float* heights) const
+{
+	// Flattened so small grids still fill whole SIMD blocks.
+	const size_t count = (size_t)countX * countY;
+	std::vector<float> xs(count);
+	std::vector<float> ys(count);
+	for (uint32_t j = 0; j < countY; ++j)
+	{
+		for (uint32_t i = 0; i < countX; ++i)
+		{
+			xs[(size_t)j * countX + i] = originX + step * i;
+			ys[(size_t)j * countX + i] = originY + step * j;
+		}
+	}
+	mBatch.FBM(xs.data(), ys.data(), count, fbm, heights);
+}
+
+void ProTerGen::HeightfieldSampler::Sample(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* heights) const
+{
+	mBatch.FBM(xs, ys, count, fbm, heights);
+}
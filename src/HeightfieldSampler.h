@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Noiser.h"
+#include "NoiseBatch.h"
+
+namespace ProTerGen
+{
+	// Batched FBM evaluation over a read-only PerlinNoise. The noise must be generated before Init and
+	// not modified afterwards, so one instance can be shared by every worker thread.
+	class HeightfieldSampler
+	{
+	public:
+		HeightfieldSampler() = default;
+		virtual ~HeightfieldSampler() = default;
+
+		void Init(const PerlinNoise* noise);
+
+		// Row major countX * countY grid starting at (originX, originY) with the given spacing. Heights are in [0, 1].
+		void SampleGrid(float originX, float originY, float step, uint32_t countX, uint32_t countY, const FBMDesc& fbm, float* heights) const;
+		void Sample(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* heights) const;
+
+		inline const NoiseBatch& GetBatch() const { return mBatch; }
+	protected:
+		NoiseBatch mBatch{};
+	};
+}
@@ -1,7 +1,10 @@
+#include <io.h>
+
 #include "ImageRawData.h"
 
 ProTerGen::FileRawData::~FileRawData()
 {
+	UnmapView();
 	if (File)
 	{
 		fclose(File);
@@ -15,6 +18,42 @@ void ProTerGen::FileRawData::RewindPtr() const
 	if (_fseeki64(File, offset, SEEK_SET) != 0) perror("fseek");
 }
 
+bool ProTerGen::FileRawData::MapView()
+{
+	if (View) return true;
+	if (!File) return false;
+
+	fflush(File);
+	const HANDLE file = (HANDLE)_get_osfhandle(_fileno(File));
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	Mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!Mapping) return false;
+
+	View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!View)
+	{
+		CloseHandle(Mapping);
+		Mapping = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void ProTerGen::FileRawData::UnmapView()
+{
+	if (View)
+	{
+		UnmapViewOfFile(View);
+		View = nullptr;
+	}
+	if (Mapping)
+	{
+		CloseHandle(Mapping);
+		Mapping = nullptr;
+	}
+}
+
 void ProTerGen::FileRawData::CopyTo(void* dst, const Point& dstOffset, const Rectangle& srcRegion) const
 {
 	const uint32_t width = min(Width - srcRegion.X, srcRegion.Width);
@@ -13,10 +13,19 @@ namespace ProTerGen
 		uint32_t FormatSize = 0;
 		int32_t Offset = -1;
 
+		// Read only view of the whole file, see MapView.
+		HANDLE Mapping = nullptr;
+		const void* View = nullptr;
+
 		~FileRawData();
 
 		void RewindPtr() const;
 
+		// Maps the file so the pixels can be read from any thread without seeking the shared FILE.
+		bool MapView();
+		void UnmapView();
+		inline const uint8_t* Pixels() const { return View ? (const uint8_t*)View + max(0, Offset) : nullptr; }
+
 		// SRC region width and height should be the same as the dest pointer.
 		void CopyTo(void* dst, const Point& destOffset, const Rectangle& srcRegion) const;
 		void WriteIn(const void* src, const Point& destOffset, const Rectangle& srcRegion) const;
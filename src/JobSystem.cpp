@@ -1,7 +1,18 @@
 #include "JobSystem.h"
 #include "ConcurrentQueue.h"
 
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include "CommonHeaders.h"
+#endif
 
 namespace ProTerGen::JobSystem
 {
@@ -96,11 +107,11 @@ namespace ProTerGen::JobSystem
 		{
 			return;
 		}
-		maxThreadCount = max(1u, maxThreadCount);
+		maxThreadCount = (std::max)(1u, maxThreadCount);
 
 		sInternalState.NumCores = std::thread::hardware_concurrency();
 
-		sInternalState.NumThreads = min(maxThreadCount, max(1u, sInternalState.NumCores - 1));
+		sInternalState.NumThreads = (std::min)(maxThreadCount, (std::max)(1u, sInternalState.NumCores - 1));
 		sInternalState.JobQueuePerThread.reset(new JobQueue[sInternalState.NumThreads]);
 		sInternalState.Threads.reserve(sInternalState.NumThreads);
 
@@ -116,6 +127,8 @@ namespace ProTerGen::JobSystem
 					}
 				});
 
+#ifdef _WIN32
+			// Pinning and naming are only for the profilers of the editor; elsewhere the scheduler places the workers.
 			std::thread& worker = sInternalState.Threads.back();
 
 			HANDLE handle = (HANDLE)worker.native_handle();
@@ -126,6 +139,7 @@ namespace ProTerGen::JobSystem
 
 			std::wstring threadName = L"JobThread_" + std::to_wstring(threadId);
 			assert(SUCCEEDED(SetThreadDescription(handle, threadName.c_str())));
+#endif
 		}
 	}
 
@@ -167,7 +181,7 @@ namespace ProTerGen::JobSystem
 		{
 			job.GroupId = groupId;
 			job.GroupJobOffset = groupId * groupSize;
-			job.GroupJobEnd = min(job.GroupJobOffset + groupSize, jobCount);
+			job.GroupJobEnd = (std::min)(job.GroupJobOffset + groupSize, jobCount);
 
 			sInternalState.JobQueuePerThread[sInternalState.NextQueue.fetch_add(1) % sInternalState.NumThreads].Enqueue(job);
 		}
@@ -5,8 +5,8 @@
 
 #pragma once
 
-#include "CommonHeaders.h"
-
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <atomic>
 
@@ -0,0 +1,542 @@
+#include "LatticeNoiseBatch.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROTERGEN_LATTICE_BATCH_X64 1
+#include <immintrin.h>
+#endif
+
+// MSVC accepts any intrinsic in any function; GCC and Clang need the target enabled per function.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PROTERGEN_TARGET(isa)
+#else
+#define PROTERGEN_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace
+{
+	// Widest kernel, in floats. Grid rows are padded to it so the row kernels have no tail.
+	constexpr uint32_t GRID_ROW_ALIGNMENT = 16;
+
+	// The hash of the high half of a cell for both signs of a 32 bit cell, see LatticeNoise::AxisHash.
+	struct AxisSeed
+	{
+		uint32_t Positive = 0;
+		uint32_t Negative = 0;
+	};
+
+	// One grid row of an octave: the columns come hashed, the row is the same for every sample.
+	struct LatticeRow
+	{
+		const float*    FracX  = nullptr;
+		const uint32_t* HashX0 = nullptr;
+		const uint32_t* HashX1 = nullptr;
+		float           FracY  = 0.0f;
+		uint32_t        HashY0 = 0;
+		uint32_t        HashY1 = 0;
+		float           Amplitude = 1.0f;
+	};
+
+	using PointKernel = void(*)(AxisSeed seedX, AxisSeed seedY, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values);
+	// Adds Amplitude * noise to values, count is a multiple of GRID_ROW_ALIGNMENT.
+	using RowKernel = void(*)(const LatticeRow& row, uint32_t count, float* values);
+
+	inline AxisSeed MakeAxisSeed(uint32_t axisSeed)
+	{
+		return AxisSeed{ .Positive = ProTerGen::LatticeNoise::Mix(axisSeed), .Negative = ProTerGen::LatticeNoise::Mix(~axisSeed) };
+	}
+
+	// Runs a W wide kernel over count points; the tail goes through a zero padded block so every
+	// point is computed by the same code.
+	template<size_t W, typename Block>
+	inline void ForEachBlock(const float* xs, const float* ys, size_t count, float* values, Block block)
+	{
+		size_t i = 0;
+		for (; i + W <= count; i += W)
+		{
+			block(xs + i, ys + i, values + i);
+		}
+		if (i < count)
+		{
+			float tx[W]{};
+			float ty[W]{};
+			float tv[W]{};
+			memcpy(tx, xs + i, (count - i) * sizeof(float));
+			memcpy(ty, ys + i, (count - i) * sizeof(float));
+			block(tx, ty, tv);
+			memcpy(values + i, tv, (count - i) * sizeof(float));
+		}
+	}
+
+#if PROTERGEN_LATTICE_BATCH_X64
+#pragma region SSE2
+	inline __m128 Floor4(__m128 x)
+	{
+		// Truncation rounds towards zero, so negative non integer values need one less.
+		const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+
+	// Same operation order as LatticeFade.
+	inline __m128 Fade4(__m128 t)
+	{
+		__m128 r = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+		r = _mm_add_ps(_mm_mul_ps(t, r), _mm_set1_ps(10.0f));
+		return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), r);
+	}
+
+	inline __m128 Lerp4(__m128 t, __m128 a, __m128 b)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+	}
+
+	inline __m128 Select4(__m128i mask, __m128 a, __m128 b)
+	{
+		const __m128 m = _mm_castsi128_ps(mask);
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+
+	// _mm_mullo_epi32 is SSE4.1: multiply the even and odd lanes into 64 bits and keep the low halves.
+	inline __m128i Mul4(__m128i a, __m128i b)
+	{
+		const __m128i even = _mm_mul_epu32(a, b);
+		const __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// LatticeNoise::Mix.
+	inline __m128i Mix4(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		x = Mul4(x, _mm_set1_epi32(0x7FEB352D));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+		x = Mul4(x, _mm_set1_epi32((int32_t)0x846CA68Bu));
+		return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	}
+
+	// LatticeNoise::AxisHash of 32 bit cells, whose high half is their sign.
+	inline __m128i AxisHash4(__m128i cell, const AxisSeed& seed)
+	{
+		const __m128i negative = _mm_cmplt_epi32(cell, _mm_setzero_si128());
+		const __m128i high     = _mm_or_si128(_mm_and_si128(negative, _mm_set1_epi32((int32_t)seed.Negative)), _mm_andnot_si128(negative, _mm_set1_epi32((int32_t)seed.Positive)));
+		return Mix4(_mm_xor_si128(cell, high));
+	}
+
+	// Same gradients as LatticeGrad without branches: the top three bits pick the gradient, 6 and 7 use y alone,
+	// below 4 y is added to x.
+	inline __m128 Grad4(__m128i hash, __m128 x, __m128 y)
+	{
+		const __m128i g     = _mm_srli_epi32(hash, 29);
+		const __m128  signA = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(1)), 31));
+		const __m128  signB = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(2)), 30));
+		const __m128i useY  = _mm_cmpeq_epi32(_mm_and_si128(g, _mm_set1_epi32(6)), _mm_set1_epi32(6));
+		const __m128i pair  = _mm_cmplt_epi32(g, _mm_set1_epi32(4));
+		const __m128  a     = _mm_xor_ps(Select4(useY, y, x), signA);
+		const __m128  b     = _mm_and_ps(_mm_castsi128_ps(pair), _mm_xor_ps(y, signB));
+		return _mm_add_ps(a, b);
+	}
+
+	// LatticeNoise::Lattice.
+	inline __m128 Lattice4(__m128 fx, __m128 fy, __m128i hx0, __m128i hx1, __m128i hy0, __m128i hy1)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 u   = Fade4(fx);
+		const __m128 v   = Fade4(fy);
+		const __m128 fx1 = _mm_sub_ps(fx, one);
+		const __m128 fy1 = _mm_sub_ps(fy, one);
+
+		const __m128 corner0 = Grad4(Mix4(_mm_xor_si128(hx0, hy0)), fx,  fy);
+		const __m128 corner1 = Grad4(Mix4(_mm_xor_si128(hx1, hy0)), fx1, fy);
+		const __m128 corner2 = Grad4(Mix4(_mm_xor_si128(hx0, hy1)), fx,  fy1);
+		const __m128 corner3 = Grad4(Mix4(_mm_xor_si128(hx1, hy1)), fx1, fy1);
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		return _mm_add_ps(half, _mm_mul_ps(Lerp4(v, Lerp4(u, corner0, corner1), Lerp4(u, corner2, corner3)), half));
+	}
+
+	void FBMSSE2(AxisSeed seedX, AxisSeed seedY, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<4>(xs, ys, count, values, [&](const float* bx, const float* by, float* out)
+		{
+			const __m128  x     = _mm_loadu_ps(bx);
+			const __m128  y     = _mm_loadu_ps(by);
+			const __m128i one   = _mm_set1_epi32(1);
+			__m128 value        = _mm_setzero_ps();
+			float  amplitude    = 1.0f;
+			float  frecuency    = fbm.Frecuency;
+			float  norm         = 0.0f;
+			for (uint32_t o = 0; o < fbm.Octaves; ++o)
+			{
+				const __m128  f  = _mm_set1_ps(frecuency);
+				const __m128  px = _mm_mul_ps(x, f);
+				const __m128  py = _mm_mul_ps(y, f);
+				const __m128  fx = Floor4(px);
+				const __m128  fy = Floor4(py);
+				const __m128i cx = _mm_cvttps_epi32(fx);
+				const __m128i cy = _mm_cvttps_epi32(fy);
+				const __m128  n  = Lattice4(_mm_sub_ps(px, fx), _mm_sub_ps(py, fy),
+					AxisHash4(cx, seedX), AxisHash4(_mm_add_epi32(cx, one), seedX),
+					AxisHash4(cy, seedY), AxisHash4(_mm_add_epi32(cy, one), seedY));
+				value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(amplitude), n));
+				frecuency *= 2.0f;
+				norm      += amplitude;
+				amplitude *= fbm.Gain;
+			}
+			_mm_storeu_ps(out, _mm_div_ps(value, _mm_set1_ps(norm)));
+		});
+	}
+
+	void RowSSE2(const LatticeRow& row, uint32_t count, float* values)
+	{
+		const __m128  fy        = _mm_set1_ps(row.FracY);
+		const __m128i hy0       = _mm_set1_epi32((int32_t)row.HashY0);
+		const __m128i hy1       = _mm_set1_epi32((int32_t)row.HashY1);
+		const __m128  amplitude = _mm_set1_ps(row.Amplitude);
+		for (uint32_t i = 0; i < count; i += 4)
+		{
+			const __m128i hx0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.HashX0 + i));
+			const __m128i hx1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row.HashX1 + i));
+			const __m128  n   = Lattice4(_mm_loadu_ps(row.FracX + i), fy, hx0, hx1, hy0, hy1);
+			_mm_storeu_ps(values + i, _mm_add_ps(_mm_loadu_ps(values + i), _mm_mul_ps(amplitude, n)));
+		}
+	}
+#pragma endregion
+
+#pragma region AVX2
+	PROTERGEN_TARGET("avx2") inline __m256 Lerp8(__m256 t, __m256 a, __m256 b)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Fade8(__m256 t)
+	{
+		__m256 r = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+		r = _mm256_add_ps(_mm256_mul_ps(t, r), _mm256_set1_ps(10.0f));
+		return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), r);
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256i Mix8(__m256i x)
+	{
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+		x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+		x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+		x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int32_t)0x846CA68Bu));
+		return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256i AxisHash8(__m256i cell, const AxisSeed& seed)
+	{
+		const __m256i negative = _mm256_cmpgt_epi32(_mm256_setzero_si256(), cell);
+		const __m256i high     = _mm256_blendv_epi8(_mm256_set1_epi32((int32_t)seed.Positive), _mm256_set1_epi32((int32_t)seed.Negative), negative);
+		return Mix8(_mm256_xor_si256(cell, high));
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Grad8(__m256i hash, __m256 x, __m256 y)
+	{
+		const __m256i g     = _mm256_srli_epi32(hash, 29);
+		const __m256  signA = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(g, _mm256_set1_epi32(1)), 31));
+		const __m256  signB = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(g, _mm256_set1_epi32(2)), 30));
+		const __m256  useY  = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(g, _mm256_set1_epi32(6)), _mm256_set1_epi32(6)));
+		const __m256  pair  = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), g));
+		const __m256  a     = _mm256_xor_ps(_mm256_blendv_ps(x, y, useY), signA);
+		const __m256  b     = _mm256_and_ps(pair, _mm256_xor_ps(y, signB));
+		return _mm256_add_ps(a, b);
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Lattice8(__m256 fx, __m256 fy, __m256i hx0, __m256i hx1, __m256i hy0, __m256i hy1)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 u   = Fade8(fx);
+		const __m256 v   = Fade8(fy);
+		const __m256 fx1 = _mm256_sub_ps(fx, one);
+		const __m256 fy1 = _mm256_sub_ps(fy, one);
+
+		const __m256 corner0 = Grad8(Mix8(_mm256_xor_si256(hx0, hy0)), fx,  fy);
+		const __m256 corner1 = Grad8(Mix8(_mm256_xor_si256(hx1, hy0)), fx1, fy);
+		const __m256 corner2 = Grad8(Mix8(_mm256_xor_si256(hx0, hy1)), fx,  fy1);
+		const __m256 corner3 = Grad8(Mix8(_mm256_xor_si256(hx1, hy1)), fx1, fy1);
+
+		const __m256 half = _mm256_set1_ps(0.5f);
+		return _mm256_add_ps(half, _mm256_mul_ps(Lerp8(v, Lerp8(u, corner0, corner1), Lerp8(u, corner2, corner3)), half));
+	}
+
+	PROTERGEN_TARGET("avx2") void FBMAVX2Block(AxisSeed seedX, AxisSeed seedY, const float* bx, const float* by, const ProTerGen::FBMDesc& fbm, float* out)
+	{
+		const __m256  x     = _mm256_loadu_ps(bx);
+		const __m256  y     = _mm256_loadu_ps(by);
+		const __m256i one   = _mm256_set1_epi32(1);
+		__m256 value        = _mm256_setzero_ps();
+		float  amplitude    = 1.0f;
+		float  frecuency    = fbm.Frecuency;
+		float  norm         = 0.0f;
+		for (uint32_t o = 0; o < fbm.Octaves; ++o)
+		{
+			const __m256  f  = _mm256_set1_ps(frecuency);
+			const __m256  px = _mm256_mul_ps(x, f);
+			const __m256  py = _mm256_mul_ps(y, f);
+			const __m256  fx = _mm256_floor_ps(px);
+			const __m256  fy = _mm256_floor_ps(py);
+			const __m256i cx = _mm256_cvttps_epi32(fx);
+			const __m256i cy = _mm256_cvttps_epi32(fy);
+			const __m256  n  = Lattice8(_mm256_sub_ps(px, fx), _mm256_sub_ps(py, fy),
+				AxisHash8(cx, seedX), AxisHash8(_mm256_add_epi32(cx, one), seedX),
+				AxisHash8(cy, seedY), AxisHash8(_mm256_add_epi32(cy, one), seedY));
+			value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(amplitude), n));
+			frecuency *= 2.0f;
+			norm      += amplitude;
+			amplitude *= fbm.Gain;
+		}
+		_mm256_storeu_ps(out, _mm256_div_ps(value, _mm256_set1_ps(norm)));
+	}
+
+	void FBMAVX2(AxisSeed seedX, AxisSeed seedY, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<8>(xs, ys, count, values, [&](const float* bx, const float* by, float* out) { FBMAVX2Block(seedX, seedY, bx, by, fbm, out); });
+	}
+
+	PROTERGEN_TARGET("avx2") void RowAVX2(const LatticeRow& row, uint32_t count, float* values)
+	{
+		const __m256  fy        = _mm256_set1_ps(row.FracY);
+		const __m256i hy0       = _mm256_set1_epi32((int32_t)row.HashY0);
+		const __m256i hy1       = _mm256_set1_epi32((int32_t)row.HashY1);
+		const __m256  amplitude = _mm256_set1_ps(row.Amplitude);
+		for (uint32_t i = 0; i < count; i += 8)
+		{
+			const __m256i hx0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row.HashX0 + i));
+			const __m256i hx1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row.HashX1 + i));
+			const __m256  n   = Lattice8(_mm256_loadu_ps(row.FracX + i), fy, hx0, hx1, hy0, hy1);
+			_mm256_storeu_ps(values + i, _mm256_add_ps(_mm256_loadu_ps(values + i), _mm256_mul_ps(amplitude, n)));
+		}
+	}
+#pragma endregion
+
+#pragma region AVX512
+	PROTERGEN_TARGET("avx512f") inline __m512 Lerp16(__m512 t, __m512 a, __m512 b)
+	{
+		return _mm512_add_ps(a, _mm512_mul_ps(t, _mm512_sub_ps(b, a)));
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Fade16(__m512 t)
+	{
+		__m512 r = _mm512_sub_ps(_mm512_mul_ps(t, _mm512_set1_ps(6.0f)), _mm512_set1_ps(15.0f));
+		r = _mm512_add_ps(_mm512_mul_ps(t, r), _mm512_set1_ps(10.0f));
+		return _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(t, t), t), r);
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512i Mix16(__m512i x)
+	{
+		x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+		x = _mm512_mullo_epi32(x, _mm512_set1_epi32(0x7FEB352D));
+		x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 15));
+		x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int32_t)0x846CA68Bu));
+		return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512i AxisHash16(__m512i cell, const AxisSeed& seed)
+	{
+		const __mmask16 negative = _mm512_cmplt_epi32_mask(cell, _mm512_setzero_si512());
+		const __m512i   high     = _mm512_mask_blend_epi32(negative, _mm512_set1_epi32((int32_t)seed.Positive), _mm512_set1_epi32((int32_t)seed.Negative));
+		return Mix16(_mm512_xor_si512(cell, high));
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Grad16(__m512i hash, __m512 x, __m512 y)
+	{
+		const __m512i   g     = _mm512_srli_epi32(hash, 29);
+		const __m512i   signA = _mm512_slli_epi32(_mm512_and_si512(g, _mm512_set1_epi32(1)), 31);
+		const __m512i   signB = _mm512_slli_epi32(_mm512_and_si512(g, _mm512_set1_epi32(2)), 30);
+		const __mmask16 useY  = _mm512_cmpeq_epi32_mask(_mm512_and_si512(g, _mm512_set1_epi32(6)), _mm512_set1_epi32(6));
+		const __mmask16 pair  = _mm512_cmplt_epi32_mask(g, _mm512_set1_epi32(4));
+		const __m512    a     = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_mask_blend_ps(useY, x, y)), signA));
+		const __m512    b     = _mm512_maskz_mov_ps(pair, _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(y), signB)));
+		return _mm512_add_ps(a, b);
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Lattice16(__m512 fx, __m512 fy, __m512i hx0, __m512i hx1, __m512i hy0, __m512i hy1)
+	{
+		const __m512 one = _mm512_set1_ps(1.0f);
+		const __m512 u   = Fade16(fx);
+		const __m512 v   = Fade16(fy);
+		const __m512 fx1 = _mm512_sub_ps(fx, one);
+		const __m512 fy1 = _mm512_sub_ps(fy, one);
+
+		const __m512 corner0 = Grad16(Mix16(_mm512_xor_si512(hx0, hy0)), fx,  fy);
+		const __m512 corner1 = Grad16(Mix16(_mm512_xor_si512(hx1, hy0)), fx1, fy);
+		const __m512 corner2 = Grad16(Mix16(_mm512_xor_si512(hx0, hy1)), fx,  fy1);
+		const __m512 corner3 = Grad16(Mix16(_mm512_xor_si512(hx1, hy1)), fx1, fy1);
+
+		const __m512 half = _mm512_set1_ps(0.5f);
+		return _mm512_add_ps(half, _mm512_mul_ps(Lerp16(v, Lerp16(u, corner0, corner1), Lerp16(u, corner2, corner3)), half));
+	}
+
+	PROTERGEN_TARGET("avx512f") void FBMAVX512Block(AxisSeed seedX, AxisSeed seedY, const float* bx, const float* by, const ProTerGen::FBMDesc& fbm, float* out)
+	{
+		const __m512  x     = _mm512_loadu_ps(bx);
+		const __m512  y     = _mm512_loadu_ps(by);
+		const __m512i one   = _mm512_set1_epi32(1);
+		__m512 value        = _mm512_setzero_ps();
+		float  amplitude    = 1.0f;
+		float  frecuency    = fbm.Frecuency;
+		float  norm         = 0.0f;
+		for (uint32_t o = 0; o < fbm.Octaves; ++o)
+		{
+			const __m512  f  = _mm512_set1_ps(frecuency);
+			const __m512  px = _mm512_mul_ps(x, f);
+			const __m512  py = _mm512_mul_ps(y, f);
+			const __m512  fx = _mm512_roundscale_ps(px, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+			const __m512  fy = _mm512_roundscale_ps(py, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+			const __m512i cx = _mm512_cvttps_epi32(fx);
+			const __m512i cy = _mm512_cvttps_epi32(fy);
+			const __m512  n  = Lattice16(_mm512_sub_ps(px, fx), _mm512_sub_ps(py, fy),
+				AxisHash16(cx, seedX), AxisHash16(_mm512_add_epi32(cx, one), seedX),
+				AxisHash16(cy, seedY), AxisHash16(_mm512_add_epi32(cy, one), seedY));
+			value = _mm512_add_ps(value, _mm512_mul_ps(_mm512_set1_ps(amplitude), n));
+			frecuency *= 2.0f;
+			norm      += amplitude;
+			amplitude *= fbm.Gain;
+		}
+		_mm512_storeu_ps(out, _mm512_div_ps(value, _mm512_set1_ps(norm)));
+	}
+
+	void FBMAVX512(AxisSeed seedX, AxisSeed seedY, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<16>(xs, ys, count, values, [&](const float* bx, const float* by, float* out) { FBMAVX512Block(seedX, seedY, bx, by, fbm, out); });
+	}
+
+	PROTERGEN_TARGET("avx512f") void RowAVX512(const LatticeRow& row, uint32_t count, float* values)
+	{
+		const __m512  fy        = _mm512_set1_ps(row.FracY);
+		const __m512i hy0       = _mm512_set1_epi32((int32_t)row.HashY0);
+		const __m512i hy1       = _mm512_set1_epi32((int32_t)row.HashY1);
+		const __m512  amplitude = _mm512_set1_ps(row.Amplitude);
+		for (uint32_t i = 0; i < count; i += 16)
+		{
+			const __m512i hx0 = _mm512_loadu_si512(row.HashX0 + i);
+			const __m512i hx1 = _mm512_loadu_si512(row.HashX1 + i);
+			const __m512  n   = Lattice16(_mm512_loadu_ps(row.FracX + i), fy, hx0, hx1, hy0, hy1);
+			_mm512_storeu_ps(values + i, _mm512_add_ps(_mm512_loadu_ps(values + i), _mm512_mul_ps(amplitude, n)));
+		}
+	}
+#pragma endregion
+#endif
+
+	PointKernel GetPointKernel(ProTerGen::NoiseBatchISA isa)
+	{
+#if PROTERGEN_LATTICE_BATCH_X64
+		switch (isa)
+		{
+		case ProTerGen::NoiseBatchISA::SSE2:   return &FBMSSE2;
+		case ProTerGen::NoiseBatchISA::AVX2:   return &FBMAVX2;
+		case ProTerGen::NoiseBatchISA::AVX512: return &FBMAVX512;
+		default: break;
+		}
+#endif
+		return nullptr;
+	}
+
+	RowKernel GetRowKernel(ProTerGen::NoiseBatchISA isa)
+	{
+#if PROTERGEN_LATTICE_BATCH_X64
+		switch (isa)
+		{
+		case ProTerGen::NoiseBatchISA::SSE2:   return &RowSSE2;
+		case ProTerGen::NoiseBatchISA::AVX2:   return &RowAVX2;
+		case ProTerGen::NoiseBatchISA::AVX512: return &RowAVX512;
+		default: break;
+		}
+#endif
+		return nullptr;
+	}
+}
+
+void ProTerGen::LatticeNoiseBatch::Init(const LatticeNoise* noise, NoiseBatchISA isa)
+{
+	mNoise = noise;
+	const NoiseBatchISA best = NoiseBatch::DetectISA();
+	mISA = (uint8_t)isa > (uint8_t)best ? best : isa;
+}
+
+void ProTerGen::LatticeNoiseBatch::Noise(const float* xs, const float* ys, size_t count, float* values) const
+{
+	// A single octave at unit frecuency is the plain noise.
+	FBM(xs, ys, count, FBMDesc{ .Octaves = 1, .Frecuency = 1.0f, .Gain = 1.0f }, values);
+}
+
+void ProTerGen::LatticeNoiseBatch::FBM(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* values) const
+{
+	assert(mNoise != nullptr);
+	const PointKernel kernel = GetPointKernel(mISA);
+	if (kernel == nullptr)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			values[i] = (float)mNoise->FBM(xs[i], ys[i], fbm.Octaves, fbm.Frecuency, fbm.Gain);
+		}
+		return;
+	}
+	kernel(MakeAxisSeed(mNoise->GetSeedX()), MakeAxisSeed(mNoise->GetSeedY()), xs, ys, count, fbm, values);
+}
+
+void ProTerGen::LatticeNoiseBatch::FBMGrid(double originX, double originY, double step, uint32_t countX, uint32_t countY, const FBMDesc& fbm, float* values) const
+{
+	assert(mNoise != nullptr);
+	const RowKernel kernel = GetRowKernel(mISA);
+	if (kernel == nullptr)
+	{
+		mNoise->FBMGrid(originX, originY, step, countX, countY, fbm.Octaves, fbm.Frecuency, fbm.Gain, values);
+		return;
+	}
+
+	// Same splitting as LatticeNoise::FBMGrid; the rows are padded so the kernels have no tail.
+	const uint32_t stride = (countX + GRID_ROW_ALIGNMENT - 1) & ~(GRID_ROW_ALIGNMENT - 1);
+	std::vector<float> grid((size_t)stride * countY, 0.0f);
+	std::vector<float> columnFrac(stride, 0.0f);
+	std::vector<uint32_t> columnHash0(stride, 0);
+	std::vector<uint32_t> columnHash1(stride, 0);
+	double frecuency = fbm.Frecuency;
+	double amplitude = 1.0;
+	double norm = 0.0;
+	for (uint32_t o = 0; o < fbm.Octaves; ++o)
+	{
+		const NoiseCoord2 origin = NoiseCoord2::FromDouble(originX * frecuency, originY * frecuency);
+		const float octaveStep = (float)(step * frecuency);
+		for (uint32_t i = 0; i < countX; ++i)
+		{
+			const float offset = origin.FracX + octaveStep * i;
+			const float cell = std::floor(offset);
+			const int64_t cellX = origin.CellX + (int64_t)cell;
+			columnFrac[i] = offset - cell;
+			columnHash0[i] = LatticeNoise::AxisHash(cellX, mNoise->GetSeedX());
+			columnHash1[i] = LatticeNoise::AxisHash(cellX + 1, mNoise->GetSeedX());
+		}
+
+		LatticeRow row = { .FracX = columnFrac.data(), .HashX0 = columnHash0.data(), .HashX1 = columnHash1.data(), .Amplitude = (float)amplitude };
+		for (uint32_t j = 0; j < countY; ++j)
+		{
+			const float offset = origin.FracY + octaveStep * j;
+			const float cell = std::floor(offset);
+			const int64_t cellY = origin.CellY + (int64_t)cell;
+			row.FracY = offset - cell;
+			row.HashY0 = LatticeNoise::AxisHash(cellY, mNoise->GetSeedY());
+			row.HashY1 = LatticeNoise::AxisHash(cellY + 1, mNoise->GetSeedY());
+			kernel(row, stride, grid.data() + (size_t)j * stride);
+		}
+
+		frecuency *= 2.0;
+		norm += amplitude;
+		amplitude *= fbm.Gain;
+	}
+
+	const float invNorm = norm > 0.0 ? (float)(1.0 / norm) : 0.0f;
+	for (uint32_t j = 0; j < countY; ++j)
+	{
+		const float* src = grid.data() + (size_t)j * stride;
+		float* dst = values + (size_t)j * countX;
+		for (uint32_t i = 0; i < countX; ++i)
+		{
+			dst[i] = src[i] * invNorm;
+		}
+	}
+}
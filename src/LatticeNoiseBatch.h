@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include "Noiser.h"
+#include "NoiseBatch.h"
+
+namespace ProTerGen
+{
+	// NoiseBatch for LatticeNoise: the same kernels and runtime dispatch, over the hashed lattice instead of
+	// the permutation table. LatticeNoise stays the reference; the batched results differ from it by float
+	// rounding only (~1e-6).
+	// The noise must be generated before Init and not modified while a LatticeNoiseBatch refers to it.
+	class LatticeNoiseBatch
+	{
+	public:
+		LatticeNoiseBatch() = default;
+		virtual ~LatticeNoiseBatch() = default;
+
+		// Requests wider than the CPU supports fall back to the best available one.
+		void Init(const LatticeNoise* noise, NoiseBatchISA isa = NoiseBatch::DetectISA());
+
+		// Points in float, so their cells must fit in 32 bits and precision drops far from the origin.
+		void Noise(const float* xs, const float* ys, size_t count, float* values) const;
+		void FBM(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* values) const;
+		// LatticeNoise::FBMGrid: only the origin is in double, so grids far from the origin keep their precision.
+		void FBMGrid(double originX, double originY, double step, uint32_t countX, uint32_t countY, const FBMDesc& fbm, float* values) const;
+
+		inline NoiseBatchISA GetISA() const { return mISA; }
+		inline const LatticeNoise* GetNoise() const { return mNoise; }
+	protected:
+		const LatticeNoise* mNoise = nullptr;
+		NoiseBatchISA       mISA   = NoiseBatchISA::SCALAR;
+	};
+}
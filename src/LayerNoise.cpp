@@ -0,0 +1,866 @@
+#include "LayerNoise.h"
+#include "Noiser.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROTERGEN_LAYER_NOISE_SSE2 1
+#include <emmintrin.h>
+#include "SseMath.h"
+#endif
+
+namespace
+{
+	constexpr float PI = 3.14159265358979f;
+
+	struct Float2
+	{
+		float x = 0.0f;
+		float y = 0.0f;
+	};
+
+	// Value, gradient and hessian of one noised() evaluation.
+	struct NoiseHessian
+	{
+		float Value = 0.0f;
+		float Gx    = 0.0f;
+		float Gy    = 0.0f;
+		float Hxx   = 0.0f;
+		float Hxy   = 0.0f;
+		float Hyy   = 0.0f;
+	};
+
+	inline float Frac(float x)
+	{
+		return x - std::floor(x);
+	}
+
+	inline float Clamp(float x, float lo, float hi)
+	{
+		return x < lo ? lo : (x > hi ? hi : x);
+	}
+
+	inline float SlopeFromGradient(float gradientLength)
+	{
+		// degrees(atan(g)) / 90
+		return (std::atan(gradientLength) * (180.0f / PI)) / 90.0f;
+	}
+
+	inline Float2 Hash(Float2 x, float kx, float ky)
+	{
+		x.x = x.x * kx + ky;
+		x.y = x.y * ky + kx;
+		const float t = Frac(x.x * x.y * (x.x + x.y));
+		return { -1.0f + 2.0f * Frac(16.0f * kx * t), -1.0f + 2.0f * Frac(16.0f * ky * t) };
+	}
+
+	// random()
+	inline Float2 Random(Float2 x)
+	{
+		return Hash(x, 0.3183099f, 0.3678794f);
+	}
+
+	// random_seed()
+	inline Float2 RandomSeed(Float2 x, float seed)
+	{
+		const float q = x.x / x.y;
+		uint32_t bits = 0;
+		memcpy(&bits, &q, sizeof(bits));
+		const uint32_t c = (bits & (uint32_t)seed) ^ (uint32_t)(0.314159f * seed);
+		return Hash(x, 0.3183099f * (float)c / seed, 0.3678794f);
+	}
+
+	template<typename R>
+	NoiseHessian NoisedHessian(float px, float py, R random)
+	{
+		const float ix = std::floor(px);
+		const float iy = std::floor(py);
+		const float fx = Frac(px);
+		const float fy = Frac(py);
+
+		const float ux   = fx * fx * fx * (fx * (fx * 6.0f - 15.0f) + 10.0f);
+		const float uy   = fy * fy * fy * (fy * (fy * 6.0f - 15.0f) + 10.0f);
+		const float dux  = 30.0f * fx * fx * (fx * (fx - 2.0f) + 1.0f);
+		const float duy  = 30.0f * fy * fy * (fy * (fy - 2.0f) + 1.0f);
+		const float ddux = 60.0f * fx * (fx * (2.0f * fx - 3.0f) + 1.0f);
+		const float dduy = 60.0f * fy * (fy * (2.0f * fy - 3.0f) + 1.0f);
+
+		const Float2 ga = random(Float2{ ix + 0.0f, iy + 0.0f });
+		const Float2 gb = random(Float2{ ix + 1.0f, iy + 0.0f });
+		const Float2 gc = random(Float2{ ix + 0.0f, iy + 1.0f });
+		const Float2 gd = random(Float2{ ix + 1.0f, iy + 1.0f });
+
+		const float va = ga.x * (fx - 0.0f) + ga.y * (fy - 0.0f);
+		const float vb = gb.x * (fx - 1.0f) + gb.y * (fy - 0.0f);
+		const float vc = gc.x * (fx - 0.0f) + gc.y * (fy - 1.0f);
+		const float vd = gd.x * (fx - 1.0f) + gd.y * (fy - 1.0f);
+
+		// n = k0 + ux k1 + uy k2 + ux uy k3, where every k is linear in f with gradient g1..g3.
+		const float k1 = vb - va;
+		const float k2 = vc - va;
+		const float k3 = va - vb - vc + vd;
+		const Float2 g1 = { gb.x - ga.x, gb.y - ga.y };
+		const Float2 g2 = { gc.x - ga.x, gc.y - ga.y };
+		const Float2 g3 = { ga.x - gb.x - gc.x + gd.x, ga.y - gb.y - gc.y + gd.y };
+
+		NoiseHessian n{};
+		n.Value = va + ux * (vb - va) + uy * (vc - va) + ux * uy * (va - vb - vc + vd);
+		n.Gx    = ga.x + ux * g1.x + uy * g2.x + ux * uy * g3.x + dux * (uy * k3 + vb - va);
+		n.Gy    = ga.y + ux * g1.y + uy * g2.y + ux * uy * g3.y + duy * (ux * k3 + vc - va);
+		n.Hxx   = 2.0f * dux * (g1.x + uy * g3.x) + ddux * (k1 + uy * k3);
+		n.Hyy   = 2.0f * duy * (g2.y + ux * g3.y) + dduy * (k2 + ux * k3);
+		n.Hxy   = duy * (g2.x + ux * g3.x) + dux * (g1.y + uy * g3.y + duy * k3);
+		return n;
+	}
+
+	inline float Smoothstep(float a, float b, float x)
+	{
+		const float t = Clamp((x - a) / (b - a), 0.0f, 1.0f);
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	// noise3(): the hash only depends on the cell and the seed.
+	inline void Noise3(float px, float py, float seed, float& x, float& y, float& z)
+	{
+		int32_t seedi = 0;
+		memcpy(&seedi, &seed, sizeof(seedi));
+		x = std::fabs(Frac(651651.15351f * seed + 165.2354f * std::sin(std::sqrt(((px - 123.25895f) * (px - 123.25895f)) + ((py - 83.1516584f) * (py - 83.1516584f))))));
+		y = std::fabs(Frac(12132.36f * (float)seedi + 5168.12f * std::cos(std::sqrt(((px - 748.2156f) * (px - 748.2156f)) + ((py - 7.2665156f) * (py - 7.2665156f))))));
+		z = std::fabs(Frac(150231.2518f + 153.1568f * std::sin(std::sqrt(((px - 30.232354f) * (px - 30.232354f)) + ((py - 8.656984654f) * (py - 8.656984654f))))));
+	}
+
+	constexpr float   VORONOI_SMOOTHNESS = 0.2f;
+	constexpr float   VORONOI_RANDOMNESS = 0.2f;
+	constexpr int32_t VORONOI_CELLS      = 5;
+
+	// The noise3() of voronoi_noise_seed. The shader hashes its loop counter instead of the cell, so the five
+	// values only depend on the seed and are hashed once per layer, not 25 times per sample.
+	struct VoronoiCells
+	{
+		float X[VORONOI_CELLS] = {};
+		float Y[VORONOI_CELLS] = {};
+		float Z[VORONOI_CELLS] = {};
+		float Exponent         = 1.0f;
+	};
+
+	inline VoronoiCells MakeVoronoiCells(float seed)
+	{
+		VoronoiCells cells{};
+		for (int32_t i = 0; i < VORONOI_CELLS; ++i)
+		{
+			const float c = (float)(i - VORONOI_CELLS / 2);
+			Noise3(c, c, seed, cells.X[i], cells.Y[i], cells.Z[i]);
+		}
+		cells.Exponent = 1.0f + 63.0f * std::pow(1.0f - VORONOI_SMOOTHNESS, 4.0f);
+		return cells;
+	}
+
+	float VoronoiNoiseCells(float x, float y, const VoronoiCells& cells)
+	{
+		const float fx = Frac(x);
+		const float fy = Frac(y);
+
+		float va = 0.0f;
+		float wt = 0.0f;
+		for (int32_t j = -2; j <= 2; ++j)
+		{
+			for (int32_t i = -2; i <= 2; ++i)
+			{
+				const float dx = (VORONOI_RANDOMNESS * i) - (fx + cells.X[i + 2]);
+				const float dy = (VORONOI_RANDOMNESS * j) - (fy + cells.Y[i + 2]);
+
+				const float d = std::sqrt(dx * dx + dy * dy);
+				const float w = std::pow(1.0f - Smoothstep(0.0f, 1.414f, d), cells.Exponent);
+
+				va += w * cells.Z[i + 2];
+				wt += w;
+			}
+		}
+		return va / wt;
+	}
+
+	float FBMTerrainVoronoiCells(float x, float y, const ProTerGen::LayerFBMParams& fbm, const VoronoiCells& cells)
+	{
+		float px    = x;
+		float py    = y;
+		float value = 0.0f;
+		float a     = 1.0f;
+		float g     = fbm.Amplitude;
+		float f     = 1.0f;
+		float dx    = 0.0f;
+		float dy    = 0.0f;
+		float total = a;
+		for (uint32_t i = 0; i < fbm.Octaves; ++i)
+		{
+			// The scalar noise is broadcast to the float3 the shader expects.
+			const float n = VoronoiNoiseCells(px, py, cells);
+			const float v = 0.5f * n + 1.0f;
+			dx += n;
+			dy += n;
+			value += (a * v) / (1.0f + (dx * dx + dy * dy));
+			a *= g;
+			g *= fbm.Gain;
+			f *= fbm.Frecuency;
+
+			// p = f * mul(p, m2), m2 = float2x2(0.8, -0.6, 0.6, 0.8)
+			const float rx = px * 0.8f + py * 0.6f;
+			const float ry = px * -0.6f + py * 0.8f;
+			px = f * rx;
+			py = f * ry;
+			total += a;
+		}
+		return value / total;
+	}
+
+#if PROTERGEN_LAYER_NOISE_SSE2
+	using ProTerGen::SseMath::Floor4;
+	using ProTerGen::SseMath::Log4;
+	using ProTerGen::SseMath::Exp4;
+
+	// Runs step once per octave: Octaves times for Octaves > 0, fbm.Octaves times for 0. The constant trip count is
+	// left to the compiler to unroll; folding the whole kernel Octaves times over grows it past what pays off.
+	template<uint32_t Octaves, typename Step>
+	inline void ForEachOctave(const ProTerGen::LayerFBMParams& fbm, Step&& step)
+	{
+		if constexpr (Octaves > 0)
+		{
+			for (uint32_t i = 0; i < Octaves; ++i)
+			{
+				step();
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < fbm.Octaves; ++i)
+			{
+				step();
+			}
+		}
+	}
+
+	inline __m128 Frac4(__m128 x)
+	{
+		return _mm_sub_ps(x, Floor4(x));
+	}
+
+	inline __m128 UintToFloat4(__m128i v)
+	{
+		// Both halves convert exactly, so the sum is rounded once like a scalar uint to float conversion.
+		const __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(v, 16));
+		const __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)));
+		return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+	}
+
+	struct Float2x4
+	{
+		__m128 x;
+		__m128 y;
+	};
+
+	inline Float2x4 RandomSeed4(__m128 x, __m128 y, __m128i seedMask, __m128i seedXor, __m128 seed)
+	{
+		const __m128i c  = _mm_xor_si128(_mm_and_si128(_mm_castps_si128(_mm_div_ps(x, y)), seedMask), seedXor);
+		const __m128  kx = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(0.3183099f), UintToFloat4(c)), seed);
+		const __m128  ky = _mm_set1_ps(0.3678794f);
+		const __m128  hx = _mm_add_ps(_mm_mul_ps(x, kx), ky);
+		const __m128  hy = _mm_add_ps(_mm_mul_ps(y, ky), kx);
+		const __m128  t  = Frac4(_mm_mul_ps(_mm_mul_ps(hx, hy), _mm_add_ps(hx, hy)));
+		const __m128  sixteen = _mm_set1_ps(16.0f);
+		const __m128  one     = _mm_set1_ps(1.0f);
+		const __m128  two     = _mm_set1_ps(2.0f);
+		return
+		{
+			_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), one), _mm_mul_ps(two, Frac4(_mm_mul_ps(_mm_mul_ps(sixteen, kx), t)))),
+			_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), one), _mm_mul_ps(two, Frac4(_mm_mul_ps(_mm_mul_ps(sixteen, ky), t)))),
+		};
+	}
+
+	// Value and gradient of noised_seed(), with the operation order of NoisedHessian.
+	inline void NoisedSeed4(__m128 px, __m128 py, __m128i seedMask, __m128i seedXor, __m128 seed, __m128& value, __m128& gx, __m128& gy)
+	{
+		const __m128 ix  = Floor4(px);
+		const __m128 iy  = Floor4(py);
+		const __m128 fx  = Frac4(px);
+		const __m128 fy  = Frac4(py);
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		const auto fade  = [](__m128 f)
+		{
+			const __m128 inner = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+			return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, f), f), inner);
+		};
+		const auto dfade = [one](__m128 f)
+		{
+			const __m128 inner = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(f, _mm_set1_ps(2.0f))), one);
+			return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(30.0f), f), f), inner);
+		};
+		const __m128 ux  = fade(fx);
+		const __m128 uy  = fade(fy);
+		const __m128 dux = dfade(fx);
+		const __m128 duy = dfade(fy);
+
+		const __m128 ix1 = _mm_add_ps(ix, one);
+		const __m128 iy1 = _mm_add_ps(iy, one);
+		const Float2x4 ga = RandomSeed4(ix,  iy,  seedMask, seedXor, seed);
+		const Float2x4 gb = RandomSeed4(ix1, iy,  seedMask, seedXor, seed);
+		const Float2x4 gc = RandomSeed4(ix,  iy1, seedMask, seedXor, seed);
+		const Float2x4 gd = RandomSeed4(ix1, iy1, seedMask, seedXor, seed);
+
+		const __m128 fx1 = _mm_sub_ps(fx, one);
+		const __m128 fy1 = _mm_sub_ps(fy, one);
+		const __m128 va  = _mm_add_ps(_mm_mul_ps(ga.x, fx),  _mm_mul_ps(ga.y, fy));
+		const __m128 vb  = _mm_add_ps(_mm_mul_ps(gb.x, fx1), _mm_mul_ps(gb.y, fy));
+		const __m128 vc  = _mm_add_ps(_mm_mul_ps(gc.x, fx),  _mm_mul_ps(gc.y, fy1));
+		const __m128 vd  = _mm_add_ps(_mm_mul_ps(gd.x, fx1), _mm_mul_ps(gd.y, fy1));
+
+		const __m128 k3   = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(va, vb), vc), vd);
+		const __m128 uxuy = _mm_mul_ps(ux, uy);
+		const __m128 g1x  = _mm_sub_ps(gb.x, ga.x);
+		const __m128 g1y  = _mm_sub_ps(gb.y, ga.y);
+		const __m128 g2x  = _mm_sub_ps(gc.x, ga.x);
+		const __m128 g2y  = _mm_sub_ps(gc.y, ga.y);
+		const __m128 g3x  = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(ga.x, gb.x), gc.x), gd.x);
+		const __m128 g3y  = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(ga.y, gb.y), gc.y), gd.y);
+
+		value = _mm_add_ps(_mm_add_ps(_mm_add_ps(va, _mm_mul_ps(ux, _mm_sub_ps(vb, va))), _mm_mul_ps(uy, _mm_sub_ps(vc, va))), _mm_mul_ps(uxuy, k3));
+		gx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(ga.x, _mm_mul_ps(ux, g1x)), _mm_mul_ps(uy, g2x)), _mm_mul_ps(uxuy, g3x)),
+			_mm_mul_ps(dux, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(uy, k3), vb), va)));
+		gy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(ga.y, _mm_mul_ps(ux, g1y)), _mm_mul_ps(uy, g2y)), _mm_mul_ps(uxuy, g3y)),
+			_mm_mul_ps(duy, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ux, k3), vc), va)));
+	}
+
+	// NoisedHessian for four points. The gradient terms are those of NoisedSeed4.
+	inline void NoisedHessian4(__m128 px, __m128 py, __m128i seedMask, __m128i seedXor, __m128 seed, __m128& value, __m128& gx, __m128& gy, __m128& hxx, __m128& hxy, __m128& hyy)
+	{
+		const __m128 ix  = Floor4(px);
+		const __m128 iy  = Floor4(py);
+		const __m128 fx  = Frac4(px);
+		const __m128 fy  = Frac4(py);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+
+		const auto fade  = [](__m128 f)
+		{
+			const __m128 inner = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+			return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, f), f), inner);
+		};
+		const auto dfade = [one](__m128 f)
+		{
+			const __m128 inner = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(f, _mm_set1_ps(2.0f))), one);
+			return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(30.0f), f), f), inner);
+		};
+		const auto ddfade = [one, two](__m128 f)
+		{
+			const __m128 inner = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(two, f), _mm_set1_ps(3.0f))), one);
+			return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(60.0f), f), inner);
+		};
+		const __m128 ux   = fade(fx);
+		const __m128 uy   = fade(fy);
+		const __m128 dux  = dfade(fx);
+		const __m128 duy  = dfade(fy);
+		const __m128 ddux = ddfade(fx);
+		const __m128 dduy = ddfade(fy);
+
+		const __m128 ix1 = _mm_add_ps(ix, one);
+		const __m128 iy1 = _mm_add_ps(iy, one);
+		const Float2x4 ga = RandomSeed4(ix,  iy,  seedMask, seedXor, seed);
+		const Float2x4 gb = RandomSeed4(ix1, iy,  seedMask, seedXor, seed);
+		const Float2x4 gc = RandomSeed4(ix,  iy1, seedMask, seedXor, seed);
+		const Float2x4 gd = RandomSeed4(ix1, iy1, seedMask, seedXor, seed);
+
+		const __m128 fx1 = _mm_sub_ps(fx, one);
+		const __m128 fy1 = _mm_sub_ps(fy, one);
+		const __m128 va  = _mm_add_ps(_mm_mul_ps(ga.x, fx),  _mm_mul_ps(ga.y, fy));
+		const __m128 vb  = _mm_add_ps(_mm_mul_ps(gb.x, fx1), _mm_mul_ps(gb.y, fy));
+		const __m128 vc  = _mm_add_ps(_mm_mul_ps(gc.x, fx),  _mm_mul_ps(gc.y, fy1));
+		const __m128 vd  = _mm_add_ps(_mm_mul_ps(gd.x, fx1), _mm_mul_ps(gd.y, fy1));
+
+		const __m128 k1   = _mm_sub_ps(vb, va);
+		const __m128 k2   = _mm_sub_ps(vc, va);
+		const __m128 k3   = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(va, vb), vc), vd);
+		const __m128 uxuy = _mm_mul_ps(ux, uy);
+		const __m128 g1x  = _mm_sub_ps(gb.x, ga.x);
+		const __m128 g1y  = _mm_sub_ps(gb.y, ga.y);
+		const __m128 g2x  = _mm_sub_ps(gc.x, ga.x);
+		const __m128 g2y  = _mm_sub_ps(gc.y, ga.y);
+		const __m128 g3x  = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(ga.x, gb.x), gc.x), gd.x);
+		const __m128 g3y  = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(ga.y, gb.y), gc.y), gd.y);
+
+		value = _mm_add_ps(_mm_add_ps(_mm_add_ps(va, _mm_mul_ps(ux, k1)), _mm_mul_ps(uy, k2)), _mm_mul_ps(uxuy, k3));
+		gx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(ga.x, _mm_mul_ps(ux, g1x)), _mm_mul_ps(uy, g2x)), _mm_mul_ps(uxuy, g3x)),
+			_mm_mul_ps(dux, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(uy, k3), vb), va)));
+		gy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(ga.y, _mm_mul_ps(ux, g1y)), _mm_mul_ps(uy, g2y)), _mm_mul_ps(uxuy, g3y)),
+			_mm_mul_ps(duy, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(ux, k3), vc), va)));
+		hxx = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, dux), _mm_add_ps(g1x, _mm_mul_ps(uy, g3x))), _mm_mul_ps(ddux, _mm_add_ps(k1, _mm_mul_ps(uy, k3))));
+		hyy = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(two, duy), _mm_add_ps(g2y, _mm_mul_ps(ux, g3y))), _mm_mul_ps(dduy, _mm_add_ps(k2, _mm_mul_ps(ux, k3))));
+		hxy = _mm_add_ps(_mm_mul_ps(duy, _mm_add_ps(g2x, _mm_mul_ps(ux, g3x))),
+			_mm_mul_ps(dux, _mm_add_ps(_mm_add_ps(g1y, _mm_mul_ps(uy, g3y)), _mm_mul_ps(duy, k3))));
+	}
+
+	template<uint32_t Octaves>
+	__m128 FBMTerrain4(__m128 x, __m128 y, const ProTerGen::LayerFBMParams& fbm, float seed)
+	{
+		const __m128i seedMask = _mm_set1_epi32((int32_t)(uint32_t)seed);
+		const __m128i seedXor  = _mm_set1_epi32((int32_t)(uint32_t)(0.314159f * seed));
+		const __m128  seed4    = _mm_set1_ps(seed);
+		const __m128  one      = _mm_set1_ps(1.0f);
+
+		__m128 px    = x;
+		__m128 py    = y;
+		__m128 value = _mm_setzero_ps();
+		__m128 dx    = _mm_setzero_ps();
+		__m128 dy    = _mm_setzero_ps();
+		float  a     = 1.0f;
+		float  g     = fbm.Amplitude;
+		float  f     = 1.0f;
+		float  total = a;
+		ForEachOctave<Octaves>(fbm, [&]
+		{
+			__m128 n, gx, gy;
+			NoisedSeed4(px, py, seedMask, seedXor, seed4, n, gx, gy);
+			const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.5f), n), one);
+			dx = _mm_add_ps(dx, gx);
+			dy = _mm_add_ps(dy, gy);
+			const __m128 denom = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+			value = _mm_add_ps(value, _mm_div_ps(_mm_mul_ps(_mm_set1_ps(a), v), denom));
+
+			a *= g;
+			g *= fbm.Gain;
+			f *= fbm.Frecuency;
+
+			const __m128 sx = _mm_mul_ps(px, _mm_set1_ps(f));
+			const __m128 sy = _mm_mul_ps(py, _mm_set1_ps(f));
+			px = _mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(1.6f)), _mm_mul_ps(sy, _mm_set1_ps(-1.2f)));
+			py = _mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(1.2f)), _mm_mul_ps(sy, _mm_set1_ps(1.5f)));
+
+			total += a;
+		});
+		return _mm_div_ps(value, _mm_set1_ps(total));
+	}
+
+	// FBMTerrain4 with the chain rule of the scalar FBMTerrain. The jacobian of p is the same for every point.
+	template<uint32_t Octaves>
+	void FBMTerrainGradient4(__m128 x, __m128 y, const ProTerGen::LayerFBMParams& fbm, float seed, __m128& outValue, __m128& outGx, __m128& outGy)
+	{
+		const __m128i seedMask = _mm_set1_epi32((int32_t)(uint32_t)seed);
+		const __m128i seedXor  = _mm_set1_epi32((int32_t)(uint32_t)(0.314159f * seed));
+		const __m128  seed4    = _mm_set1_ps(seed);
+		const __m128  one      = _mm_set1_ps(1.0f);
+		const __m128  half     = _mm_set1_ps(0.5f);
+		const __m128  two      = _mm_set1_ps(2.0f);
+
+		__m128 px    = x;
+		__m128 py    = y;
+		__m128 value = _mm_setzero_ps();
+		__m128 dx    = _mm_setzero_ps();
+		__m128 dy    = _mm_setzero_ps();
+		__m128 d00   = _mm_setzero_ps();
+		__m128 d01   = _mm_setzero_ps();
+		__m128 d10   = _mm_setzero_ps();
+		__m128 d11   = _mm_setzero_ps();
+		__m128 gx    = _mm_setzero_ps();
+		__m128 gy    = _mm_setzero_ps();
+		float  a     = 1.0f;
+		float  g     = fbm.Amplitude;
+		float  f     = 1.0f;
+		float  total = a;
+		float  j00 = 1.0f, j01 = 0.0f, j10 = 0.0f, j11 = 1.0f;
+		ForEachOctave<Octaves>(fbm, [&]
+		{
+			__m128 n, ngx, ngy, hxx, hxy, hyy;
+			NoisedHessian4(px, py, seedMask, seedXor, seed4, n, ngx, ngy, hxx, hxy, hyy);
+			const __m128 v = _mm_add_ps(_mm_mul_ps(half, n), one);
+			dx = _mm_add_ps(dx, ngx);
+			dy = _mm_add_ps(dy, ngy);
+
+			const __m128 J00 = _mm_set1_ps(j00);
+			const __m128 J01 = _mm_set1_ps(j01);
+			const __m128 J10 = _mm_set1_ps(j10);
+			const __m128 J11 = _mm_set1_ps(j11);
+			d00 = _mm_add_ps(d00, _mm_add_ps(_mm_mul_ps(hxx, J00), _mm_mul_ps(hxy, J10)));
+			d01 = _mm_add_ps(d01, _mm_add_ps(_mm_mul_ps(hxx, J01), _mm_mul_ps(hxy, J11)));
+			d10 = _mm_add_ps(d10, _mm_add_ps(_mm_mul_ps(hxy, J00), _mm_mul_ps(hyy, J10)));
+			d11 = _mm_add_ps(d11, _mm_add_ps(_mm_mul_ps(hxy, J01), _mm_mul_ps(hyy, J11)));
+
+			const __m128 denom = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+			const __m128 dvx   = _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(ngx, J00), _mm_mul_ps(ngy, J10)));
+			const __m128 dvy   = _mm_mul_ps(half, _mm_add_ps(_mm_mul_ps(ngx, J01), _mm_mul_ps(ngy, J11)));
+			const __m128 dqx   = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(d00, dx), _mm_mul_ps(d10, dy)));
+			const __m128 dqy   = _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(d01, dx), _mm_mul_ps(d11, dy)));
+
+			const __m128 a4 = _mm_set1_ps(a);
+			value = _mm_add_ps(value, _mm_div_ps(_mm_mul_ps(a4, v), denom));
+			gx    = _mm_add_ps(gx, _mm_div_ps(_mm_mul_ps(a4, _mm_sub_ps(dvx, _mm_div_ps(_mm_mul_ps(v, dqx), denom))), denom));
+			gy    = _mm_add_ps(gy, _mm_div_ps(_mm_mul_ps(a4, _mm_sub_ps(dvy, _mm_div_ps(_mm_mul_ps(v, dqy), denom))), denom));
+
+			a *= g;
+			g *= fbm.Gain;
+			f *= fbm.Frecuency;
+
+			const __m128 sx = _mm_mul_ps(px, _mm_set1_ps(f));
+			const __m128 sy = _mm_mul_ps(py, _mm_set1_ps(f));
+			px = _mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(1.6f)), _mm_mul_ps(sy, _mm_set1_ps(-1.2f)));
+			py = _mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(1.2f)), _mm_mul_ps(sy, _mm_set1_ps(1.5f)));
+			const float n00 = f * (1.6f * j00 - 1.2f * j10);
+			const float n01 = f * (1.6f * j01 - 1.2f * j11);
+			const float n10 = f * (1.2f * j00 + 1.5f * j10);
+			const float n11 = f * (1.2f * j01 + 1.5f * j11);
+			j00 = n00; j01 = n01; j10 = n10; j11 = n11;
+
+			total += a;
+		});
+		const __m128 total4 = _mm_set1_ps(total);
+		outValue = _mm_div_ps(value, total4);
+		outGx    = _mm_div_ps(gx, total4);
+		outGy    = _mm_div_ps(gy, total4);
+	}
+
+	// VoronoiNoiseCells for four points. pow is Exp4(Log4()), so values differ from the scalar version by ~1e-6.
+	inline __m128 VoronoiNoiseCells4(__m128 x, __m128 y, const VoronoiCells& cells)
+	{
+		const __m128 fx       = Frac4(x);
+		const __m128 fy       = Frac4(y);
+		const __m128 zero     = _mm_setzero_ps();
+		const __m128 one      = _mm_set1_ps(1.0f);
+		const __m128 exponent = _mm_set1_ps(cells.Exponent);
+		const __m128 invEdge  = _mm_set1_ps(1.0f / 1.414f);
+
+		__m128 va = zero;
+		__m128 wt = zero;
+		for (int32_t j = -2; j <= 2; ++j)
+		{
+			for (int32_t i = -2; i <= 2; ++i)
+			{
+				const __m128 dx = _mm_sub_ps(_mm_set1_ps(VORONOI_RANDOMNESS * i), _mm_add_ps(fx, _mm_set1_ps(cells.X[i + 2])));
+				const __m128 dy = _mm_sub_ps(_mm_set1_ps(VORONOI_RANDOMNESS * j), _mm_add_ps(fy, _mm_set1_ps(cells.Y[i + 2])));
+
+				const __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+				const __m128 t = _mm_min_ps(_mm_mul_ps(d, invEdge), one);
+				const __m128 s = _mm_sub_ps(one, _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t))));
+
+				// pow(0, e) is 0, where the log of the polynomial is not defined.
+				const __m128 inside = _mm_cmpgt_ps(s, zero);
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+				const __m128 w = _mm_and_ps(inside, Exp4(_mm_mul_ps(exponent, Log4(_mm_max_ps(s, _mm_set1_ps(1e-30f))))));
+
+				va = _mm_add_ps(va, _mm_mul_ps(w, _mm_set1_ps(cells.Z[i + 2])));
+				wt = _mm_add_ps(wt, w);
+			}
+		}
+		return _mm_div_ps(va, wt);
+	}
+
+	template<uint32_t Octaves>
+	inline __m128 FBMTerrainVoronoi4(__m128 x, __m128 y, const ProTerGen::LayerFBMParams& fbm, const VoronoiCells& cells)
+	{
+		__m128 px    = x;
+		__m128 py    = y;
+		__m128 value = _mm_setzero_ps();
+		__m128 dx    = _mm_setzero_ps();
+		__m128 dy    = _mm_setzero_ps();
+		float  a     = 1.0f;
+		float  g     = fbm.Amplitude;
+		float  f     = 1.0f;
+		float  total = a;
+		const __m128 one  = _mm_set1_ps(1.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		ForEachOctave<Octaves>(fbm, [&]
+		{
+			const __m128 n = VoronoiNoiseCells4(px, py, cells);
+			const __m128 v = _mm_add_ps(_mm_mul_ps(half, n), one);
+			dx = _mm_add_ps(dx, n);
+			dy = _mm_add_ps(dy, n);
+			const __m128 denom = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+			value = _mm_add_ps(value, _mm_div_ps(_mm_mul_ps(_mm_set1_ps(a), v), denom));
+			a *= g;
+			g *= fbm.Gain;
+			f *= fbm.Frecuency;
+
+			const __m128 f4 = _mm_set1_ps(f);
+			const __m128 rx = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(0.8f)), _mm_mul_ps(py, _mm_set1_ps(0.6f)));
+			const __m128 ry = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(-0.6f)), _mm_mul_ps(py, _mm_set1_ps(0.8f)));
+			px = _mm_mul_ps(f4, rx);
+			py = _mm_mul_ps(f4, ry);
+			total += a;
+		});
+		return _mm_div_ps(value, _mm_set1_ps(total));
+	}
+
+	// The batches for one octave count; the scalar versions take the points left over.
+	template<uint32_t Octaves>
+	void FBMTerrainBatch(const float* xs, const float* ys, size_t count, const ProTerGen::LayerFBMParams& fbm, float seed, float* values)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(values + i, FBMTerrain4<Octaves>(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i), fbm, seed));
+		}
+		for (; i < count; ++i)
+		{
+			values[i] = ProTerGen::LayerNoise::FBMTerrain(xs[i], ys[i], fbm, seed).Value;
+		}
+	}
+
+	template<uint32_t Octaves>
+	void FBMTerrainGradientBatch(const float* xs, const float* ys, size_t count, const ProTerGen::LayerFBMParams& fbm, float seed, float* values, float* dxs, float* dys)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 value, gx, gy;
+			FBMTerrainGradient4<Octaves>(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i), fbm, seed, value, gx, gy);
+			_mm_storeu_ps(values + i, value);
+			_mm_storeu_ps(dxs + i, gx);
+			_mm_storeu_ps(dys + i, gy);
+		}
+		for (; i < count; ++i)
+		{
+			const ProTerGen::NoiseGradient n = ProTerGen::LayerNoise::FBMTerrain(xs[i], ys[i], fbm, seed);
+			values[i] = n.Value;
+			dxs[i]    = n.Dx;
+			dys[i]    = n.Dy;
+		}
+	}
+
+	template<uint32_t Octaves>
+	void FBMTerrainVoronoiBatch(const float* xs, const float* ys, size_t count, const ProTerGen::LayerFBMParams& fbm, const VoronoiCells& cells, float* values)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(values + i, FBMTerrainVoronoi4<Octaves>(_mm_loadu_ps(xs + i), _mm_loadu_ps(ys + i), fbm, cells));
+		}
+		for (; i < count; ++i)
+		{
+			values[i] = FBMTerrainVoronoiCells(xs[i], ys[i], fbm, cells);
+		}
+	}
+
+	// Entry of the dispatch tables for the octaves of fbm: the batch unrolled for that count, or entry 0, the loop,
+	// past MAX_UNROLLED_FBM_OCTAVES.
+	inline size_t OctaveTableIndex(const ProTerGen::LayerFBMParams& fbm)
+	{
+		return fbm.Octaves <= ProTerGen::MAX_UNROLLED_FBM_OCTAVES ? fbm.Octaves : 0;
+	}
+#endif
+}
+
+ProTerGen::NoiseGradient ProTerGen::LayerNoise::Noised(float x, float y)
+{
+	const NoiseHessian n = NoisedHessian(x, y, [](Float2 p) { return Random(p); });
+	return NoiseGradient{ .Value = n.Value, .Dx = n.Gx, .Dy = n.Gy };
+}
+
+ProTerGen::NoiseGradient ProTerGen::LayerNoise::NoisedSeed(float x, float y, float seed)
+{
+	const NoiseHessian n = NoisedHessian(x, y, [seed](Float2 p) { return RandomSeed(p, seed); });
+	return NoiseGradient{ .Value = n.Value, .Dx = n.Gx, .Dy = n.Gy };
+}
+
+ProTerGen::NoiseGradient ProTerGen::LayerNoise::FBMTerrain(float x, float y, const LayerFBMParams& fbm, float seed)
+{
+	const auto random = [seed](Float2 p) { return RandomSeed(p, seed); };
+
+	float px    = x;
+	float py    = y;
+	float value = 0.0f;
+	float a     = 1.0f;
+	float g     = fbm.Amplitude;
+	float f     = 1.0f;
+	float dx    = 0.0f;
+	float dy    = 0.0f;
+	float total = a;
+
+	// Chain rule state: J is the jacobian of p and dD the one of the accumulated noise derivatives, both
+	// with respect to (x, y). gx, gy is the gradient of value.
+	float j00 = 1.0f, j01 = 0.0f, j10 = 0.0f, j11 = 1.0f;
+	float d00 = 0.0f, d01 = 0.0f, d10 = 0.0f, d11 = 0.0f;
+	float gx  = 0.0f;
+	float gy  = 0.0f;
+
+	for (uint32_t i = 0; i < fbm.Octaves; ++i)
+	{
+		const NoiseHessian n = NoisedHessian(px, py, random);
+		const float v = 0.5f * n.Value + 1.0f;
+		dx += n.Gx;
+		dy += n.Gy;
+
+		d00 += n.Hxx * j00 + n.Hxy * j10;
+		d01 += n.Hxx * j01 + n.Hxy * j11;
+		d10 += n.Hxy * j00 + n.Hyy * j10;
+		d11 += n.Hxy * j01 + n.Hyy * j11;
+
+		const float denom = 1.0f + (dx * dx + dy * dy);
+		const float dvx   = 0.5f * (n.Gx * j00 + n.Gy * j10);
+		const float dvy   = 0.5f * (n.Gx * j01 + n.Gy * j11);
+		const float dqx   = 2.0f * (d00 * dx + d10 * dy);
+		const float dqy   = 2.0f * (d01 * dx + d11 * dy);
+
+		value += (a * v) / denom;
+		gx    += a * (dvx - v * dqx / denom) / denom;
+		gy    += a * (dvy - v * dqy / denom) / denom;
+
+		a *= g;
+		g *= fbm.Gain;
+		f *= fbm.Frecuency;
+
+		// p = mul(p * f, m), m = float2x2(1.6, 1.2, -1.2, 1.5)
+		const float sx = px * f;
+		const float sy = py * f;
+		px = sx * 1.6f + sy * -1.2f;
+		py = sx * 1.2f + sy * 1.5f;
+		const float n00 = f * (1.6f * j00 - 1.2f * j10);
+		const float n01 = f * (1.6f * j01 - 1.2f * j11);
+		const float n10 = f * (1.2f * j00 + 1.5f * j10);
+		const float n11 = f * (1.2f * j01 + 1.5f * j11);
+		j00 = n00; j01 = n01; j10 = n10; j11 = n11;
+
+		total += a;
+	}
+
+	return NoiseGradient{ .Value = value / total, .Dx = gx / total, .Dy = gy / total };
+}
+
+void ProTerGen::LayerNoise::FBMTerrain(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values)
+{
+#if PROTERGEN_LAYER_NOISE_SSE2
+	using Fn = void(*)(const float*, const float*, size_t, const LayerFBMParams&, float, float*);
+	static constexpr auto table = []<size_t... I>(std::index_sequence<I...>)
+	{
+		return std::array<Fn, sizeof...(I)>{ &FBMTerrainBatch<(uint32_t)I>... };
+	}(std::make_index_sequence<MAX_UNROLLED_FBM_OCTAVES + 1>{});
+
+	table[OctaveTableIndex(fbm)](xs, ys, count, fbm, seed, values);
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		values[i] = FBMTerrain(xs[i], ys[i], fbm, seed).Value;
+	}
+#endif
+}
+
+void ProTerGen::LayerNoise::FBMTerrain(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values, float* dxs, float* dys)
+{
+#if PROTERGEN_LAYER_NOISE_SSE2
+	using Fn = void(*)(const float*, const float*, size_t, const LayerFBMParams&, float, float*, float*, float*);
+	static constexpr auto table = []<size_t... I>(std::index_sequence<I...>)
+	{
+		return std::array<Fn, sizeof...(I)>{ &FBMTerrainGradientBatch<(uint32_t)I>... };
+	}(std::make_index_sequence<MAX_UNROLLED_FBM_OCTAVES + 1>{});
+
+	table[OctaveTableIndex(fbm)](xs, ys, count, fbm, seed, values, dxs, dys);
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		const NoiseGradient n = FBMTerrain(xs[i], ys[i], fbm, seed);
+		values[i] = n.Value;
+		dxs[i]    = n.Dx;
+		dys[i]    = n.Dy;
+	}
+#endif
+}
+
+float ProTerGen::LayerNoise::VoronoiNoiseSeed(float x, float y, float seed)
+{
+	return VoronoiNoiseCells(x, y, MakeVoronoiCells(seed));
+}
+
+float ProTerGen::LayerNoise::FBMTerrainVoronoi(float x, float y, const LayerFBMParams& fbm, float seed)
+{
+	return FBMTerrainVoronoiCells(x, y, fbm, MakeVoronoiCells(seed));
+}
+
+void ProTerGen::LayerNoise::FBMTerrainVoronoi(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values)
+{
+	const VoronoiCells cells = MakeVoronoiCells(seed);
+#if PROTERGEN_LAYER_NOISE_SSE2
+	using Fn = void(*)(const float*, const float*, size_t, const LayerFBMParams&, const VoronoiCells&, float*);
+	static constexpr auto table = []<size_t... I>(std::index_sequence<I...>)
+	{
+		return std::array<Fn, sizeof...(I)>{ &FBMTerrainVoronoiBatch<(uint32_t)I>... };
+	}(std::make_index_sequence<MAX_UNROLLED_FBM_OCTAVES + 1>{});
+
+	table[OctaveTableIndex(fbm)](xs, ys, count, fbm, cells, values);
+#else
+	for (size_t i = 0; i < count; ++i)
+	{
+		values[i] = FBMTerrainVoronoiCells(xs[i], ys[i], fbm, cells);
+	}
+#endif
+}
+
+float ProTerGen::LayerNoise::MaxFrequency(const LayerFBMParams& fbm)
+{
+	// The jacobian of p in FBMTerrain, whose Frobenius norm bounds the stretch of the last octave.
+	float f   = 1.0f;
+	float j00 = 1.0f, j01 = 0.0f, j10 = 0.0f, j11 = 1.0f;
+	for (uint32_t i = 1; i < fbm.Octaves; ++i)
+	{
+		f *= fbm.Frecuency;
+		const float n00 = f * (1.6f * j00 - 1.2f * j10);
+		const float n01 = f * (1.6f * j01 - 1.2f * j11);
+		const float n10 = f * (1.2f * j00 + 1.5f * j10);
+		const float n11 = f * (1.2f * j01 + 1.5f * j11);
+		j00 = n00; j01 = n01; j10 = n10; j11 = n11;
+	}
+	return std::sqrt(j00 * j00 + j01 * j01 + j10 * j10 + j11 * j11);
+}
+
+ProTerGen::TerrainSample ProTerGen::LayerNoise::SlopeAndDerivatives(float height, float hx, float hy, float scale)
+{
+	TerrainSample s{};
+	s.Height = height;
+	s.Dx     = -hx * scale;
+	s.Dy     = -hy * scale;
+
+	// The shader squares the derivatives before taking the length.
+	const float dx = s.Dx * s.Dx;
+	const float dy = s.Dy * s.Dy;
+	s.Slope = SlopeFromGradient(std::sqrt(dx * dx + dy * dy));
+	return s;
+}
+
+ProTerGen::TerrainSample ProTerGen::LayerNoise::SlopeAndDerivativesFiniteDifferences(const float* heights, float scale)
+{
+	const float hx = (heights[2] + heights[5] + heights[8] - heights[0] - heights[3] - heights[6]) / (6.0f);
+	const float hy = (heights[0] + heights[1] + heights[2] - heights[6] - heights[7] - heights[8]) / (6.0f);
+	return SlopeAndDerivatives(heights[4], hx, hy, scale);
+}
+
+ProTerGen::LayerNoiseValidation ProTerGen::LayerNoise::ValidateAgainstFiniteDifferences(const LayerFBMParams& fbm, float seed, float step, uint32_t samplesPerSide)
+{
+	LayerNoiseValidation result{};
+	const float margin = 2.0f * step;
+	const float scale  = samplesPerSide > 1 ? (1.0f - 2.0f * margin) / (samplesPerSide - 1) : 0.0f;
+	for (uint32_t j = 0; j < samplesPerSide; ++j)
+	{
+		for (uint32_t i = 0; i < samplesPerSide; ++i)
+		{
+			const float u = margin + i * scale;
+			const float v = margin + j * scale;
+
+			float heights[9] = {};
+			for (int32_t y = 0; y < 3; ++y)
+			{
+				for (int32_t x = 0; x < 3; ++x)
+				{
+					heights[3 * y + x] = FBMTerrain(u + (x - 1) * step, v + (1 - y) * step, fbm, seed).Value;
+				}
+			}
+			const NoiseGradient n = FBMTerrain(u, v, fbm, seed);
+			const TerrainSample a = SlopeAndDerivatives(n.Value, n.Dx * step, n.Dy * step, 1.0f);
+			const TerrainSample b = SlopeAndDerivativesFiniteDifferences(heights, 1.0f);
+
+			result.MaxHeightError     = std::fmax(result.MaxHeightError, std::fabs(a.Height - b.Height));
+			result.MaxDerivativeError = std::fmax(result.MaxDerivativeError, std::fmax(std::fabs(a.Dx - b.Dx), std::fabs(a.Dy - b.Dy)));
+			result.MaxDerivative      = std::fmax(result.MaxDerivative, std::fmax(std::fabs(a.Dx), std::fabs(a.Dy)));
+			result.MaxSlopeError      = std::fmax(result.MaxSlopeError, std::fabs(a.Slope - b.Slope));
+		}
+	}
+	return result;
+}
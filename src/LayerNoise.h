@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ProTerGen
+{
+	// Mirrors the FBM struct of Noise.hlsli.
+	struct LayerFBMParams
+	{
+		float    Amplitude = 1.0f;
+		float    Frecuency = 1.0f;
+		float    Gain      = 1.0f;
+		uint32_t Octaves   = 1;
+	};
+
+	struct NoiseGradient
+	{
+		float Value = 0.0f;
+		float Dx    = 0.0f;
+		float Dy    = 0.0f;
+	};
+
+	// Same layout as the float4(slope, derivatives, height) written by ComputeNhTileTerrain.hlsl.
+	struct TerrainSample
+	{
+		float Slope  = 0.0f;
+		float Dx     = 0.0f;
+		float Dy     = 0.0f;
+		float Height = 0.0f;
+	};
+
+	struct LayerNoiseValidation
+	{
+		float MaxHeightError     = 0.0f;
+		float MaxDerivativeError = 0.0f;
+		float MaxDerivative      = 0.0f;
+		float MaxSlopeError      = 0.0f;
+	};
+
+	// CPU version of the gradient noise in Noise.hlsli, in float32 and with the same operation order.
+	// The FBM carries the analytic gradient along, so derivatives and slope of a texel come with its height
+	// instead of from the 3x3 neighbourhood SLOPE_DERIVATIVES differences.
+	class LayerNoise
+	{
+	public:
+		static NoiseGradient Noised(float x, float y);
+		static NoiseGradient NoisedSeed(float x, float y, float seed);
+
+		// fbm_terrain_params, with the gradient of the result with respect to (x, y).
+		static NoiseGradient FBMTerrain(float x, float y, const LayerFBMParams& fbm, float seed);
+		// fbm_terrain_params for many points, four at a time with SSE2. Same values as the scalar version.
+		// The batches run a kernel built for fbm.Octaves, picked from a table up to MAX_UNROLLED_FBM_OCTAVES.
+		static void FBMTerrain(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values);
+		static void FBMTerrain(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values, float* dxs, float* dys);
+		// Lattice cells per unit of (x, y) in the last octave of FBMTerrain, an upper bound. A grid coarser than half
+		// of it cannot resolve the gradient, and differencing it sees less than the analytic gradient.
+		static float MaxFrequency(const LayerFBMParams& fbm);
+
+		// voronoi_noise_seed and fbm_terrain_params_voronoi, as written in the shader.
+		static float VoronoiNoiseSeed(float x, float y, float seed);
+		static float FBMTerrainVoronoi(float x, float y, const LayerFBMParams& fbm, float seed);
+		// fbm_terrain_params_voronoi for many points, four at a time with SSE2. The weights use a polynomial pow,
+		// so values differ from the scalar version by ~1e-6.
+		static void FBMTerrainVoronoi(const float* xs, const float* ys, size_t count, const LayerFBMParams& fbm, float seed, float* values);
+
+		// SLOPE_DERIVATIVES of ComputeNhTileTerrain.hlsl for a texel of the given height and gradient, in height
+		// per texel. scale is Terrain_TileSize / 2^mip.
+		static TerrainSample SlopeAndDerivatives(float height, float hx, float hy, float scale);
+		// The same from the 3x3 neighbourhood the shader reads: heights h1 to h9, rows from y + 1 down to y - 1.
+		static TerrainSample SlopeAndDerivativesFiniteDifferences(const float* heights, float scale);
+
+		// Compares both for FBMTerrain over a samplesPerSide^2 grid of the unit square, the neighbours step apart.
+		static LayerNoiseValidation ValidateAgainstFiniteDifferences(const LayerFBMParams& fbm, float seed, float step, uint32_t samplesPerSide);
+	};
+}
@@ -277,6 +277,11 @@ void ProTerGen::MainEngine::BuildShadersAndInputLayout()
 	   { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,       0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	   { "TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 36, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
+	mShaders.InputLayout("TerrainInputLayout") =
+	{
+	   { "POSITION",     0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	   { "BLENDINDICES", 0, DXGI_FORMAT_R8G8_UINT,          0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 	mShaders.InputLayout("PositionOnlyInputLayout") =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
@@ -698,9 +703,9 @@ void ProTerGen::MainEngine::BuildPSOs()
 		};
 		basePsoDesc.PrimitiveTopologyType    = D3D12_PRIMITIVE_TOPOLOGY_TYPE_PATCH;
 		basePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-		mShaders.CreateGraphicPSO("TerrainPSO_WF", mDevice, "DefaultRS", "DefaultInputLayout", names, basePsoDesc);
+		mShaders.CreateGraphicPSO("TerrainPSO_WF", mDevice, "DefaultRS", "TerrainInputLayout", names, basePsoDesc);
 		basePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-		mShaders.CreateGraphicPSO("TerrainPSO", mDevice, "DefaultRS", "DefaultInputLayout", names, basePsoDesc);
+		mShaders.CreateGraphicPSO("TerrainPSO", mDevice, "DefaultRS", "TerrainInputLayout", names, basePsoDesc);
 	}
 	{
 		const std::vector<std::string> names =
@@ -726,7 +731,7 @@ void ProTerGen::MainEngine::BuildPSOs()
 		};
 		basePsoDesc.PrimitiveTopologyType    = D3D12_PRIMITIVE_TOPOLOGY_TYPE_PATCH;
 		basePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-		mShaders.CreateGraphicPSO("ShadowCasterTerrainPSO", mDevice, "DefaultRS", "DefaultInputLayout", names, basePsoDesc);
+		mShaders.CreateGraphicPSO("ShadowCasterTerrainPSO", mDevice, "DefaultRS", "TerrainInputLayout", names, basePsoDesc);
 	}
 	{
 		const std::vector<std::string> names =
@@ -737,9 +742,9 @@ void ProTerGen::MainEngine::BuildPSOs()
 			"terrainDebugLodPS",
 		};
 		basePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-		mShaders.CreateGraphicPSO("DebugLodPSO_WF", mDevice, "DefaultRS", "DefaultInputLayout", names, basePsoDesc);
+		mShaders.CreateGraphicPSO("DebugLodPSO_WF", mDevice, "DefaultRS", "TerrainInputLayout", names, basePsoDesc);
 		basePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-		mShaders.CreateGraphicPSO("DebugLodPSO", mDevice, "DefaultRS", "DefaultInputLayout", names, basePsoDesc);
+		mShaders.CreateGraphicPSO("DebugLodPSO", mDevice, "DefaultRS", "TerrainInputLayout", names, basePsoDesc);
 	}
 	{
 		const std::vector<std::string> names
@@ -810,9 +815,9 @@ void ProTerGen::MainEngine::BuildPSOs()
 	};
 	{
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC vtPsoDesc = basePsoDesc;
-		vtPsoDesc.RTVFormats[0] = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		vtPsoDesc.RTVFormats[0] = VT::FeedbackBuffer::FORMAT;
 		vtPsoDesc.DSVFormat     = DXGI_FORMAT_D32_FLOAT;
-		mShaders.CreateGraphicPSO("VTFeedbackPSO", mDevice, "DefaultRS", "DefaultInputLayout", { "vtVS", "vtPS" }, vtPsoDesc);
+		mShaders.CreateGraphicPSO("VTFeedbackPSO", mDevice, "DefaultRS", "TerrainInputLayout", { "vtVS", "vtPS" }, vtPsoDesc);
 	}
 	{
 		D3D12_GRAPHICS_PIPELINE_STATE_DESC vtPsoDesc = basePsoDesc;
@@ -1840,6 +1845,7 @@ void ProTerGen::MainEngine::Draw(const Clock& gt)
 		    mCommandList->SetPipelineState(mShaders.GetPSO("VTFeedbackPSO").Get());
 
 			mFeedbackBuffer.Download();
+			mVTTerrain.BeginFrame();
 			mVTTerrain.Update(mCommandList, mFeedbackBuffer.Requests());
 			mFeedbackBuffer.SetAsWriteable(mCommandList);
 			mFeedbackBuffer.Clear(mCommandList, mDescriptorHeaps);
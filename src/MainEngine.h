@@ -3,6 +3,7 @@
 #include <unordered_map>
 
 #include <array>
+#include <type_traits>
 #include "CommonHeaders.h"
 #include "Config.h"
 #include "App.h"
@@ -22,6 +23,7 @@
 #include "GpuBatches.h"
 #include "CustomHeightmapTileGenerator.h"
 #include "PageLoaderGpuGen.h"
+#include "PageLoaderCpuGen.h"
 #include "GrassCompute.h"
 #include "CascadeShadowMap.h"
 
@@ -109,7 +111,7 @@ namespace ProTerGen
 		ECS::Entity mTerrainAlt = ECS::INVALID;
 
 		VT::VTDesc mVTTerrainDesc = {};
-		VT::VirtualTexture<VT::PageGpuGen_Sdh> mVTTerrain = {};
+		VT::VirtualTexture<std::conditional_t<gCpuTerrainPages, VT::PageCpuGen_Sdh, VT::PageGpuGen_Sdh>> mVTTerrain = {};
 		VT::FeedbackBuffer mFeedbackBuffer = {};
 
 		CascadeShadowMap mCSM = {};
@@ -3,11 +3,44 @@
 #include <DirectXMath.h>
 #include <DirectXCollision.h>
 #include <unordered_map>
+#include <vector>
+#include <cstring>
 #include "CommonHeaders.h"
 
 namespace ProTerGen
 {
-	using Index = uint32_t;
+	using Index   = uint32_t;
+	using Index16 = uint16_t;
+
+	// Meshes with more vertices than this can't be addressed with 16-bit indices.
+	constexpr size_t MAX_INDEX16_VERTEX_COUNT = 0xFFFF;
+
+	constexpr DXGI_FORMAT GetIndexFormat(size_t vertexCount) noexcept
+	{
+		return vertexCount <= MAX_INDEX16_VERTEX_COUNT ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	}
+
+	constexpr size_t GetIndexByteStride(DXGI_FORMAT indexFormat) noexcept
+	{
+		return indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(Index16) : sizeof(Index);
+	}
+
+	// Writes count indices into dst narrowing them if indexFormat is DXGI_FORMAT_R16_UINT.
+	inline void WriteIndices(void* dst, const Index* src, size_t count, DXGI_FORMAT indexFormat) noexcept
+	{
+		if (indexFormat == DXGI_FORMAT_R16_UINT)
+		{
+			Index16* dst16 = reinterpret_cast<Index16*>(dst);
+			for (size_t i = 0; i < count; ++i)
+			{
+				dst16[i] = static_cast<Index16>(src[i]);
+			}
+		}
+		else
+		{
+			memcpy(dst, src, count * sizeof(Index));
+		}
+	}
 
 	struct Vertex
 	{
@@ -51,6 +84,8 @@ namespace ProTerGen
 		size_t InstanceBufferByteSize = 0;
 
 		std::unordered_map<std::string, SubmeshParameters> SubMesh{};
+		// When not empty, the unnamed submesh is drawn as one call per range (e.g. terrain chunks).
+		std::vector<SubmeshParameters> DrawRanges{};
 
 		D3D12_VERTEX_BUFFER_VIEW VertexBufferView() const
 		{
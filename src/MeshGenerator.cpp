@@ -1,4 +1,5 @@
 #include "MeshGenerator.h"
+#include "MeshOptimizer.h"
 
 ProTerGen::MeshGenerator::MeshGenerator()
 {
@@ -76,6 +77,9 @@ ProTerGen::Mesh ProTerGen::MeshGenerator::CreateQuad(std::string name, size_t ve
 		}
 	}
 
+	MeshOptimizer optimizer{};
+	optimizer.Optimize(mesh);
+
 	return mesh;
 }
 
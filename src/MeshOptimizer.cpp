@@ -0,0 +1,426 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+#include "MathHelpers.h"
+
+namespace
+{
+	// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation".
+	constexpr float CACHE_DECAY_POWER   = 1.5f;
+	constexpr float LAST_TRI_SCORE      = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	float VertexScore(int32_t cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0) return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				score = LAST_TRI_SCORE;
+			}
+			else
+			{
+				const float scaler = 1.0f / (ProTerGen::MeshOptimizer::CACHE_SIZE - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+		score += VALENCE_BOOST_SCALE * powf((float)remainingTriangles, -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	// FIFO cache of the ACMR measure, restarted by moving the time past every timestamp. Returns the misses of
+	// the triangle.
+	uint32_t SimulateTriangle(const ProTerGen::Index* triangle, std::vector<uint32_t>& timestamps, uint32_t& time)
+	{
+		uint32_t misses = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			if (time - timestamps[triangle[k]] > ProTerGen::MeshOptimizer::FIFO_SIZE)
+			{
+				timestamps[triangle[k]] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+
+	struct VertexRef
+	{
+		const ProTerGen::Vertex* v = nullptr;
+	};
+
+	struct VertexRefHash
+	{
+		size_t operator()(const VertexRef& r) const noexcept
+		{
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(r.v);
+			size_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(ProTerGen::Vertex); ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+	};
+
+	struct VertexRefEqual
+	{
+		bool operator()(const VertexRef& a, const VertexRef& b) const noexcept
+		{
+			return memcmp(a.v, b.v, sizeof(ProTerGen::Vertex)) == 0;
+		}
+	};
+}
+
+ProTerGen::MeshOptimizationReport ProTerGen::MeshOptimizer::Optimize(Mesh& mesh, bool weld) const
+{
+	MeshOptimizationReport report
+	{
+		.AcmrBefore     = ComputeACMR(mesh.Indices, mesh.Vertices.size()),
+		.VerticesBefore = mesh.Vertices.size(),
+	};
+
+	if (weld)
+	{
+		WeldVertices(mesh);
+	}
+	OptimizeVertexCache(mesh.Indices, mesh.Vertices.size());
+	OptimizeOverdraw(mesh.Indices, mesh.Vertices);
+	OptimizeVertexFetch(mesh.Vertices, mesh.Indices);
+
+	report.AcmrAfter     = ComputeACMR(mesh.Indices, mesh.Vertices.size());
+	report.VerticesAfter = mesh.Vertices.size();
+	return report;
+}
+
+double ProTerGen::MeshOptimizer::ComputeACMR(const std::vector<Index>& indices, size_t vertexCount, uint32_t cacheSize) const
+{
+	if (indices.size() < 3) return 0.0;
+
+	// FIFO simulation: a vertex is cached while less than cacheSize misses happened after it was loaded.
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time   = cacheSize + 1;
+	size_t   misses = 0;
+	for (Index i : indices)
+	{
+		if (time - timestamps[i] > cacheSize)
+		{
+			timestamps[i] = time++;
+			++misses;
+		}
+	}
+	return (double)misses / (double)(indices.size() / 3);
+}
+
+void ProTerGen::MeshOptimizer::OptimizeVertexCache(std::vector<Index>& indices, size_t vertexCount) const
+{
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0 || vertexCount == 0) return;
+
+	// Vertex to triangle adjacency. The first liveTris[v] entries of each range are the triangles not emitted yet.
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triCount * 3; ++i)
+	{
+		++offsets[indices[i] + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> liveTris(vertexCount);
+	std::vector<uint32_t> adjacency(triCount * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		liveTris[v] = offsets[v + 1] - offsets[v];
+	}
+	for (size_t t = 0; t < triCount; ++t)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+		}
+	}
+
+	std::vector<int32_t> cachePosition(vertexCount, -1);
+	std::vector<float>   vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		vertexScore[v] = VertexScore(-1, liveTris[v]);
+	}
+
+	const auto triangleScore = [&](size_t t)
+	{
+		return vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	};
+
+	std::vector<bool> emitted(triCount, false);
+	int64_t best      = -1;
+	float   bestScore = -1.0f;
+	for (size_t t = 0; t < triCount; ++t)
+	{
+		const float score = triangleScore(t);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			best      = (int64_t)t;
+		}
+	}
+
+	std::vector<Index> result;
+	result.reserve(triCount * 3);
+	std::array<Index, CACHE_SIZE + 3> cache{};
+	std::array<Index, CACHE_SIZE + 3> newCache{};
+	uint32_t cacheCount = 0;
+	size_t   scanCursor = 0;
+
+	while (best >= 0)
+	{
+		const size_t t = (size_t)best;
+		emitted[t] = true;
+
+		uint32_t newCount = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			const Index v = indices[t * 3 + k];
+			result.push_back(v);
+
+			uint32_t* tris = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < liveTris[v]; ++j)
+			{
+				if (tris[j] == t)
+				{
+					tris[j] = tris[liveTris[v] - 1];
+					break;
+				}
+			}
+			--liveTris[v];
+
+			bool repeated = false;
+			for (uint32_t j = 0; j < newCount; ++j) repeated |= newCache[j] == v;
+			if (!repeated) newCache[newCount++] = v;
+		}
+		const uint32_t triVertices = newCount;
+		for (uint32_t i = 0; i < cacheCount; ++i)
+		{
+			const Index v = cache[i];
+			bool inTriangle = false;
+			for (uint32_t j = 0; j < triVertices; ++j) inTriangle |= newCache[j] == v;
+			if (!inTriangle) newCache[newCount++] = v;
+		}
+
+		for (uint32_t i = CACHE_SIZE; i < newCount; ++i)
+		{
+			const Index v     = newCache[i];
+			cachePosition[v]  = -1;
+			vertexScore[v]    = VertexScore(-1, liveTris[v]);
+		}
+		cacheCount = min(newCount, CACHE_SIZE);
+		for (uint32_t i = 0; i < cacheCount; ++i)
+		{
+			const Index v     = newCache[i];
+			cache[i]          = v;
+			cachePosition[v]  = (int32_t)i;
+			vertexScore[v]    = VertexScore((int32_t)i, liveTris[v]);
+		}
+
+		best      = -1;
+		bestScore = -1.0f;
+		for (uint32_t i = 0; i < newCount; ++i)
+		{
+			const Index v = newCache[i];
+			for (uint32_t j = 0; j < liveTris[v]; ++j)
+			{
+				const uint32_t adj   = adjacency[offsets[v] + j];
+				const float    score = triangleScore(adj);
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best      = (int64_t)adj;
+				}
+			}
+		}
+
+		if (best < 0)
+		{
+			while (scanCursor < triCount && emitted[scanCursor]) ++scanCursor;
+			if (scanCursor < triCount) best = (int64_t)scanCursor;
+		}
+	}
+
+	indices = std::move(result);
+}
+
+void ProTerGen::MeshOptimizer::OptimizeOverdraw(std::vector<Index>& indices, const std::vector<Vertex>& vertices, float threshold) const
+{
+	const size_t triCount = indices.size() / 3;
+	if (triCount == 0 || vertices.empty()) return;
+
+	// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". Hard
+	// boundaries first: triangles where every vertex misses, the cache starts over there anyway.
+	std::vector<uint32_t> timestamps(vertices.size(), 0);
+	uint32_t time = FIFO_SIZE + 1;
+	std::vector<size_t> hard = { 0 };
+	for (size_t t = 0; t < triCount; ++t)
+	{
+		if (SimulateTriangle(&indices[t * 3], timestamps, time) == 3 && t > 0)
+		{
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triCount);
+
+	// Soft boundaries: a hard cluster is cut wherever the part since the last cut, simulated from a cold cache, is
+	// within threshold of the ACMR of the whole hard cluster.
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h)
+	{
+		const size_t start = hard[h];
+		const size_t end   = hard[h + 1];
+
+		time += FIFO_SIZE + 1;
+		uint32_t hardMisses = 0;
+		for (size_t t = start; t < end; ++t)
+		{
+			hardMisses += SimulateTriangle(&indices[t * 3], timestamps, time);
+		}
+		const float maxAcmr = threshold * (float)hardMisses / (float)(end - start);
+
+		time += FIFO_SIZE + 1;
+		size_t   clusterStart  = start;
+		uint32_t clusterMisses = 0;
+		clusters.push_back(start);
+		for (size_t t = start; t + 1 < end; ++t)
+		{
+			clusterMisses += SimulateTriangle(&indices[t * 3], timestamps, time);
+			if ((float)clusterMisses <= maxAcmr * (float)(t + 1 - clusterStart))
+			{
+				clusterStart  = t + 1;
+				clusterMisses = 0;
+				time += FIFO_SIZE + 1;
+				clusters.push_back(clusterStart);
+			}
+		}
+	}
+	clusters.push_back(triCount);
+
+	DirectX::XMFLOAT3 meshCenter = { 0.0f, 0.0f, 0.0f };
+	for (const Vertex& v : vertices)
+	{
+		meshCenter.x += v.Position.x;
+		meshCenter.y += v.Position.y;
+		meshCenter.z += v.Position.z;
+	}
+	const float invCount = 1.0f / (float)vertices.size();
+	meshCenter = { meshCenter.x * invCount, meshCenter.y * invCount, meshCenter.z * invCount };
+
+	// Clusters facing away from the center, and far along their normal, are drawn first.
+	struct ClusterSort
+	{
+		size_t Cluster = 0;
+		float  Key     = 0.0f;
+	};
+	std::vector<ClusterSort> order(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); ++c)
+	{
+		DirectX::XMFLOAT3 center = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 normal = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const DirectX::XMFLOAT4& p0 = vertices[indices[t * 3]].Position;
+			const DirectX::XMFLOAT4& p1 = vertices[indices[t * 3 + 1]].Position;
+			const DirectX::XMFLOAT4& p2 = vertices[indices[t * 3 + 2]].Position;
+			const float e1x = p1.x - p0.x, e1y = p1.y - p0.y, e1z = p1.z - p0.z;
+			const float e2x = p2.x - p0.x, e2y = p2.y - p0.y, e2z = p2.z - p0.z;
+			const float nx = e1y * e2z - e1z * e2y;
+			const float ny = e1z * e2x - e1x * e2z;
+			const float nz = e1x * e2y - e1y * e2x;
+			const float triArea = sqrtf(nx * nx + ny * ny + nz * nz);
+
+			center.x += (p0.x + p1.x + p2.x) * triArea;
+			center.y += (p0.y + p1.y + p2.y) * triArea;
+			center.z += (p0.z + p1.z + p2.z) * triArea;
+			normal.x += nx;
+			normal.y += ny;
+			normal.z += nz;
+			area += triArea;
+		}
+
+		float key = 0.0f;
+		const float normalLength = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+		if (area > 0.0f && normalLength > 0.0f)
+		{
+			const float invArea = 1.0f / (3.0f * area);
+			key = ((center.x * invArea - meshCenter.x) * normal.x
+				+  (center.y * invArea - meshCenter.y) * normal.y
+				+  (center.z * invArea - meshCenter.z) * normal.z) / normalLength;
+		}
+		order[c] = { .Cluster = c, .Key = key };
+	}
+	std::stable_sort(order.begin(), order.end(), [](const ClusterSort& a, const ClusterSort& b) { return a.Key > b.Key; });
+
+	std::vector<Index> result;
+	result.reserve(indices.size());
+	for (const ClusterSort& o : order)
+	{
+		result.insert(result.end(), indices.begin() + clusters[o.Cluster] * 3, indices.begin() + clusters[o.Cluster + 1] * 3);
+	}
+	result.insert(result.end(), indices.begin() + triCount * 3, indices.end());
+	indices = std::move(result);
+}
+
+size_t ProTerGen::MeshOptimizer::WeldVertices(Mesh& mesh) const
+{
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.Vertices.size());
+	std::vector<Index> remap(mesh.Vertices.size());
+	std::unordered_map<VertexRef, Index, VertexRefHash, VertexRefEqual> unique{};
+	unique.reserve(mesh.Vertices.size());
+
+	for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+	{
+		const auto [it, inserted] = unique.try_emplace(VertexRef{ &mesh.Vertices[i] }, (Index)vertices.size());
+		if (inserted)
+		{
+			vertices.push_back(mesh.Vertices[i]);
+		}
+		remap[i] = it->second;
+	}
+	for (Index& i : mesh.Indices)
+	{
+		i = remap[i];
+	}
+
+	const size_t removed = mesh.Vertices.size() - vertices.size();
+	mesh.Vertices = std::move(vertices);
+	return removed;
+}
+
+std::vector<ProTerGen::Index> ProTerGen::MeshOptimizer::BuildVertexFetchRemap(std::vector<Index>& indices, size_t vertexCount) const
+{
+	std::vector<Index> remap(vertexCount, gInvalidIndex);
+	Index next = 0;
+	for (Index& i : indices)
+	{
+		if (remap[i] == gInvalidIndex)
+		{
+			remap[i] = next++;
+		}
+		i = remap[i];
+	}
+	for (Index& r : remap)
+	{
+		if (r == gInvalidIndex)
+		{
+			r = next++;
+		}
+	}
+	return remap;
+}
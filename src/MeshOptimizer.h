@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "CommonHeaders.h"
+#include "Mesh.h"
+#include "Config.h"
+
+namespace ProTerGen
+{
+	struct MeshOptimizationReport
+	{
+		double AcmrBefore     = 0.0;
+		double AcmrAfter      = 0.0;
+		size_t VerticesBefore = 0;
+		size_t VerticesAfter  = 0;
+	};
+
+	// CPU mesh optimization: post-transform cache ordering (Forsyth), overdraw ordering (Tipsify style clusters),
+	// vertex fetch ordering and ACMR (average cache miss ratio, transformed vertices per triangle) measurement.
+	class MeshOptimizer
+	{
+	public:
+		static constexpr uint32_t CACHE_SIZE = 32; // LRU size modelled by the cache optimizer
+		static constexpr uint32_t FIFO_SIZE  = 16; // FIFO size used to measure the ACMR
+		static constexpr float    OVERDRAW_THRESHOLD = 1.05f; // ACMR the overdraw ordering may give up, as a factor
+
+		MeshOptimizationReport Optimize(Mesh& mesh, bool weld = false) const;
+
+		double ComputeACMR(const std::vector<Index>& indices, size_t vertexCount, uint32_t cacheSize = FIFO_SIZE) const;
+		void   OptimizeVertexCache(std::vector<Index>& indices, size_t vertexCount) const;
+		// Reorders clusters of cache ordered triangles so the ones facing out of the mesh are drawn first and hide
+		// the ones behind them. Clusters end where the cache starts over, or where their ACMR is within threshold
+		// of it; a higher threshold gives smaller clusters, a better overdraw order and a worse ACMR.
+		void   OptimizeOverdraw(std::vector<Index>& indices, const std::vector<Vertex>& vertices, float threshold = OVERDRAW_THRESHOLD) const;
+		size_t WeldVertices(Mesh& mesh) const;
+
+		// Rewrites the indices so vertices are referenced in first use order. Returns the new
+		// position of every old vertex; unreferenced vertices are moved to the end.
+		std::vector<Index> BuildVertexFetchRemap(std::vector<Index>& indices, size_t vertexCount) const;
+
+		template<typename V>
+		void OptimizeVertexFetch(std::vector<V>& vertices, std::vector<Index>& indices) const
+		{
+			const std::vector<Index> remap = BuildVertexFetchRemap(indices, vertices.size());
+			std::vector<V> result(vertices.size());
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				result[remap[i]] = vertices[i];
+			}
+			vertices = std::move(result);
+		}
+	};
+}
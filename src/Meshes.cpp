@@ -1,6 +1,8 @@
 #include "Meshes.h"
 #include "BufferCreator.h"
 #include "ObjReader.h"
+#include "MeshOptimizer.h"
+#include "MathHelpers.h"
 
 ProTerGen::Mesh* ProTerGen::Meshes::LoadMeshFromFile(std::wstring path)
 {
@@ -21,6 +23,14 @@ ProTerGen::Mesh* ProTerGen::Meshes::LoadMeshFromFile(std::wstring path)
 		delete result;
 		return nullptr;
 	}
+
+	// The reader emits three unique vertices per face, weld them before reordering.
+	MeshOptimizer optimizer{};
+	const MeshOptimizationReport report = optimizer.Optimize(*result, true);
+#if _DEBUG
+	wprintf(L"Mesh optimized: %s\n\tVertices: %zu -> %zu\n\tACMR: %.3f -> %.3f\n", path.c_str(),
+		report.VerticesBefore, report.VerticesAfter, report.AcmrBefore, report.AcmrAfter);
+#endif
 	return result;
 }
 
@@ -62,6 +72,7 @@ void ProTerGen::Meshes::LoadMeshesInGpu
 
 	size_t vertexCount = 0;
 	size_t indexCount = 0;
+	size_t maxSubmeshVertexCount = 0;
 
 	for (Mesh* mesh : meshes)
 	{
@@ -74,6 +85,7 @@ void ProTerGen::Meshes::LoadMeshesInGpu
 
 		vertexCount += mesh->Vertices.size();
 		indexCount  += mesh->Indices.size();
+		maxSubmeshVertexCount = max(maxSubmeshVertexCount, mesh->Vertices.size());
 
 		if (mesh->Name != "")
 		{
@@ -88,8 +100,13 @@ void ProTerGen::Meshes::LoadMeshesInGpu
 	}
 	meshGpu.SubMesh.emplace("", SubmeshParameters{ indexCount, 0, 0 });
 
+	// Indices are relative to each submesh base vertex, so 16 bits are enough unless one submesh is too big.
+	const DXGI_FORMAT indexFormat = GetIndexFormat(maxSubmeshVertexCount);
 	const uint32_t vbByteSize = static_cast<uint32_t>(vertices.size()) * sizeof(Vertex);
-	const uint32_t ibByteSize = static_cast<uint32_t>(indices.size()) * sizeof(Index);
+	const uint32_t ibByteSize = static_cast<uint32_t>(indices.size() * GetIndexByteStride(indexFormat));
+
+	std::vector<uint8_t> indexData(ibByteSize);
+	WriteIndices(indexData.data(), indices.data(), indices.size(), indexFormat);
 
 	//ThrowIfFailed(D3DCreateBlob(vbByteSize, &meshGpu->VertexBufferCPU));
 	//CopyMemory(meshGpu->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -111,7 +128,7 @@ void ProTerGen::Meshes::LoadMeshesInGpu
 	(
 		device,
 		commandList, 
-		indices.data(), 
+		indexData.data(), 
 		ibByteSize, 
 		meshGpu.IndexBufferUploader
 	);
@@ -119,6 +136,7 @@ void ProTerGen::Meshes::LoadMeshesInGpu
 	meshGpu.VertexByteStride     = sizeof(Vertex);
 	meshGpu.VertexBufferByteSize = vbByteSize;
 	meshGpu.IndexBufferByteSize  = ibByteSize;
+	meshGpu.IndexFormat          = indexFormat;
 }
 
 ProTerGen::MeshGpuLocations ProTerGen::Meshes::GetMeshGpuLocation(std::string meshName, std::string submeshName)
@@ -129,7 +147,8 @@ ProTerGen::MeshGpuLocations ProTerGen::Meshes::GetMeshGpuLocation(std::string me
 		.Vbv = meshGpu.VertexBufferView(),
 		.Ibv = meshGpu.IndexBufferView(),
 		.Instances = meshGpu.InstanceBufferView(),
-		.MeshRenderValues = meshGpu.SubMesh[submeshName]
+		.MeshRenderValues = meshGpu.SubMesh[submeshName],
+		.DrawRanges = (submeshName.empty() && !meshGpu.DrawRanges.empty()) ? &meshGpu.DrawRanges : nullptr
 	};
 }
 
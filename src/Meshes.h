@@ -14,6 +14,7 @@ namespace ProTerGen
 		D3D12_INDEX_BUFFER_VIEW Ibv{};
 		D3D12_VERTEX_BUFFER_VIEW Instances{};
 		SubmeshParameters MeshRenderValues{};
+		const std::vector<SubmeshParameters>* DrawRanges = nullptr;
 	};
 
 	class Meshes
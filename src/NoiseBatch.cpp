@@ -0,0 +1,480 @@
+#include "NoiseBatch.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROTERGEN_NOISE_BATCH_X64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic in any function; GCC and Clang need the target enabled per function.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PROTERGEN_TARGET(isa)
+#else
+#define PROTERGEN_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace
+{
+	using Kernel = void(*)(const uint32_t* p, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values);
+
+	constexpr uint32_t PERMUTATION_MASK = 255;
+	constexpr float    NOISE_Z          = (float)ProTerGen::PerlinNoise::NOISE_2D_Z;
+
+#if _DEBUG
+	// Startup check of the selected kernel against the double precision reference.
+	constexpr uint32_t VALIDATION_SAMPLES   = 64;
+	constexpr float    VALIDATION_TOLERANCE = 2e-6f;
+#endif
+
+	// Runs a W wide kernel over count points; the tail goes through a zero padded block so every
+	// point is computed by the same code.
+	template<size_t W, typename Block>
+	inline void ForEachBlock(const float* xs, const float* ys, size_t count, float* values, Block block)
+	{
+		size_t i = 0;
+		for (; i + W <= count; i += W)
+		{
+			block(xs + i, ys + i, values + i);
+		}
+		if (i < count)
+		{
+			float tx[W]{};
+			float ty[W]{};
+			float tv[W]{};
+			memcpy(tx, xs + i, (count - i) * sizeof(float));
+			memcpy(ty, ys + i, (count - i) * sizeof(float));
+			block(tx, ty, tv);
+			memcpy(values + i, tv, (count - i) * sizeof(float));
+		}
+	}
+
+	void FBMScalar(const ProTerGen::PerlinNoise& noise, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			values[i] = (float)noise.FBM(xs[i], ys[i], fbm.Octaves, fbm.Frecuency, fbm.Gain);
+		}
+	}
+
+#if PROTERGEN_NOISE_BATCH_X64
+#pragma region SSE2
+	inline __m128 Floor4(__m128 x)
+	{
+		// Truncation rounds towards zero, so negative non integer values need one less.
+		const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+
+	inline __m128 Fade4(__m128 t)
+	{
+		__m128 r = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f));
+		r = _mm_add_ps(_mm_mul_ps(r, t), _mm_set1_ps(10.0f));
+		return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(r, t), t), t);
+	}
+
+	inline __m128 Lerp4(__m128 t, __m128 a, __m128 b)
+	{
+		return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+	}
+
+	inline __m128 Select4(__m128i mask, __m128 a, __m128 b)
+	{
+		const __m128 m = _mm_castsi128_ps(mask);
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+
+	// Same gradient table as PerlinNoise::Grad without branches.
+	inline __m128 Grad4(__m128i hash, __m128 x, __m128 y, __m128 z)
+	{
+		const __m128i h     = _mm_and_si128(hash, _mm_set1_epi32(15));
+		const __m128  u     = Select4(_mm_cmplt_epi32(h, _mm_set1_epi32(8)), x, y);
+		const __m128i useX  = _mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14)));
+		const __m128  v     = Select4(_mm_cmplt_epi32(h, _mm_set1_epi32(4)), y, Select4(useX, x, z));
+		const __m128  uSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+		const __m128  vSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+		return _mm_add_ps(_mm_xor_ps(u, uSign), _mm_xor_ps(v, vSign));
+	}
+
+	__m128 Perlin4(const uint32_t* p, __m128 x, __m128 y)
+	{
+		const __m128  fx   = Floor4(x);
+		const __m128  fy   = Floor4(y);
+		const __m128i mask = _mm_set1_epi32(PERMUTATION_MASK);
+		alignas(16) int32_t px[4];
+		alignas(16) int32_t py[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(px), _mm_and_si128(_mm_cvttps_epi32(fx), mask));
+		_mm_store_si128(reinterpret_cast<__m128i*>(py), _mm_and_si128(_mm_cvttps_epi32(fy), mask));
+
+		// SSE2 has no gather. The z slice is constant: its lattice cell is 0 and z - 1 is the far face.
+		alignas(16) int32_t hash[8][4];
+		for (uint32_t l = 0; l < 4; ++l)
+		{
+			const uint32_t A  = p[px[l]] + py[l];
+			const uint32_t B  = p[px[l] + 1] + py[l];
+			const uint32_t AA = p[A];
+			const uint32_t AB = p[A + 1];
+			const uint32_t BA = p[B];
+			const uint32_t BB = p[B + 1];
+			hash[0][l] = p[AA];
+			hash[1][l] = p[BA];
+			hash[2][l] = p[AB];
+			hash[3][l] = p[BB];
+			hash[4][l] = p[AA + 1];
+			hash[5][l] = p[BA + 1];
+			hash[6][l] = p[AB + 1];
+			hash[7][l] = p[BB + 1];
+		}
+
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 x0  = _mm_sub_ps(x, fx);
+		const __m128 y0  = _mm_sub_ps(y, fy);
+		const __m128 z0  = _mm_set1_ps(NOISE_Z);
+		const __m128 x1  = _mm_sub_ps(x0, one);
+		const __m128 y1  = _mm_sub_ps(y0, one);
+		const __m128 z1  = _mm_sub_ps(z0, one);
+		const __m128 u   = Fade4(x0);
+		const __m128 v   = Fade4(y0);
+		const __m128 w   = Fade4(z0);
+
+		const auto h = [&](uint32_t i) { return _mm_load_si128(reinterpret_cast<const __m128i*>(hash[i])); };
+		const __m128 lerpU12 = Lerp4(u, Grad4(h(0), x0, y0, z0), Grad4(h(1), x1, y0, z0));
+		const __m128 lerpU23 = Lerp4(u, Grad4(h(2), x0, y1, z0), Grad4(h(3), x1, y1, z0));
+		const __m128 lerpU45 = Lerp4(u, Grad4(h(4), x0, y0, z1), Grad4(h(5), x1, y0, z1));
+		const __m128 lerpU67 = Lerp4(u, Grad4(h(6), x0, y1, z1), Grad4(h(7), x1, y1, z1));
+		const __m128 result  = Lerp4(w, Lerp4(v, lerpU12, lerpU23), Lerp4(v, lerpU45, lerpU67));
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		return _mm_add_ps(half, _mm_mul_ps(result, half));
+	}
+
+	void FBMSSE2(const uint32_t* p, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<4>(xs, ys, count, values, [&](const float* bx, const float* by, float* out)
+		{
+			const __m128 x     = _mm_loadu_ps(bx);
+			const __m128 y     = _mm_loadu_ps(by);
+			__m128 value       = _mm_setzero_ps();
+			float  amplitude   = 1.0f;
+			float  frecuency   = fbm.Frecuency;
+			float  norm        = 0.0f;
+			for (uint32_t o = 0; o < fbm.Octaves; ++o)
+			{
+				const __m128 f = _mm_set1_ps(frecuency);
+				value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(amplitude), Perlin4(p, _mm_mul_ps(x, f), _mm_mul_ps(y, f))));
+				frecuency *= 2.0f;
+				norm      += amplitude;
+				amplitude *= fbm.Gain;
+			}
+			_mm_storeu_ps(out, _mm_div_ps(value, _mm_set1_ps(norm)));
+		});
+	}
+#pragma endregion
+
+#pragma region AVX2
+	PROTERGEN_TARGET("avx2") inline __m256 Lerp8(__m256 t, __m256 a, __m256 b)
+	{
+		return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Fade8(__m256 t)
+	{
+		__m256 r = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+		r = _mm256_add_ps(_mm256_mul_ps(r, t), _mm256_set1_ps(10.0f));
+		return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(r, t), t), t);
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Grad8(__m256i hash, __m256 x, __m256 y, __m256 z)
+	{
+		const __m256i h     = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+		const __m256  lt8   = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+		const __m256  lt4   = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+		const __m256  useX  = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+		const __m256  u     = _mm256_blendv_ps(y, x, lt8);
+		const __m256  v     = _mm256_blendv_ps(_mm256_blendv_ps(z, x, useX), y, lt4);
+		const __m256  uSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+		const __m256  vSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+		return _mm256_add_ps(_mm256_xor_ps(u, uSign), _mm256_xor_ps(v, vSign));
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256i Gather8(const uint32_t* p, __m256i i)
+	{
+		return _mm256_i32gather_epi32(reinterpret_cast<const int*>(p), i, 4);
+	}
+
+	PROTERGEN_TARGET("avx2") inline __m256 Perlin8(const uint32_t* p, __m256 x, __m256 y)
+	{
+		const __m256  fx   = _mm256_floor_ps(x);
+		const __m256  fy   = _mm256_floor_ps(y);
+		const __m256i mask = _mm256_set1_epi32(PERMUTATION_MASK);
+		const __m256i one  = _mm256_set1_epi32(1);
+		const __m256i px   = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+		const __m256i py   = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+
+		const __m256i A  = _mm256_add_epi32(Gather8(p, px), py);
+		const __m256i B  = _mm256_add_epi32(Gather8(p, _mm256_add_epi32(px, one)), py);
+		const __m256i AA = Gather8(p, A);
+		const __m256i AB = Gather8(p, _mm256_add_epi32(A, one));
+		const __m256i BA = Gather8(p, B);
+		const __m256i BB = Gather8(p, _mm256_add_epi32(B, one));
+
+		const __m256 fone = _mm256_set1_ps(1.0f);
+		const __m256 x0   = _mm256_sub_ps(x, fx);
+		const __m256 y0   = _mm256_sub_ps(y, fy);
+		const __m256 z0   = _mm256_set1_ps(NOISE_Z);
+		const __m256 x1   = _mm256_sub_ps(x0, fone);
+		const __m256 y1   = _mm256_sub_ps(y0, fone);
+		const __m256 z1   = _mm256_sub_ps(z0, fone);
+		const __m256 u    = Fade8(x0);
+		const __m256 v    = Fade8(y0);
+		const __m256 w    = Fade8(z0);
+
+		const __m256 lerpU12 = Lerp8(u, Grad8(Gather8(p, AA), x0, y0, z0), Grad8(Gather8(p, BA), x1, y0, z0));
+		const __m256 lerpU23 = Lerp8(u, Grad8(Gather8(p, AB), x0, y1, z0), Grad8(Gather8(p, BB), x1, y1, z0));
+		const __m256 lerpU45 = Lerp8(u, Grad8(Gather8(p, _mm256_add_epi32(AA, one)), x0, y0, z1), Grad8(Gather8(p, _mm256_add_epi32(BA, one)), x1, y0, z1));
+		const __m256 lerpU67 = Lerp8(u, Grad8(Gather8(p, _mm256_add_epi32(AB, one)), x0, y1, z1), Grad8(Gather8(p, _mm256_add_epi32(BB, one)), x1, y1, z1));
+		const __m256 result  = Lerp8(w, Lerp8(v, lerpU12, lerpU23), Lerp8(v, lerpU45, lerpU67));
+
+		const __m256 half = _mm256_set1_ps(0.5f);
+		return _mm256_add_ps(half, _mm256_mul_ps(result, half));
+	}
+
+	PROTERGEN_TARGET("avx2") void FBMAVX2Block(const uint32_t* p, const float* bx, const float* by, const ProTerGen::FBMDesc& fbm, float* out)
+	{
+		const __m256 x     = _mm256_loadu_ps(bx);
+		const __m256 y     = _mm256_loadu_ps(by);
+		__m256 value       = _mm256_setzero_ps();
+		float  amplitude   = 1.0f;
+		float  frecuency   = fbm.Frecuency;
+		float  norm        = 0.0f;
+		for (uint32_t o = 0; o < fbm.Octaves; ++o)
+		{
+			const __m256 f = _mm256_set1_ps(frecuency);
+			value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(amplitude), Perlin8(p, _mm256_mul_ps(x, f), _mm256_mul_ps(y, f))));
+			frecuency *= 2.0f;
+			norm      += amplitude;
+			amplitude *= fbm.Gain;
+		}
+		_mm256_storeu_ps(out, _mm256_div_ps(value, _mm256_set1_ps(norm)));
+	}
+
+	void FBMAVX2(const uint32_t* p, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<8>(xs, ys, count, values, [&](const float* bx, const float* by, float* out) { FBMAVX2Block(p, bx, by, fbm, out); });
+	}
+#pragma endregion
+
+#pragma region AVX512
+	PROTERGEN_TARGET("avx512f") inline __m512 Lerp16(__m512 t, __m512 a, __m512 b)
+	{
+		return _mm512_add_ps(a, _mm512_mul_ps(t, _mm512_sub_ps(b, a)));
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Fade16(__m512 t)
+	{
+		__m512 r = _mm512_sub_ps(_mm512_mul_ps(t, _mm512_set1_ps(6.0f)), _mm512_set1_ps(15.0f));
+		r = _mm512_add_ps(_mm512_mul_ps(r, t), _mm512_set1_ps(10.0f));
+		return _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(r, t), t), t);
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Grad16(__m512i hash, __m512 x, __m512 y, __m512 z)
+	{
+		const __m512i   h     = _mm512_and_si512(hash, _mm512_set1_epi32(15));
+		const __mmask16 lt8   = _mm512_cmplt_epi32_mask(h, _mm512_set1_epi32(8));
+		const __mmask16 lt4   = _mm512_cmplt_epi32_mask(h, _mm512_set1_epi32(4));
+		const __mmask16 useX  = _mm512_cmpeq_epi32_mask(h, _mm512_set1_epi32(12)) | _mm512_cmpeq_epi32_mask(h, _mm512_set1_epi32(14));
+		const __m512    u     = _mm512_mask_blend_ps(lt8, y, x);
+		const __m512    v     = _mm512_mask_blend_ps(lt4, _mm512_mask_blend_ps(useX, z, x), y);
+		const __m512i   uSign = _mm512_slli_epi32(_mm512_and_si512(h, _mm512_set1_epi32(1)), 31);
+		const __m512i   vSign = _mm512_slli_epi32(_mm512_and_si512(h, _mm512_set1_epi32(2)), 30);
+		const __m512    su    = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(u), uSign));
+		const __m512    sv    = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), vSign));
+		return _mm512_add_ps(su, sv);
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512i Gather16(const uint32_t* p, __m512i i)
+	{
+		return _mm512_i32gather_epi32(i, p, 4);
+	}
+
+	PROTERGEN_TARGET("avx512f") inline __m512 Perlin16(const uint32_t* p, __m512 x, __m512 y)
+	{
+		const __m512  fx   = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		const __m512  fy   = _mm512_roundscale_ps(y, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+		const __m512i mask = _mm512_set1_epi32(PERMUTATION_MASK);
+		const __m512i one  = _mm512_set1_epi32(1);
+		const __m512i px   = _mm512_and_si512(_mm512_cvttps_epi32(fx), mask);
+		const __m512i py   = _mm512_and_si512(_mm512_cvttps_epi32(fy), mask);
+
+		const __m512i A  = _mm512_add_epi32(Gather16(p, px), py);
+		const __m512i B  = _mm512_add_epi32(Gather16(p, _mm512_add_epi32(px, one)), py);
+		const __m512i AA = Gather16(p, A);
+		const __m512i AB = Gather16(p, _mm512_add_epi32(A, one));
+		const __m512i BA = Gather16(p, B);
+		const __m512i BB = Gather16(p, _mm512_add_epi32(B, one));
+
+		const __m512 fone = _mm512_set1_ps(1.0f);
+		const __m512 x0   = _mm512_sub_ps(x, fx);
+		const __m512 y0   = _mm512_sub_ps(y, fy);
+		const __m512 z0   = _mm512_set1_ps(NOISE_Z);
+		const __m512 x1   = _mm512_sub_ps(x0, fone);
+		const __m512 y1   = _mm512_sub_ps(y0, fone);
+		const __m512 z1   = _mm512_sub_ps(z0, fone);
+		const __m512 u    = Fade16(x0);
+		const __m512 v    = Fade16(y0);
+		const __m512 w    = Fade16(z0);
+
+		const __m512 lerpU12 = Lerp16(u, Grad16(Gather16(p, AA), x0, y0, z0), Grad16(Gather16(p, BA), x1, y0, z0));
+		const __m512 lerpU23 = Lerp16(u, Grad16(Gather16(p, AB), x0, y1, z0), Grad16(Gather16(p, BB), x1, y1, z0));
+		const __m512 lerpU45 = Lerp16(u, Grad16(Gather16(p, _mm512_add_epi32(AA, one)), x0, y0, z1), Grad16(Gather16(p, _mm512_add_epi32(BA, one)), x1, y0, z1));
+		const __m512 lerpU67 = Lerp16(u, Grad16(Gather16(p, _mm512_add_epi32(AB, one)), x0, y1, z1), Grad16(Gather16(p, _mm512_add_epi32(BB, one)), x1, y1, z1));
+		const __m512 result  = Lerp16(w, Lerp16(v, lerpU12, lerpU23), Lerp16(v, lerpU45, lerpU67));
+
+		const __m512 half = _mm512_set1_ps(0.5f);
+		return _mm512_add_ps(half, _mm512_mul_ps(result, half));
+	}
+
+	PROTERGEN_TARGET("avx512f") void FBMAVX512Block(const uint32_t* p, const float* bx, const float* by, const ProTerGen::FBMDesc& fbm, float* out)
+	{
+		const __m512 x     = _mm512_loadu_ps(bx);
+		const __m512 y     = _mm512_loadu_ps(by);
+		__m512 value       = _mm512_setzero_ps();
+		float  amplitude   = 1.0f;
+		float  frecuency   = fbm.Frecuency;
+		float  norm        = 0.0f;
+		for (uint32_t o = 0; o < fbm.Octaves; ++o)
+		{
+			const __m512 f = _mm512_set1_ps(frecuency);
+			value = _mm512_add_ps(value, _mm512_mul_ps(_mm512_set1_ps(amplitude), Perlin16(p, _mm512_mul_ps(x, f), _mm512_mul_ps(y, f))));
+			frecuency *= 2.0f;
+			norm      += amplitude;
+			amplitude *= fbm.Gain;
+		}
+		_mm512_storeu_ps(out, _mm512_div_ps(value, _mm512_set1_ps(norm)));
+	}
+
+	void FBMAVX512(const uint32_t* p, const float* xs, const float* ys, size_t count, const ProTerGen::FBMDesc& fbm, float* values)
+	{
+		ForEachBlock<16>(xs, ys, count, values, [&](const float* bx, const float* by, float* out) { FBMAVX512Block(p, bx, by, fbm, out); });
+	}
+#pragma endregion
+#endif
+
+	Kernel GetKernel(ProTerGen::NoiseBatchISA isa)
+	{
+#if PROTERGEN_NOISE_BATCH_X64
+		switch (isa)
+		{
+		case ProTerGen::NoiseBatchISA::SSE2:   return &FBMSSE2;
+		case ProTerGen::NoiseBatchISA::AVX2:   return &FBMAVX2;
+		case ProTerGen::NoiseBatchISA::AVX512: return &FBMAVX512;
+		default: break;
+		}
+#endif
+		return nullptr;
+	}
+}
+
+ProTerGen::NoiseBatchISA ProTerGen::NoiseBatch::DetectISA()
+{
+#if PROTERGEN_NOISE_BATCH_X64
+#if defined(_MSC_VER)
+	// The OS must also save the wider registers (XCR0) for AVX and AVX-512 to be usable.
+	int info[4]{};
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx     = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || maxLeaf < 7) return NoiseBatchISA::SSE2;
+
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	const bool avx2    = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+	const bool avx512f = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+#else
+	__builtin_cpu_init();
+	const bool avx2    = __builtin_cpu_supports("avx2");
+	const bool avx512f = __builtin_cpu_supports("avx512f");
+#endif
+	if (avx512f) return NoiseBatchISA::AVX512;
+	if (avx2)    return NoiseBatchISA::AVX2;
+	return NoiseBatchISA::SSE2;
+#else
+	return NoiseBatchISA::SCALAR;
+#endif
+}
+
+const char* ProTerGen::NoiseBatch::ISAName(NoiseBatchISA isa)
+{
+	switch (isa)
+	{
+	case NoiseBatchISA::SSE2:   return "SSE2";
+	case NoiseBatchISA::AVX2:   return "AVX2";
+	case NoiseBatchISA::AVX512: return "AVX-512";
+	default:                    return "Scalar";
+	}
+}
+
+void ProTerGen::NoiseBatch::Init(const PerlinNoise* noise, NoiseBatchISA isa)
+{
+	mNoise = noise;
+	const NoiseBatchISA best = DetectISA();
+	mISA = (uint8_t)isa > (uint8_t)best ? best : isa;
+
+#if _DEBUG
+	assert(ValidateAgainstScalar(FBMDesc{}, VALIDATION_SAMPLES) <= VALIDATION_TOLERANCE && "NoiseBatch kernel disagrees with PerlinNoise.");
+#endif
+}
+
+void ProTerGen::NoiseBatch::Noise(const float* xs, const float* ys, size_t count, float* values) const
+{
+	// A single octave at unit frecuency is the plain noise.
+	FBM(xs, ys, count, FBMDesc{ .Octaves = 1, .Frecuency = 1.0f, .Gain = 1.0f }, values);
+}
+
+void ProTerGen::NoiseBatch::FBM(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* values) const
+{
+	assert(mNoise != nullptr);
+	const Kernel kernel = GetKernel(mISA);
+	if (kernel == nullptr)
+	{
+		FBMScalar(*mNoise, xs, ys, count, fbm, values);
+		return;
+	}
+	kernel(mNoise->GetPermutation().data(), xs, ys, count, fbm, values);
+}
+
+float ProTerGen::NoiseBatch::ValidateAgainstScalar(const FBMDesc& fbm, uint32_t samplesPerSide) const
+{
+	assert(mNoise != nullptr && samplesPerSide > 1);
+	const size_t count = (size_t)samplesPerSide * samplesPerSide;
+	std::vector<float> xs(count);
+	std::vector<float> ys(count);
+	std::vector<float> values(count);
+	const float step = 8.0f / (float)(samplesPerSide - 1);
+	for (uint32_t j = 0; j < samplesPerSide; ++j)
+	{
+		for (uint32_t i = 0; i < samplesPerSide; ++i)
+		{
+			// Off the lattice, so no sample sits exactly on a cell edge.
+			xs[(size_t)j * samplesPerSide + i] = -4.0f + step * i + 0.013f;
+			ys[(size_t)j * samplesPerSide + i] = -4.0f + step * j + 0.029f;
+		}
+	}
+	FBM(xs.data(), ys.data(), count, fbm, values.data());
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float reference = (float)mNoise->FBM(xs[i], ys[i], fbm.Octaves, fbm.Frecuency, fbm.Gain);
+		const float error = std::fabs(values[i] - reference);
+		maxError = error > maxError ? error : maxError;
+	}
+	return maxError;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include "Noiser.h"
+
+namespace ProTerGen
+{
+	struct FBMDesc
+	{
+		uint32_t Octaves   = 6;
+		float    Frecuency = 1.0f;
+		float    Gain      = 0.6f;
+	};
+
+	enum class NoiseBatchISA : uint8_t
+	{
+		SCALAR = 0,
+		SSE2,
+		AVX2,
+		AVX512,
+	};
+
+	// Evaluates the 2D slice of a PerlinNoise for many points at once in float32, picking the widest
+	// instruction set available at runtime. PerlinNoise::Noise stays the double precision reference;
+	// the batched results differ from it by float rounding only (~1e-6).
+	// The noise must be generated before Init and not modified while a NoiseBatch refers to it.
+	class NoiseBatch
+	{
+	public:
+		NoiseBatch() = default;
+		virtual ~NoiseBatch() = default;
+
+		static NoiseBatchISA DetectISA();
+		static const char*   ISAName(NoiseBatchISA isa);
+
+		// Requests wider than the CPU supports fall back to the best available one.
+		void Init(const PerlinNoise* noise, NoiseBatchISA isa = DetectISA());
+
+		void Noise(const float* xs, const float* ys, size_t count, float* values) const;
+		void FBM(const float* xs, const float* ys, size_t count, const FBMDesc& fbm, float* values) const;
+
+		// Largest difference between FBM and PerlinNoise::FBM over a samplesPerSide^2 grid of [-4, 4]^2,
+		// which crosses cells of both signs. Debug builds check it for the selected kernel on Init.
+		float ValidateAgainstScalar(const FBMDesc& fbm, uint32_t samplesPerSide) const;
+
+		inline NoiseBatchISA GetISA() const { return mISA; }
+		inline const PerlinNoise* GetNoise() const { return mNoise; }
+	protected:
+		const PerlinNoise* mNoise = nullptr;
+		NoiseBatchISA      mISA   = NoiseBatchISA::SCALAR;
+	};
+}
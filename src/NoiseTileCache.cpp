@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cwchar>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "NoiseTileCache.h"
+
+namespace
+{
+	// Bump whenever the generated noise changes, so older spilled tiles stop matching.
+	constexpr uint64_t NOISE_TILE_VERSION = 2;
+	constexpr uint32_t NOISE_TILE_MAGIC   = 0x4C54504E; // "NPTL"
+
+	struct NoiseTileHeader
+	{
+		uint32_t Magic      = NOISE_TILE_MAGIC;
+		uint32_t Version    = (uint32_t)NOISE_TILE_VERSION;
+		uint64_t TexelCount = 0;
+	};
+
+	// A trimmed spill directory is brought this far below its cap, so the next spills don't trim it again.
+	constexpr double SPILL_TRIM_TARGET = 0.75;
+
+	template<typename T>
+	inline uint64_t HashValue(uint64_t hash, const T& value)
+	{
+		return ProTerGen::VT::NoiseTileCache::HashBytes(hash, &value, sizeof(T));
+	}
+}
+
+std::atomic<uint64_t> ProTerGen::VT::NoiseTileCache::sMetricHits    = 0;
+std::atomic<uint64_t> ProTerGen::VT::NoiseTileCache::sMetricLookups = 0;
+
+ProTerGen::VT::NoiseTileCache::~NoiseTileCache()
+{
+	Flush();
+}
+
+void ProTerGen::VT::NoiseTileCache::Init(size_t memoryTiles, const std::wstring& spillDirectory, uint64_t maxSpillBytes)
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	mSpillDirectory = spillDirectory;
+	mMaxSpillBytes = maxSpillBytes;
+	mSpilledBytes.store(0);
+	if (!mSpillDirectory.empty())
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(mSpillDirectory, ec);
+		if (ec) mSpillDirectory.clear();
+	}
+	if (!mSpillDirectory.empty() && mMaxSpillBytes > 0)
+	{
+		TrimSpilled();
+	}
+
+	mMemoryTiles = memoryTiles;
+	mLru.OnRemove([&](NoiseTileKey key, tile_ptr tile) { mEvicted.emplace_back(key, tile); });
+	mLru.Resize(mMemoryTiles);
+}
+
+uint64_t ProTerGen::VT::NoiseTileCache::HashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+uint64_t ProTerGen::VT::NoiseTileCache::HashLayer(const Layer& layer, const VTDesc* info)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = HashValue(hash, NOISE_TILE_VERSION);
+	hash = HashValue(hash, layer.layerDesc);
+	hash = HashValue(hash, layer.amplitude);
+	hash = HashValue(hash, layer.frecuency);
+	hash = HashValue(hash, layer.gain);
+	hash = HashValue(hash, layer.octaves);
+	hash = HashValue(hash, layer.seed);
+	hash = HashValue(hash, info->VTSize);
+	hash = HashValue(hash, info->VTTilesPerRowExp);
+	hash = HashValue(hash, info->BorderSize);
+	return hash;
+}
+
+uint64_t ProTerGen::VT::NoiseTileCache::HashLayers(const std::vector<Layer>& layers, const VTDesc* info)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = HashValue(hash, layers.size());
+	for (const Layer& layer : layers)
+	{
+		hash = HashValue(hash, HashLayer(layer, info));
+		hash = HashValue(hash, layer.weight);
+	}
+	return hash;
+}
+
+bool ProTerGen::VT::NoiseTileCache::TryGet(const NoiseTileKey& key, size_t count, tile_ptr& tile)
+{
+	sMetricLookups.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lg(mMutex);
+		if (mLru.TryGet(key, tile, true))
+		{
+			sMetricHits.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	if (!LoadSpilled(key, count, tile))
+	{
+		return false;
+	}
+	sMetricHits.fetch_add(1, std::memory_order_relaxed);
+
+	Add(key, tile);
+	return true;
+}
+
+void ProTerGen::VT::NoiseTileCache::Add(const NoiseTileKey& key, const tile_ptr& tile)
+{
+	evicted_t evicted;
+	{
+		std::lock_guard<std::mutex> lg(mMutex);
+		mLru.Add(key, tile);
+		evicted.swap(mEvicted);
+	}
+	Spill(evicted);
+}
+
+void ProTerGen::VT::NoiseTileCache::Flush()
+{
+	evicted_t resident;
+	{
+		std::lock_guard<std::mutex> lg(mMutex);
+		for (const auto& [key, tile] : mLru.Items())
+		{
+			resident.emplace_back(key, tile);
+		}
+	}
+	Spill(resident);
+}
+
+double ProTerGen::VT::NoiseTileCache::MetricGetHitRatio()
+{
+	const uint64_t lookups = sMetricLookups.load();
+	return lookups > 0 ? (double)sMetricHits.load() / (double)lookups : 0.0;
+}
+
+void ProTerGen::VT::NoiseTileCache::MetricResetHitRatio()
+{
+	sMetricHits.store(0);
+	sMetricLookups.store(0);
+}
+
+std::wstring ProTerGen::VT::NoiseTileCache::SpillPath(const NoiseTileKey& key) const
+{
+	wchar_t name[96] = {};
+	swprintf(name, 96, L"%016llx_%u_%u_%u.tile", (unsigned long long)key.LayerHash, key.page.X, key.page.Y, key.page.Mip);
+	return (std::filesystem::path(mSpillDirectory) / name).wstring();
+}
+
+void ProTerGen::VT::NoiseTileCache::Spill(const NoiseTileKey& key, const tile_ptr& tile) const
+{
+	if (mSpillDirectory.empty() || tile == nullptr) return;
+
+	// Same key, same content: a tile spilled before does not need to be written again, it was just used.
+	const std::wstring path = SpillPath(key);
+	std::error_code ec;
+	if (std::filesystem::exists(path, ec))
+	{
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+		return;
+	}
+
+	// Written aside and renamed, so a reader never sees half a tile. The name is per thread, as two threads
+	// can spill the same tile at once.
+	const std::filesystem::path tmpPath = path + L"." + std::to_wstring(std::hash<std::thread::id>{}(std::this_thread::get_id())) + L".tmp";
+	bool written = false;
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file) return;
+
+		const NoiseTileHeader header = { .TexelCount = tile->size() };
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)tile->data(), (std::streamsize)(tile->size() * sizeof(float)));
+		file.close();
+		written = !file.fail();
+	}
+
+	if (written)
+	{
+		std::filesystem::rename(tmpPath, path, ec);
+	}
+	if (!written || ec)
+	{
+		std::filesystem::remove(tmpPath, ec);
+		return;
+	}
+
+	const uint64_t fileBytes = sizeof(NoiseTileHeader) + tile->size() * sizeof(float);
+	if (mMaxSpillBytes > 0 && mSpilledBytes.fetch_add(fileBytes) + fileBytes > mMaxSpillBytes)
+	{
+		TrimSpilled();
+	}
+}
+
+void ProTerGen::VT::NoiseTileCache::Spill(const evicted_t& tiles) const
+{
+	for (const auto& [key, tile] : tiles)
+	{
+		Spill(key, tile);
+	}
+}
+
+bool ProTerGen::VT::NoiseTileCache::LoadSpilled(const NoiseTileKey& key, size_t count, tile_ptr& tile) const
+{
+	if (mSpillDirectory.empty()) return false;
+
+	const std::filesystem::path path = SpillPath(key);
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	NoiseTileHeader header = {};
+	bool valid = file.read((char*)&header, sizeof(header))
+		&& header.Magic == NOISE_TILE_MAGIC
+		&& header.Version == (uint32_t)NOISE_TILE_VERSION
+		&& header.TexelCount == count;
+
+	std::shared_ptr<std::vector<float>> data = nullptr;
+	if (valid)
+	{
+		data = std::make_shared<std::vector<float>>(count);
+		valid = (bool)file.read((char*)data->data(), (std::streamsize)(count * sizeof(float)));
+	}
+
+	if (valid)
+	{
+		tile = data;
+
+		// Read tiles count as recently used, so trimming removes the ones nobody asks for.
+		std::error_code ec;
+		file.close();
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+	}
+	return valid;
+}
+
+void ProTerGen::VT::NoiseTileCache::TrimSpilled() const
+{
+	// One trim at a time; a spill that finds one running leaves it the work.
+	std::unique_lock<std::mutex> lock(mTrimMutex, std::try_to_lock);
+	if (!lock.owns_lock()) return;
+
+	struct SpilledFile
+	{
+		std::filesystem::path Path;
+		uint64_t Size = 0;
+		std::filesystem::file_time_type Time = {};
+	};
+	std::vector<SpilledFile> files;
+	uint64_t totalBytes = 0;
+
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(mSpillDirectory, ec))
+	{
+		std::error_code entryEc;
+		const uint64_t size = entry.file_size(entryEc);
+		const std::filesystem::file_time_type time = entry.last_write_time(entryEc);
+		if (entryEc || entry.path().extension() != L".tile") continue;
+
+		files.push_back({ .Path = entry.path(), .Size = size, .Time = time });
+		totalBytes += size;
+	}
+
+	if (totalBytes > mMaxSpillBytes)
+	{
+		std::sort(files.begin(), files.end(), [](const SpilledFile& a, const SpilledFile& b) { return a.Time < b.Time; });
+		const uint64_t target = (uint64_t)(mMaxSpillBytes * SPILL_TRIM_TARGET);
+		for (size_t i = 0; i < files.size() && totalBytes > target; ++i)
+		{
+			if (std::filesystem::remove(files[i].Path, ec))
+			{
+				totalBytes -= files[i].Size;
+			}
+		}
+	}
+	mSpilledBytes.store(totalBytes);
+}
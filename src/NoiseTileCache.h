@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "VirtualTextureTypes.h"
+#include "TerrainLayer.h"
+#include "LRUCache.h"
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		// A layer contribution to a page: the layer noise parameters (not its weight, which only matters
+		// when blending) plus the page rect.
+		struct NoiseTileKey
+		{
+			uint64_t LayerHash = 0;
+			Page     page      = {};
+
+			inline bool operator==(const NoiseTileKey& rhs) const { return LayerHash == rhs.LayerHash && page == rhs.page; };
+		};
+	}
+}
+
+template<>
+struct std::hash<ProTerGen::VT::NoiseTileKey>
+{
+	size_t operator()(ProTerGen::VT::NoiseTileKey const& key) const noexcept
+	{
+		return (size_t)key.LayerHash ^ (std::hash<ProTerGen::VT::Page>{}(key.page) * 0x9E3779B97F4A7C15ull);
+	}
+};
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		// Content addressed cache of float tiles: unblended layer tiles of TerrainPageGenerator, or whole pages of
+		// PageGpuGen_Sdh keyed by their layer stack. The most recent tiles live in memory; the ones evicted are
+		// written to the spill directory, outside of the lock, and read back on the next miss. The tiles still in
+		// memory are written when the cache is destroyed, so tiles that did not change survive reloads and restarts.
+		// The spill directory is capped in bytes: past the cap, the files least recently written or read are removed.
+		class NoiseTileCache
+		{
+		public:
+			using tile_ptr = std::shared_ptr<const std::vector<float>>;
+
+			~NoiseTileCache();
+
+			// An empty spill directory keeps the cache in memory only. maxSpillBytes 0 leaves the directory uncapped.
+			void Init(size_t memoryTiles, const std::wstring& spillDirectory, uint64_t maxSpillBytes = 0);
+
+			// FNV-1a of size bytes, continued from hash. Keys of tiles that depend on more than the layers fold it in.
+			static uint64_t HashBytes(uint64_t hash, const void* data, size_t size);
+
+			// Hash of everything that changes the noise of a layer, including the page layout of the texture.
+			static uint64_t HashLayer(const Layer& layer, const VTDesc* info);
+			// The same for a blended stack of layers, weights included.
+			static uint64_t HashLayers(const std::vector<Layer>& layers, const VTDesc* info);
+
+			// count: floats in the tile, for the spilled ones.
+			bool TryGet(const NoiseTileKey& key, size_t count, tile_ptr& tile);
+			void Add(const NoiseTileKey& key, const tile_ptr& tile);
+			// Writes the tiles in memory to the spill directory. They stay in memory.
+			void Flush();
+
+			static double MetricGetHitRatio();
+			static void MetricResetHitRatio();
+
+		private:
+			using evicted_t = std::vector<std::pair<NoiseTileKey, tile_ptr>>;
+
+			std::wstring SpillPath(const NoiseTileKey& key) const;
+			void Spill(const NoiseTileKey& key, const tile_ptr& tile) const;
+			void Spill(const evicted_t& tiles) const;
+			bool LoadSpilled(const NoiseTileKey& key, size_t count, tile_ptr& tile) const;
+			// Removes the least recently used spilled tiles until the directory is below the cap.
+			void TrimSpilled() const;
+
+			std::mutex mMutex;
+			LRUCache<NoiseTileKey, tile_ptr> mLru{};
+			evicted_t mEvicted; // Removed from mLru under mMutex, spilled once it is released.
+			size_t mMemoryTiles = 0;
+			std::wstring mSpillDirectory = L"";
+			uint64_t mMaxSpillBytes = 0;
+			mutable std::atomic<uint64_t> mSpilledBytes = 0; // Estimate, recounted by TrimSpilled.
+			mutable std::mutex mTrimMutex;
+
+			static std::atomic<uint64_t> sMetricHits;
+			static std::atomic<uint64_t> sMetricLookups;
+		};
+	}
+}
@@ -1,6 +1,13 @@
 #include "Noiser.h"
 #include "MathHelpers.h"
 
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PROTERGEN_VORONOI_SSE2 1
+#include <emmintrin.h>
+#include "SseMath.h"
+#endif
 
 constexpr double Smoothstep(double edge1, double edge2, double x) noexcept
 {
@@ -8,6 +15,80 @@ constexpr double Smoothstep(double edge1, double edge2, double x) noexcept
 	return x * x * x * (x * (x * 6.0 - 15.0) + 10.0);
 }
 
+namespace
+{
+	// Feature points are jittered towards the positive corner of their cell. With this kernel radius a
+	// 4x4 window, leaning to the side of the cell the sample is in, holds every point in reach.
+	constexpr double  VORONOI_KERNEL_RADIUS = 1.414;
+	constexpr int32_t VORONOI_WINDOW        = 4;
+	// Keeps the weighted mean defined where no feature point is closer than the kernel radius.
+	constexpr double VORONOI_WEIGHT_EPSILON = 1e-6;
+
+	// The eight gradients of 2D Perlin noise.
+	inline float LatticeGrad(uint32_t hash, float x, float y)
+	{
+		switch (hash >> 29)
+		{
+		case 0:  return  x + y;
+		case 1:  return -x + y;
+		case 2:  return  x - y;
+		case 3:  return -x - y;
+		case 4:  return  x;
+		case 5:  return -x;
+		case 6:  return  y;
+		default: return -y;
+		}
+	}
+
+	constexpr float LatticeFade(float t)
+	{
+		return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+	}
+
+	// lowbias32, https://nullprogram.com/blog/2018/07/31/
+	constexpr uint32_t HashU32(uint32_t x) noexcept
+	{
+		x ^= x >> 16;
+		x *= 0x7FEB352Du;
+		x ^= x >> 15;
+		x *= 0x846CA68Bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+#if PROTERGEN_VORONOI_SSE2
+	using ProTerGen::SseMath::Floor4;
+	using ProTerGen::SseMath::Log4;
+	using ProTerGen::SseMath::Exp4;
+
+	inline __m128i Mul32(__m128i a, uint32_t b)
+	{
+		// SSE2 has no 32 bit mullo: multiply even and odd lanes separately and keep the low halves.
+		const __m128i bv   = _mm_set1_epi32((int32_t)b);
+		const __m128i even = _mm_mul_epu32(a, bv);
+		const __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), bv);
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	// HashU32 for four lanes.
+	inline __m128i HashU32_4(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		x = Mul32(x, 0x7FEB352Du);
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+		x = Mul32(x, 0x846CA68Bu);
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		return x;
+	}
+
+	// 16 bits of the hash to [0, 1).
+	inline __m128 Unorm16_4(__m128i bits)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, _mm_set1_epi32(0xFFFF))), _mm_set1_ps(1.0f / 65536.0f));
+	}
+#endif
+}
+
 double ProTerGen::Noiser::FBM(double x, double y, size_t octaves, double frecuency, double gain) const
 {
 	double value = 0.0;
@@ -54,114 +135,291 @@ void ProTerGen::PerlinNoise::Generate(uint32_t seed)
 	std::copy(begin, end, end);
 }
 
-double ProTerGen::PerlinNoise::Noise(double x, double y) const
+double ProTerGen::PerlinNoise::FBM(double x, double y, size_t octaves, double frecuency, double gain) const
 {
-	const double z = 0.314159265;
-	return Noise(x, y, z);
+	return ProTerGen::FBM(*this, x, y, octaves, frecuency, gain);
 }
 
-double ProTerGen::PerlinNoise::Noise(double x, double y, double z) const
+double ProTerGen::PerlinNoise::FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const
 {
-	const size_t px = static_cast<size_t>(std::floor(x)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
-	const size_t py = static_cast<size_t>(std::floor(y)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
-	const size_t pz = static_cast<size_t>(std::floor(z)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
+	return ProTerGen::FBM_turbulence(*this, x, y, octaves, frecuency, gain);
+}
 
-	x -= std::floor(x);
-	y -= std::floor(y);
-	z -= std::floor(z);
+ProTerGen::NoiseCoord2 ProTerGen::NoiseCoord2::FromDouble(double x, double y)
+{
+	const double cx = std::floor(x);
+	const double cy = std::floor(y);
+	return
+	{
+		.CellX = static_cast<int64_t>(cx),
+		.CellY = static_cast<int64_t>(cy),
+		.FracX = static_cast<float>(x - cx),
+		.FracY = static_cast<float>(y - cy),
+	};
+}
 
-	const double u = Fade(x);
-	const double v = Fade(y);
-	const double w = Fade(z);
+void ProTerGen::LatticeNoise::Generate(uint32_t seed)
+{
+	mSeedX = HashU32(seed + 0x68E31DA4u);
+	mSeedY = HashU32(seed + 0xB5297A4Du);
+}
 
-	const size_t A = mPermutation[px] + py;
-	const size_t B = mPermutation[px + 1] + py;
+double ProTerGen::LatticeNoise::Noise(double x, double y) const
+{
+	return Noise(NoiseCoord2::FromDouble(x, y));
+}
 
-	const size_t AA = mPermutation[A] + pz;
-	const size_t AB = mPermutation[A + 1] + pz;
-	const size_t BA = mPermutation[B] + pz;
-	const size_t BB = mPermutation[B + 1] + pz;
+float ProTerGen::LatticeNoise::Noise(const NoiseCoord2& p) const
+{
+	return Lattice(p.FracX, p.FracY,
+		AxisHash(p.CellX, mSeedX), AxisHash(p.CellX + 1, mSeedX),
+		AxisHash(p.CellY, mSeedY), AxisHash(p.CellY + 1, mSeedY));
+}
 
-	const double corner0 = Grad(mPermutation[AA], x, y, z);
-	const double corner1 = Grad(mPermutation[BA], x - 1, y, z);
-	const double corner2 = Grad(mPermutation[AB], x, y - 1, z);
-	const double corner3 = Grad(mPermutation[BB], x - 1, y - 1, z);
+uint32_t ProTerGen::LatticeNoise::Mix(uint32_t x)
+{
+	return HashU32(x);
+}
 
-	const double corner4 = Grad(mPermutation[AA + 1], x, y, z - 1);
-	const double corner5 = Grad(mPermutation[BA + 1], x - 1, y, z - 1);
-	const double corner6 = Grad(mPermutation[AB + 1], x, y - 1, z - 1);
-	const double corner7 = Grad(mPermutation[BB + 1], x - 1, y - 1, z - 1);
+uint32_t ProTerGen::LatticeNoise::AxisHash(int64_t cell, uint32_t axisSeed)
+{
+	return HashU32((uint32_t)cell ^ HashU32((uint32_t)((uint64_t)cell >> 32) ^ axisSeed));
+}
 
-	// Linear interp between x edges
-	const double lerpU12 = Lerp(u, corner0, corner1);
-	const double lerpU23 = Lerp(u, corner2, corner3);
+float ProTerGen::LatticeNoise::Lattice(float fx, float fy, uint32_t hx0, uint32_t hx1, uint32_t hy0, uint32_t hy1)
+{
+	const float u = LatticeFade(fx);
+	const float v = LatticeFade(fy);
 
-	const double lerpU45 = Lerp(u, corner4, corner5);
-	const double lerpU67 = Lerp(u, corner6, corner7);
+	const float corner0 = LatticeGrad(HashU32(hx0 ^ hy0), fx,        fy);
+	const float corner1 = LatticeGrad(HashU32(hx1 ^ hy0), fx - 1.0f, fy);
+	const float corner2 = LatticeGrad(HashU32(hx0 ^ hy1), fx,        fy - 1.0f);
+	const float corner3 = LatticeGrad(HashU32(hx1 ^ hy1), fx - 1.0f, fy - 1.0f);
 
-	// Bilinear interp between xy faces
-	const double lerpV1234 = Lerp(v, lerpU12, lerpU23);
-	const double lerpV4567 = Lerp(v, lerpU45, lerpU67);
+	const float lerpU01 = corner0 + u * (corner1 - corner0);
+	const float lerpU23 = corner2 + u * (corner3 - corner2);
 
-	// Trilinear interp between xyz cube
-	return 0.5 + Lerp(w, lerpV1234, lerpV4567) * 0.5;
+	return 0.5f + (lerpU01 + v * (lerpU23 - lerpU01)) * 0.5f;
 }
 
-constexpr double ProTerGen::PerlinNoise::Fade(double t) const
+double ProTerGen::LatticeNoise::FBM(double x, double y, size_t octaves, double frecuency, double gain) const
 {
-	return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+	return ProTerGen::FBM(*this, x, y, octaves, frecuency, gain);
 }
 
-constexpr double ProTerGen::PerlinNoise::Lerp(double t, double a, double b) const
+double ProTerGen::LatticeNoise::FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const
 {
-	return a + t * (b - a);
+	return ProTerGen::FBM_turbulence(*this, x, y, octaves, frecuency, gain);
 }
 
-constexpr double ProTerGen::PerlinNoise::Grad(size_t hash, double x, double y, double z) const
+void ProTerGen::LatticeNoise::FBMGrid(double originX, double originY, double step, uint32_t countX, uint32_t countY, size_t octaves, double frecuency, double gain, float* values) const
 {
-	const size_t h = hash & 15;
-	const double u = h < 8 ? x : y;
-	const double v = h < 4 ? y : (h == 12 || h == 14) ? x
-		: z;
+	const size_t count = (size_t)countX * countY;
+	std::fill(values, values + count, 0.0f);
 
-	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+	// Each column and row is hashed once per octave; the samples only combine them.
+	std::vector<float> columnFrac(countX);
+	std::vector<uint32_t> columnHash0(countX);
+	std::vector<uint32_t> columnHash1(countX);
+	double amplitude = 1.0;
+	double norm = 0.0;
+	for (size_t o = 0; o < octaves; ++o)
+	{
+		// Only the origin goes through double; every sample is origin cell + float offset.
+		const NoiseCoord2 origin = NoiseCoord2::FromDouble(originX * frecuency, originY * frecuency);
+		const float octaveStep = static_cast<float>(step * frecuency);
+		const float octaveAmplitude = static_cast<float>(amplitude);
+
+		for (uint32_t i = 0; i < countX; ++i)
+		{
+			const float offset = origin.FracX + octaveStep * i;
+			const float cell = std::floor(offset);
+			const int64_t cellX = origin.CellX + static_cast<int64_t>(cell);
+			columnFrac[i] = offset - cell;
+			columnHash0[i] = AxisHash(cellX, mSeedX);
+			columnHash1[i] = AxisHash(cellX + 1, mSeedX);
+		}
+		for (uint32_t j = 0; j < countY; ++j)
+		{
+			const float offset = origin.FracY + octaveStep * j;
+			const float cell = std::floor(offset);
+			const int64_t cellY = origin.CellY + static_cast<int64_t>(cell);
+			const float fracY = offset - cell;
+			const uint32_t hy0 = AxisHash(cellY, mSeedY);
+			const uint32_t hy1 = AxisHash(cellY + 1, mSeedY);
+
+			float* row = values + (size_t)j * countX;
+			for (uint32_t i = 0; i < countX; ++i)
+			{
+				row[i] += octaveAmplitude * Lattice(columnFrac[i], fracY, columnHash0[i], columnHash1[i], hy0, hy1);
+			}
+		}
+
+		frecuency *= 2.0;
+		norm += amplitude;
+		amplitude *= gain;
+	}
+
+	if (norm <= 0.0) return;
+	const float invNorm = static_cast<float>(1.0 / norm);
+	for (size_t k = 0; k < count; ++k)
+	{
+		values[k] *= invNorm;
+	}
 }
 
 void ProTerGen::VoronoiNoise::Generate(uint32_t seed)
 {
-
+	mSeed = HashU32(seed ^ 0x9E3779B9u);
 }
 
-double ProTerGen::VoronoiNoise::Noise(double x, double y) const
+double ProTerGen::VoronoiNoise::FBM(double x, double y, size_t octaves, double frecuency, double gain) const
 {
-	const size_t px = static_cast<size_t>(std::floor(x));
-	const size_t py = static_cast<size_t>(std::floor(y));
+	return ProTerGen::FBM(*this, x, y, octaves, frecuency, gain);
+}
 
-	const double fx = x - px;
-	const double fy = y - py;
+double ProTerGen::VoronoiNoise::FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const
+{
+	return ProTerGen::FBM_turbulence(*this, x, y, octaves, frecuency, gain);
+}
 
-	const double smoothness = 1.0 + 63.0 * pow(1.0 - mSmoothness, 4.0);
+double ProTerGen::VoronoiNoise::Noise(double x, double y) const
+{
+	constexpr double radius2   = VORONOI_KERNEL_RADIUS * VORONOI_KERNEL_RADIUS;
+	constexpr double invRadius = 1.0 / VORONOI_KERNEL_RADIUS;
+
+	const double cx = std::floor(x);
+	const double cy = std::floor(y);
+	const int64_t px = static_cast<int64_t>(cx);
+	const int64_t py = static_cast<int64_t>(cy);
+
+	const double fx = x - cx;
+	const double fy = y - cy;
+	const int32_t startX = fx < 0.5 ? -2 : -1;
+	const int32_t startY = fy < 0.5 ? -2 : -1;
+
+	// Closest offset any point of a cell can have: skips the hash when the whole cell is out of reach.
+	double minX2[VORONOI_WINDOW] = {};
+	for (int32_t i = 0; i < VORONOI_WINDOW; ++i)
+	{
+		const double minX = ProTerGen_clamp(startX + i - fx, startX + i + mRandomness - fx, 0.0);
+		minX2[i] = minX * minX;
+	}
 
 	double va = 0.0;
 	double wt = 0.0;
-	for (int j = -2; j <= 2; ++j)
+	for (int32_t j = startY; j < startY + VORONOI_WINDOW; ++j)
 	{
-		for (int i = -2; i <= 2; ++i)
+		const double minY = ProTerGen_clamp(j - fy, j + mRandomness - fy, 0.0);
+		const double minY2 = minY * minY;
+		if (minY2 >= radius2)
 		{
-			Point p = Hash(px + i, py + j);
-
-			const double dx = (mRandomness * i) - (fx + p.X);
-			const double dy = (mRandomness * j) - (fy + p.Y);
-
-			const double d = sqrt(dx * dx + dy * dy);
-			const double w = pow(1.0 - Smoothstep(0.0, 1.414, d), smoothness);
+			continue;
+		}
 
-			va += w * p.Val;
+		const uint32_t row = RowHash(py + j);
+		for (int32_t i = 0; i < VORONOI_WINDOW; ++i)
+		{
+			if (minX2[i] + minY2 >= radius2)
+			{
+				continue;
+			}
+
+			const uint32_t h0 = CellHash(px + startX + i, row);
+			const double dx = (startX + i + mRandomness * PointX(h0)) - fx;
+			const double dy = (j + mRandomness * PointY(h0)) - fy;
+
+			const double d2 = dx * dx + dy * dy;
+			if (d2 >= radius2)
+			{
+				continue;
+			}
+			// 1 - Smoothstep(0, radius, d), without the clamp: d is inside of the kernel.
+			const double t = std::sqrt(d2) * invRadius;
+			const double s = max(0.0, 1.0 - t * t * t * (t * (t * 6.0 - 15.0) + 10.0));
+			const double w = mWeightExponent == 1.0 ? s : std::pow(s, mWeightExponent);
+
+			va += w * PointValue(h0);
 			wt += w;
 		}
 	}
 
-	return va / wt;
+	return (va + VORONOI_WEIGHT_EPSILON * 0.5) / (wt + VORONOI_WEIGHT_EPSILON);
+}
+
+void ProTerGen::VoronoiNoise::Noise(const float* xs, const float* ys, size_t count, float* values) const
+{
+	size_t k = 0;
+#if PROTERGEN_VORONOI_SSE2
+	const __m128  randomness  = _mm_set1_ps((float)mRandomness);
+	const __m128  exponent    = _mm_set1_ps((float)mWeightExponent);
+	const bool    linear      = mWeightExponent == 1.0;
+	const __m128i seed        = _mm_set1_epi32((int32_t)mSeed);
+	const __m128  one         = _mm_set1_ps(1.0f);
+	const __m128  half        = _mm_set1_ps(0.5f);
+	const __m128  invRadius   = _mm_set1_ps((float)(1.0 / VORONOI_KERNEL_RADIUS));
+	for (; k + 4 <= count; k += 4)
+	{
+		const __m128  x  = _mm_loadu_ps(xs + k);
+		const __m128  y  = _mm_loadu_ps(ys + k);
+		const __m128  cx = Floor4(x);
+		const __m128  cy = Floor4(y);
+		const __m128  fx = _mm_sub_ps(x, cx);
+		const __m128  fy = _mm_sub_ps(y, cy);
+		// Window start per lane: -2, or -1 in the upper half of the cell.
+		const __m128  startX = _mm_add_ps(_mm_set1_ps(-2.0f), _mm_and_ps(_mm_cmpge_ps(fx, half), one));
+		const __m128  startY = _mm_add_ps(_mm_set1_ps(-2.0f), _mm_and_ps(_mm_cmpge_ps(fy, half), one));
+		const __m128i px = _mm_add_epi32(_mm_cvttps_epi32(cx), _mm_cvttps_epi32(startX));
+		const __m128i py = _mm_add_epi32(_mm_cvttps_epi32(cy), _mm_cvttps_epi32(startY));
+
+		__m128 va = _mm_setzero_ps();
+		__m128 wt = _mm_setzero_ps();
+		for (int32_t j = 0; j < VORONOI_WINDOW; ++j)
+		{
+			// RowHash and CellHash of the scalar version, per lane.
+			const __m128i rowHash = HashU32_4(_mm_add_epi32(_mm_add_epi32(py, _mm_set1_epi32(j)), seed));
+			const __m128  oy      = _mm_sub_ps(_mm_add_ps(startY, _mm_set1_ps((float)j)), fy);
+			for (int32_t i = 0; i < VORONOI_WINDOW; ++i)
+			{
+				const __m128i h0 = HashU32_4(_mm_add_epi32(_mm_add_epi32(px, _mm_set1_epi32(i)), rowHash));
+				const __m128  ox = _mm_sub_ps(_mm_add_ps(startX, _mm_set1_ps((float)i)), fx);
+
+				const __m128 dx = _mm_add_ps(ox, _mm_mul_ps(randomness, Unorm16_4(h0)));
+				const __m128 dy = _mm_add_ps(oy, _mm_mul_ps(randomness, Unorm16_4(_mm_srli_epi32(h0, 16))));
+				const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+				// Quintic smoothstep over the kernel; the clamp leaves s = 0 outside of it.
+				const __m128 t = _mm_min_ps(_mm_mul_ps(_mm_sqrt_ps(d2), invRadius), one);
+				const __m128 q = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t),
+					_mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)));
+				const __m128 s      = _mm_max_ps(_mm_sub_ps(one, q), _mm_setzero_ps());
+				const __m128 inside = _mm_cmpgt_ps(s, _mm_setzero_ps());
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				__m128 w = s;
+				if (!linear)
+				{
+					w = _mm_and_ps(inside, Exp4(_mm_mul_ps(exponent, Log4(_mm_max_ps(s, _mm_set1_ps(1e-30f))))));
+				}
+
+				// PointValue: 24 bits of a second round.
+				const __m128i h1  = HashU32_4(h0);
+				const __m128  val = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h1, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+				va = _mm_add_ps(va, _mm_mul_ps(w, val));
+				wt = _mm_add_ps(wt, w);
+			}
+		}
+		const __m128 epsilon = _mm_set1_ps((float)VORONOI_WEIGHT_EPSILON);
+		_mm_storeu_ps(values + k, _mm_div_ps(_mm_add_ps(va, _mm_mul_ps(epsilon, half)), _mm_add_ps(wt, epsilon)));
+	}
+#endif
+	for (; k < count; ++k)
+	{
+		values[k] = (float)Noise((double)xs[k], (double)ys[k]);
+	}
 }
 
 void ProTerGen::VoronoiNoise::SetRandomness(double randomness)
@@ -172,17 +430,30 @@ void ProTerGen::VoronoiNoise::SetRandomness(double randomness)
 void ProTerGen::VoronoiNoise::SetSmoothness(double smoothness)
 {
 	mSmoothness = ProTerGen_clamp(0.0, 1.0, smoothness);
+	mWeightExponent = 1.0 + 63.0 * std::pow(1.0 - mSmoothness, 4.0);
 }
 
-ProTerGen::VoronoiNoise::Point ProTerGen::VoronoiNoise::Hash(double x, double y) const
+uint32_t ProTerGen::VoronoiNoise::RowHash(int64_t cy) const
 {
-	double _d = 0.0;
-	Point p
-	{
-		.X = std::abs(modf(651651.15351 + 165.2354 * sin(sqrt(((x - 123.25895) * (x - 123.25895)) + ((y - 83.1516584) * (y - 83.1516584)))), &_d)),
-		.Y = std::abs(modf(12132.36 + 5168.12 * cos(sqrt(((x - 748.2156) * (x - 748.2156)) + ((y - 7.2665156) * (y - 7.2665156)))), &_d)),
-		.Val = std::abs(modf(150231.2518 + 153.1568 * sin(sqrt(((x - 30.232354) * (x - 30.232354)) + ((y - 8.656984654) * (y - 8.656984654)))), &_d)),
-	};
+	return HashU32((uint32_t)cy + mSeed);
+}
+
+uint32_t ProTerGen::VoronoiNoise::CellHash(int64_t cx, uint32_t rowHash)
+{
+	return HashU32((uint32_t)cx + rowHash);
+}
 
-	return p;
+double ProTerGen::VoronoiNoise::PointX(uint32_t hash)
+{
+	return (double)(hash & 0xFFFFu) * (1.0 / 65536.0);
+}
+
+double ProTerGen::VoronoiNoise::PointY(uint32_t hash)
+{
+	return (double)(hash >> 16) * (1.0 / 65536.0);
+}
+
+double ProTerGen::VoronoiNoise::PointValue(uint32_t hash)
+{
+	return (double)(HashU32(hash) >> 8) * (1.0 / 16777216.0);
 }
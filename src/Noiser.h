@@ -4,6 +4,9 @@
 #include <numeric>
 #include <random>
 #include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdint>
 
 namespace ProTerGen
 {
@@ -32,6 +35,14 @@ namespace ProTerGen
 		double Noise(double x, double y) const override;
 		double Noise(double x, double y, double z) const;
 
+		double FBM(double x, double y, size_t octaves, double frecuency, double gain) const override;
+		double FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const override;
+
+		inline const std::array<uint32_t, 512>& GetPermutation() const { return mPermutation; }
+
+		// Constant z slice used by the 2D noise.
+		static constexpr double NOISE_2D_Z = 0.314159265;
+
 	protected:
 		constexpr double Fade(double t) const;
 		constexpr double Lerp(double t, double a, double b) const;
@@ -49,20 +60,236 @@ namespace ProTerGen
 
 		void Generate(uint32_t seed = 0) override;
 		double Noise(double x, double y) const override;
+		// Many points at once in float32, four at a time with SSE2. The weights use a polynomial pow,
+		// so values differ from the scalar version by up to ~6e-6. Pages use LayerNoise::FBMTerrainVoronoi instead.
+		void Noise(const float* xs, const float* ys, size_t count, float* values) const;
+
+		double FBM(double x, double y, size_t octaves, double frecuency, double gain) const override;
+		double FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const override;
 
+		// Jitter of the feature points within their cell, as u in voronoise. It used to scale the cell grid
+		// instead, which packed more points in the kernel below 1 and broke at cell borders. At the default of 1
+		// both agree: values have a mean of 0.50 and a deviation of 0.17.
 		void SetRandomness(double randomness);
 		void SetSmoothness(double smoothness);
 	private:
-		struct Point
-		{
-			double X = 0.0;
-			double Y = 0.0;
-			double Val = 0.0;
-		};
+		// Integer hash of the cell and the seed, no trigonometry involved: the row first, shared by its cells.
+		// 16 bits per coordinate of the feature point, and 24 bits of a second round for its value.
+		uint32_t RowHash(int64_t cy) const;
+		static uint32_t CellHash(int64_t cx, uint32_t rowHash);
+		static double PointX(uint32_t hash);
+		static double PointY(uint32_t hash);
+		static double PointValue(uint32_t hash);
+
+		uint32_t mSeed       = 0;
+		double   mRandomness = 1.0;
+		double   mSmoothness = 1.0;
+		// 1 + 63 * (1 - smoothness)^4, the exponent applied to the cell weights.
+		double   mWeightExponent = 1.0;
+	};
 
-		Point Hash(double x, double y) const;
+	// A noise domain position split into its lattice cell and the offset inside it. Far from the origin
+	// the offset keeps full float precision, where a float position, or a double masked to a period, does not.
+	struct NoiseCoord2
+	{
+		int64_t CellX = 0;
+		int64_t CellY = 0;
+		float   FracX = 0.0f;
+		float   FracY = 0.0f;
 
-		double mRandomness = 1.0;
-		double mSmoothness = 1.0;
+		static NoiseCoord2 FromDouble(double x, double y);
 	};
+
+	// Gradient noise over a hashed lattice: the gradients come from a hash of the 64 bit cell and the seed
+	// instead of a permutation table, so the noise never repeats. Same [0, 1] range as PerlinNoise.
+	// The cell hash is split per axis: a row or column of a grid is hashed once, and each sample combines
+	// both with a single 32 bit mix. Batched evaluators (NoiseBatch) use the same functions.
+	class LatticeNoise : public Noiser
+	{
+	public:
+		LatticeNoise() = default;
+		virtual ~LatticeNoise() = default;
+
+		void Generate(uint32_t seed = 0) override;
+		double Noise(double x, double y) const override;
+		float Noise(const NoiseCoord2& p) const;
+
+		double FBM(double x, double y, size_t octaves, double frecuency, double gain) const override;
+		double FBM_turbulence(double x, double y, size_t octaves, double frecuency, double gain) const override;
+
+		// FBM of a countX * countY grid with its first sample at origin. The origin is split once per octave
+		// and the samples only add small float offsets to it, so the per sample work stays in float.
+		void FBMGrid(double originX, double originY, double step, uint32_t countX, uint32_t countY, size_t octaves, double frecuency, double gain, float* values) const;
+
+		// lowbias32, https://nullprogram.com/blog/2018/07/31/
+		static uint32_t Mix(uint32_t x);
+		// Both halves of the cell are hashed, so cells 2^32 apart differ too.
+		static uint32_t AxisHash(int64_t cell, uint32_t axisSeed);
+		// The noise of a cell from the axis hashes of its corners (x0, x1, y0, y1) and the offset inside it.
+		static float Lattice(float fx, float fy, uint32_t hx0, uint32_t hx1, uint32_t hy0, uint32_t hy1);
+
+		inline uint32_t GetSeedX() const { return mSeedX; }
+		inline uint32_t GetSeedY() const { return mSeedY; }
+	private:
+		uint32_t mSeedX = 0;
+		uint32_t mSeedY = 0;
+	};
+
+#pragma region PerlinNoise inline
+	// Defined in the header so the FBM specializations below can inline the basis function.
+	inline double PerlinNoise::Noise(double x, double y) const
+	{
+		return Noise(x, y, NOISE_2D_Z);
+	}
+
+	inline double PerlinNoise::Noise(double x, double y, double z) const
+	{
+		const size_t px = static_cast<size_t>(std::floor(x)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
+		const size_t py = static_cast<size_t>(std::floor(y)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
+		const size_t pz = static_cast<size_t>(std::floor(z)) & (static_cast<size_t>(mPermutation.size() * 0.5) - 1);
+
+		x -= std::floor(x);
+		y -= std::floor(y);
+		z -= std::floor(z);
+
+		const double u = Fade(x);
+		const double v = Fade(y);
+		const double w = Fade(z);
+
+		const size_t A = mPermutation[px] + py;
+		const size_t B = mPermutation[px + 1] + py;
+
+		const size_t AA = mPermutation[A] + pz;
+		const size_t AB = mPermutation[A + 1] + pz;
+		const size_t BA = mPermutation[B] + pz;
+		const size_t BB = mPermutation[B + 1] + pz;
+
+		const double corner0 = Grad(mPermutation[AA], x, y, z);
+		const double corner1 = Grad(mPermutation[BA], x - 1, y, z);
+		const double corner2 = Grad(mPermutation[AB], x, y - 1, z);
+		const double corner3 = Grad(mPermutation[BB], x - 1, y - 1, z);
+
+		const double corner4 = Grad(mPermutation[AA + 1], x, y, z - 1);
+		const double corner5 = Grad(mPermutation[BA + 1], x - 1, y, z - 1);
+		const double corner6 = Grad(mPermutation[AB + 1], x, y - 1, z - 1);
+		const double corner7 = Grad(mPermutation[BB + 1], x - 1, y - 1, z - 1);
+
+		// Linear interp between x edges
+		const double lerpU12 = Lerp(u, corner0, corner1);
+		const double lerpU23 = Lerp(u, corner2, corner3);
+
+		const double lerpU45 = Lerp(u, corner4, corner5);
+		const double lerpU67 = Lerp(u, corner6, corner7);
+
+		// Bilinear interp between xy faces
+		const double lerpV1234 = Lerp(v, lerpU12, lerpU23);
+		const double lerpV4567 = Lerp(v, lerpU45, lerpU67);
+
+		// Trilinear interp between xyz cube
+		return 0.5 + Lerp(w, lerpV1234, lerpV4567) * 0.5;
+	}
+
+	constexpr double PerlinNoise::Fade(double t) const
+	{
+		return t * t * t * (t * (t * 6.0 - 15.0) + 10.0);
+	}
+
+	constexpr double PerlinNoise::Lerp(double t, double a, double b) const
+	{
+		return a + t * (b - a);
+	}
+
+	constexpr double PerlinNoise::Grad(size_t hash, double x, double y, double z) const
+	{
+		const size_t h = hash & 15;
+		const double u = h < 8 ? x : y;
+		const double v = h < 4 ? y : (h == 12 || h == 14) ? x
+			: z;
+
+		return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+	}
+#pragma endregion
+
+#pragma region FBM specializations
+	// Highest octave count with an unrolled specialization; matches the octave range exposed for layers.
+	static constexpr uint32_t MAX_UNROLLED_FBM_OCTAVES = 10;
+
+	template<size_t Octaves>
+	constexpr std::array<double, Octaves> FBMAmplitudes(double gain)
+	{
+		std::array<double, Octaves> amplitudes{};
+		double amplitude = 1.0;
+		for (size_t i = 0; i < Octaves; ++i)
+		{
+			amplitudes[i] = amplitude;
+			amplitude *= gain;
+		}
+		return amplitudes;
+	}
+
+	template<size_t Octaves>
+	constexpr double FBMNorm(double gain, double start = 0.0)
+	{
+		double norm = start;
+		for (double amplitude : FBMAmplitudes<Octaves>(gain))
+		{
+			norm += amplitude;
+		}
+		return norm;
+	}
+
+	// Same sums, in the same order, as Noiser::FBM and Noiser::FBM_turbulence, with the octave loop unrolled and the
+	// basis function called non virtually. Amplitudes and norm are folded at compile time for constant gains.
+	template<typename N, size_t Octaves>
+	double FBM(const N& noise, double x, double y, double frecuency, double gain)
+	{
+		static_assert(Octaves > 0, "FBM needs at least one octave");
+		const std::array<double, Octaves> amplitudes = FBMAmplitudes<Octaves>(gain);
+		const double value = [&]<size_t... I>(std::index_sequence<I...>)
+		{
+			return (... + (amplitudes[I] * noise.N::Noise((frecuency * (double)(1ull << I)) * x, (frecuency * (double)(1ull << I)) * y)));
+		}(std::make_index_sequence<Octaves>{});
+		return value / FBMNorm<Octaves>(gain);
+	}
+
+	template<typename N, size_t Octaves>
+	double FBM_turbulence(const N& noise, double x, double y, double frecuency, double gain)
+	{
+		static_assert(Octaves > 0, "FBM needs at least one octave");
+		const std::array<double, Octaves> amplitudes = FBMAmplitudes<Octaves>(gain);
+		const auto ridge = [](double n) { n = 1 - 2 * std::abs(0.5 - n); return n * n; };
+		const double value = [&]<size_t... I>(std::index_sequence<I...>)
+		{
+			return (... + (amplitudes[I] * ridge(noise.N::Noise((frecuency * (double)(1ull << I)) * x, (frecuency * (double)(1ull << I)) * y))));
+		}(std::make_index_sequence<Octaves>{});
+		return value / FBMNorm<Octaves>(gain, 1.0);
+	}
+
+	// Picks the specialization matching a runtime octave count; counts above MAX_UNROLLED_FBM_OCTAVES use the generic loop.
+	template<typename N>
+	double FBM(const N& noise, double x, double y, size_t octaves, double frecuency, double gain)
+	{
+		using Fn = double(*)(const N&, double, double, double, double);
+		static constexpr auto table = []<size_t... I>(std::index_sequence<I...>)
+		{
+			return std::array<Fn, sizeof...(I)>{ &FBM<N, I + 1>... };
+		}(std::make_index_sequence<MAX_UNROLLED_FBM_OCTAVES>{});
+
+		if (octaves == 0 || octaves > MAX_UNROLLED_FBM_OCTAVES) return noise.Noiser::FBM(x, y, octaves, frecuency, gain);
+		return table[octaves - 1](noise, x, y, frecuency, gain);
+	}
+
+	template<typename N>
+	double FBM_turbulence(const N& noise, double x, double y, size_t octaves, double frecuency, double gain)
+	{
+		using Fn = double(*)(const N&, double, double, double, double);
+		static constexpr auto table = []<size_t... I>(std::index_sequence<I...>)
+		{
+			return std::array<Fn, sizeof...(I)>{ &FBM_turbulence<N, I + 1>... };
+		}(std::make_index_sequence<MAX_UNROLLED_FBM_OCTAVES>{});
+
+		if (octaves == 0 || octaves > MAX_UNROLLED_FBM_OCTAVES) return noise.Noiser::FBM_turbulence(x, y, octaves, frecuency, gain);
+		return table[octaves - 1](noise, x, y, frecuency, gain);
+	}
+#pragma endregion
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include <array>
+
+#include "PageLoaderCpuGen.h"
+#include "Config.h"
+
+namespace
+{
+	// Page buffers allocated up front.
+	constexpr size_t PAGE_BUFFERS_PREALLOCATED = 16;
+}
+
+ProTerGen::VT::PageCpuGen_Sdh::~PageCpuGen_Sdh()
+{
+	Dispose();
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Init
+(
+	PageIndexer* indexer,
+	const VTDesc* info,
+	std::unique_ptr<ComputeContext> computeContext,
+	uint32_t tilesPerDispatch
+)
+{
+	mIndexer = indexer;
+	mInfo = info;
+	mGenerator.Init(mInfo, gCachePath + L"NoiseTiles\\");
+
+	const uint32_t size = mInfo->BorderedTileSize();
+	const size_t alignedRowPitch = Align((size_t)size * TEXTURES_BYTES_PER_TEXEL()[GenerationTextures::NORMAL_HEIGHTMAP], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+	mPageBuffers.Init(alignedRowPitch * size, PAGE_BUFFERS_PREALLOCATED);
+	// A page is queued once until it loads, so the queues never hold more than every page.
+	mPageThread.MaxQueueSize(mIndexer->GetCount());
+	mPageThread.OnRun([&](MultiPage& readState) { return LoadPage(readState); });
+	mPageThread.OnComplete([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& rs) { OnProcessingComplete(commandList, rs); });
+	mPageThread.Init();
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Dispose()
+{
+	mPageThread.Dispose();
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Update(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t updateCount)
+{
+	mPageThread.Update(commandList, updateCount);
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Reload()
+{
+	Restart();
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Submit(const Page& request)
+{
+	MultiPage state = {};
+	state.page = request;
+
+	mPageThread.Enqueue(state);
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Clear()
+{
+	// The pages queued or done were requested by a cache that is cleared next; the thread keeps running.
+	mPageThread.Clear();
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::Restart()
+{
+	if (!mPageThread.IsRunning())
+	{
+		mPageThread.Init();
+	}
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::SetLayers(const std::vector<Layer>& layers)
+{
+	mGenerator.SetLayers(layers);
+}
+
+bool ProTerGen::VT::PageCpuGen_Sdh::LoadPage(MultiPage& readState)
+{
+	const size_t index = (size_t)GenerationTextures::NORMAL_HEIGHTMAP;
+	const size_t alignedRowPitch = Align((size_t)mInfo->BorderedTileSize() * TEXTURES_BYTES_PER_TEXEL()[index], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+	readState.dataPtrs[index] = AcquirePageBuffer((uint32_t)index, mPageBuffers);
+	mGenerator.GeneratePage(readState.page, readState.dataPtrs[index].Data(), alignedRowPitch);
+
+	if (mShowBordersEnabled)
+	{
+		ColorBorders
+		(
+			readState.dataPtrs[index].Data(),
+			std::array<float, TEXTURES_BYTES_PER_TEXEL()[index] / sizeof(float)>{ 0.0f, 1.0f, 0.0f, 1.0f },
+			mInfo->TileSize(),
+			mInfo->BorderSize,
+			alignedRowPitch / sizeof(float)
+		);
+	}
+	return true;
+}
+
+void ProTerGen::VT::PageCpuGen_Sdh::OnProcessingComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& page)
+{
+	mOnLoadComplete(commandList, page);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "PageLoaderGpuGen.h"
+#include "TerrainPageGenerator.h"
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		class PageCpuGen_Sdh;
+		template<>
+		struct GpuPageGenerator<PageCpuGen_Sdh>::GenerationTextures
+		{
+			static const uint32_t NORMAL_HEIGHTMAP = 0;
+			static const uint32_t COUNT = NORMAL_HEIGHTMAP + 1;
+		};
+
+		// Same pages as PageGpuGen_Sdh, computed on the CPU by a TerrainPageGenerator, so no compute queue or
+		// readback is needed. Selected with gCpuTerrainPages. The compute context passed to Init is not used and can be null.
+		class PageCpuGen_Sdh : public GpuPageGenerator<PageCpuGen_Sdh>
+		{
+		public:
+			static constexpr uint32_t _TEXTURES_COUNT() { return GenerationTextures::COUNT; }
+			static constexpr const std::array<DXGI_FORMAT, GenerationTextures::COUNT> _TEXTURES_FORMAT()
+			{
+				return { DXGI_FORMAT_R32G32B32A32_FLOAT };
+			};
+			static constexpr const std::array<uint32_t, GenerationTextures::COUNT> _TEXTURES_BYTES_PER_TEXEL()
+			{
+				return { 16 };
+			}
+
+		public:
+			virtual ~PageCpuGen_Sdh();
+
+			void Init
+			(
+				PageIndexer* indexer,
+				const VTDesc* info,
+				std::unique_ptr<ComputeContext> computeContext,
+				uint32_t tilesPerDispatch
+			);
+			void Dispose();
+			void Update(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t updateCount);
+			void Reload();
+			void Submit(const Page& request);
+			void Clear();
+			void Restart();
+
+			void SetLayers(const std::vector<Layer>& layers);
+
+			inline void OnLoadComplete(load_complete_f newFunc) { mOnLoadComplete = newFunc; }
+
+			inline bool IsShowBordersEnabled() const { return mShowBordersEnabled; }
+			inline void EnableShowBorders(bool value) { mShowBordersEnabled = value; }
+
+		protected:
+			bool LoadPage(MultiPage& readState);
+			void OnProcessingComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& page);
+
+		private:
+			bool mShowBordersEnabled = false;
+
+			const PageIndexer* mIndexer = nullptr;
+			const VTDesc* mInfo = nullptr;
+
+			TerrainPageGenerator mGenerator;
+
+			PageBufferPool mPageBuffers; // Outlives the pages queued in mPageThread.
+			PageThread<MultiPage> mPageThread;
+
+			load_complete_f mOnLoadComplete
+				= [](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const MultiPage&) {};
+		};
+	}
+}
@@ -1,179 +1,675 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
 #include "PageLoaderFromDisk.h"
+#include "TileCompression.h"
 
-ProTerGen::VT::TileDataFile::~TileDataFile()
+namespace
 {
-	Close();
-}
+	// Widens or narrows texels; extra channels are filled with 255. Walking forwards, this can run in
+	// place when widening if src sits at the end of dst.
+	inline void ConvertTexels(const uint8_t* src, uint8_t* dst, size_t texelCount, uint32_t srcFormatSize, uint32_t dstFormatSize)
+	{
+		for (size_t i = 0; i < texelCount; ++i)
+		{
+			const uint8_t* s = src + i * srcFormatSize;
+			uint8_t* d = dst + i * dstFormatSize;
+			for (uint32_t c = 0; c < dstFormatSize; ++c)
+			{
+				d[c] = c < srcFormatSize ? s[c] : 255;
+			}
+		}
+	}
 
-void ProTerGen::VT::TileDataFile::Open(const std::wstring& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode)
-{
-	mMode = accessMode;
-	mInfo = info;
-	mFormatSize = formatSize;
+	inline int64_t NowNanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
-	std::wstring mode = L"rb";
-	if ((mMode & WRITE) == WRITE)
+	// Hash of stored page bytes, to find pages written before with the same content.
+	inline uint64_t HashContent(const uint8_t* data, size_t size)
 	{
-		if ((mMode & READ) == READ)
+		uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
 		{
-			mode = L"wb+";
+			uint64_t word;
+			memcpy(&word, data + i, sizeof(word));
+			hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 32;
 		}
-		else
+		for (; i < size; ++i)
 		{
-			mode = L"wb";
+			hash = (hash ^ data[i]) * 0x100000001B3ull;
 		}
+		return hash ^ (hash >> 29);
 	}
 
-	mFile = _wfopen(filename.c_str(), mode.c_str());
-	if (!mFile) perror("fopen");
+	// A writer checkpoints the file after this many pages or this much time since the last checkpoint.
+	constexpr uint32_t CHECKPOINT_PAGES       = 4096;
+	constexpr int64_t  CHECKPOINT_NANOSECONDS = 5'000'000'000;
 
-	assert(mFile);
+	// Decoded shared pages kept by the loader.
+	constexpr size_t SHARED_PAGES_CACHED = 64;
+
+	// Completions reaped and decompressed together.
+	constexpr uint32_t ASYNC_BATCH_SIZE = 64;
+
+	// Latencies kept for the percentiles, the most recent ones.
+	constexpr size_t METRIC_LATENCY_SAMPLES = 4096;
 }
 
-void ProTerGen::VT::TileDataFile::Open(const std::string& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode)
+std::atomic<uint64_t> ProTerGen::VT::PageLoaderFromDisk::sMetricPagesLoaded = 0;
+std::atomic<uint64_t> ProTerGen::VT::PageLoaderFromDisk::sMetricSharedPageHits = 0;
+std::atomic<int64_t> ProTerGen::VT::PageLoaderFromDisk::sMetricWindowStartNanoseconds = 0;
+std::mutex ProTerGen::VT::PageLoaderFromDisk::sMetricLatencyMutex;
+std::vector<float> ProTerGen::VT::PageLoaderFromDisk::sMetricLatenciesMs;
+size_t ProTerGen::VT::PageLoaderFromDisk::sMetricNextLatency = 0;
+
+ProTerGen::VT::TileDataFile::~TileDataFile()
+{
+	Close();
+}
+
+bool ProTerGen::VT::TileDataFile::IsComplete(const std::wstring& filename, char completeChar)
+{
+	bool completed = false;
+	if (FILE* f = _wfopen(filename.c_str(), L"rb"))
+	{
+		char mark = 0;
+		TileFileHeader header = {};
+		completed = fread(&mark, 1, 1, f) == 1 && mark == completeChar
+			&& fread(&header, sizeof(header), 1, f) == 1
+			&& header.Magic == FILE_MAGIC && header.Version == FILE_VERSION;
+		fclose(f);
+	}
+	return completed;
+}
+
+bool ProTerGen::VT::TileDataFile::IsComplete(const std::string& filename, char completeChar)
+{
+	return IsComplete(std::filesystem::path(filename).wstring(), completeChar);
+}
+
+void ProTerGen::VT::TileDataFile::Open(const std::wstring& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode)
 {
 	mMode = accessMode;
 	mInfo = info;
 	mFormatSize = formatSize;
 
-	std::string mode = "rb";
+	DWORD access = GENERIC_READ;
+	DWORD disposition = OPEN_EXISTING;
 	if ((mMode & WRITE) == WRITE)
 	{
-		if ((mMode & READ) == READ)
-		{
-			mode = "wb+";
-		}
-		else
-		{
-			mode = "wb";
-		}
+		access = ((mMode & READ) == READ) ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_WRITE;
+		disposition = ((mMode & RESUME) == RESUME) ? OPEN_ALWAYS : CREATE_ALWAYS;
 	}
 
-	mFile = fopen(filename.c_str(), mode.c_str());
-	if (!mFile) perror("fopen");
+	const DWORD flags = ((mMode & ASYNC) == ASYNC) ? (FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED) : FILE_ATTRIBUTE_NORMAL;
+	mFile = CreateFileW(filename.c_str(), access, FILE_SHARE_READ, nullptr, disposition, flags, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+	{
+		mFile = nullptr;
+		perror("CreateFile");
+	}
 
 	assert(mFile);
+
+	mPagesSinceCheckpoint.store(0);
+	mLastCheckpointNanoseconds.store(NowNanoseconds());
+	if (mFile && ((mMode & WRITE) == WRITE))
+	{
+		if (((mMode & RESUME) == RESUME) && ResumeIndex())
+		{
+			return;
+		}
+
+		// A new file: an empty index and bitmap, the pages go after them. Whatever was there before is dropped.
+		LARGE_INTEGER zero = {};
+		if (!SetFilePointerEx(mFile, zero, nullptr, FILE_BEGIN) || !SetEndOfFile(mFile)) perror("SetEndOfFile");
+		mIndex.assign(PageCount(), TilePageEntry{});
+		mWrittenContent.clear();
+		mSharedOffsets.clear();
+		mCompletePages = std::vector<std::atomic<uint64_t>>((mIndex.size() + 63) >> 6);
+		mDataEnd.store(DataOffset());
+		if (!WriteIndex(mIndex, std::vector<uint64_t>(mCompletePages.size(), 0))) perror("WriteFile");
+	}
+	else if (mFile && !ReadIndex())
+	{
+		printf("The tile file is not a version %u tile file of this texture, generate it again.\n", FILE_VERSION);
+		mIndex.clear();
+	}
+}
+
+void ProTerGen::VT::TileDataFile::Open(const std::string& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode)
+{
+	Open(std::filesystem::path(filename).wstring(), info, formatSize, accessMode);
 }
 
 void ProTerGen::VT::TileDataFile::Close()
 {
+	Unmap();
 	if (mFile)
 	{
-		fclose(mFile);
+		if ((mMode & WRITE) == WRITE) Checkpoint();
+		CloseHandle(mFile);
 		mFile = nullptr;
 	}
+	mIndex.clear();
+	mCompletePages.clear();
+	mWrittenContent.clear();
+	mSharedOffsets.clear();
+	mDeduplicatedPages.store(0);
 }
 
 void ProTerGen::VT::TileDataFile::WritePage(PageIndex index, const data_ptr data)
 {
-	if (mFile && ((mMode & WRITE) == WRITE))
+	if (mFile && ((mMode & WRITE) == WRITE) && index < mIndex.size())
 	{
-		const size_t pageTotalSize = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFormatSize;
-		if (_fseeki64(mFile, index * pageTotalSize + 1, SEEK_SET) != 0) perror("fseek");
-		assert(fwrite(data, 1, pageTotalSize, mFile) == pageTotalSize);
-		fflush(mFile);
+		const size_t pageTotalSize = PageTotalSize();
+		thread_local std::vector<uint8_t> filtered;
+		thread_local std::vector<uint8_t> compressed;
+		filtered.assign((const uint8_t*)data, (const uint8_t*)data + pageTotalSize);
+		TileCompression::DeltaEncode(filtered.data(), pageTotalSize, mFormatSize);
+		compressed.resize(TileCompression::CompressBound(pageTotalSize));
+		const size_t compressedSize = TileCompression::Compress(filtered.data(), pageTotalSize, compressed.data(), compressed.size());
+
+		// Pages that don't get smaller are kept raw, so no page takes more than PageTotalSize.
+		TilePageEntry entry = {};
+		const void* bytes = data;
+		if (compressedSize > 0 && compressedSize < pageTotalSize)
+		{
+			entry.Encoding = TilePageEncoding::DELTA_LZ;
+			entry.Size = (uint32_t)compressedSize;
+			bytes = compressed.data();
+		}
+		else
+		{
+			entry.Encoding = TilePageEncoding::RAW;
+			entry.Size = (uint32_t)pageTotalSize;
+		}
+
+		// Same encoder, same bytes: equal pages are found by the hash of what would be stored, and compared
+		// with the stored copy before sharing it.
+		const uint64_t contentHash = HashContent((const uint8_t*)bytes, entry.Size);
+
+		// The first writer of some content claims it and its space in one step, so two writers of the same
+		// page never both store it. Space is reserved atomically and written outside of the lock.
+		TilePageEntry existing = {};
+		bool claimed = false;
+		{
+			std::lock_guard<std::mutex> lg(mWrittenContentMutex);
+			auto it = mWrittenContent.find(contentHash);
+			if (it != mWrittenContent.end())
+			{
+				existing = it->second;
+			}
+			else
+			{
+				entry.Offset = mDataEnd.fetch_add(entry.Size);
+				mWrittenContent.emplace(contentHash, entry);
+				claimed = true;
+			}
+		}
+
+		if (!claimed)
+		{
+			thread_local std::vector<uint8_t> stored;
+			stored.resize(existing.Size);
+			if (existing.Size == entry.Size && existing.Encoding == entry.Encoding
+				&& ReadAt(existing.Offset, stored.data(), existing.Size) && memcmp(stored.data(), bytes, existing.Size) == 0)
+			{
+				mIndex[index] = existing;
+				mDeduplicatedPages.fetch_add(1);
+				MarkComplete(index);
+				return;
+			}
+
+			// A hash collision, or the claiming writer has not finished yet: this page gets its own copy.
+			entry.Offset = mDataEnd.fetch_add(entry.Size);
+		}
+
+		const bool written = WriteAt(entry.Offset, bytes, entry.Size);
+		assert(written);
+		mIndex[index] = entry;
+		MarkComplete(index);
 	}
 }
 
 void ProTerGen::VT::TileDataFile::WriteCharOnBeginning(char c)
 {
-	if (_fseeki64(mFile, 0, SEEK_SET) != 0) perror("fseek");
-	putc(c, mFile);
+	if ((mMode & WRITE) == WRITE) Checkpoint();
+	if (!WriteAt(0, &c, 1) || !FlushFileBuffers(mFile)) perror("WriteFile");
+}
+
+void ProTerGen::VT::TileDataFile::Checkpoint()
+{
+	if (mFile && ((mMode & WRITE) == WRITE))
+	{
+		std::lock_guard<std::mutex> lg(mCheckpointMutex);
+		WriteCheckpoint();
+	}
+}
+
+size_t ProTerGen::VT::TileDataFile::CompletePages() const
+{
+	size_t count = 0;
+	for (const std::atomic<uint64_t>& word : mCompletePages)
+	{
+		count += std::popcount(word.load(std::memory_order_acquire));
+	}
+	return count;
 }
 
 bool ProTerGen::VT::TileDataFile::ReadPage(PageIndex index, data_ptr data, uint32_t formatSize) const
 {
 	if (mFile && ((mMode & READ) == READ))
 	{
-		const size_t pageTotalSize = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFormatSize;
-		if (formatSize == 0) formatSize = mFormatSize;
-		if (formatSize != mFormatSize)
+		const TilePageEntry* entry = Entry(index);
+		if (!entry) return false;
+
+		if (IsMapped())
 		{
-			void* __data = malloc(pageTotalSize);
-			if (!__data) return false;
-			if (_fseeki64(mFile, index * pageTotalSize + 1, SEEK_SET) != 0)
-			{
-				perror("fseek");
-				free(__data);
-				return false;
-			}
-			const size_t elementsCopied = fread_s(__data, pageTotalSize, 1, pageTotalSize, mFile);
-			if (elementsCopied != pageTotalSize)
-			{
-				free(__data);
-				return false;
-			}
-			for (size_t i = 0, j = 0; i < pageTotalSize; i += mFormatSize, j += formatSize)
-			{
-				for (size_t ii = 0; ii < formatSize; ++ii)
-				{
-					((uint8_t*)data)[j + ii] = ii <= mFormatSize ? ((uint8_t*)__data)[i + ii] : 255;
-				}
-			}
+			const uint8_t* stored = PageView(index);
+			return stored && DecodePage(index, stored, data, formatSize);
+		}
 
-			free(__data);
+		thread_local std::vector<uint8_t> stored;
+		stored.resize(entry->Size);
+		return ReadAt(entry->Offset, stored.data(), entry->Size) && DecodePage(index, stored.data(), data, formatSize);
+	}
 
-			return true;
-		}
-		else
+
+	return false;
+}
+
+bool ProTerGen::VT::TileDataFile::ReadTile(PageIndex index, data_ptr data) const
+{
+	thread_local std::vector<uint8_t> page;
+	page.resize(PageTotalSize());
+	if (!ReadPage(index, page.data(), mFormatSize))
+	{
+		return false;
+	}
+
+	const size_t rowPitch = (size_t)mInfo->BorderedTileSize() * mFormatSize;
+	const size_t pageBorderXOffset = (size_t)mInfo->BorderSize * mFormatSize;
+	const size_t pageBorderYOffset = (size_t)mInfo->BorderSize * rowPitch;
+	const size_t tileByteSize = (size_t)mInfo->TileSize() * mFormatSize;
+	for (uint32_t i = 0; i < mInfo->TileSize(); ++i)
+	{
+		memcpy((char*)data + i * tileByteSize, page.data() + pageBorderYOffset + i * rowPitch + pageBorderXOffset, tileByteSize);
+	}
+	return true;
+}
+
+bool ProTerGen::VT::TileDataFile::BeginReadPage(PageIndex index, data_ptr data, OVERLAPPED* overlapped) const
+{
+	if (!mFile || ((mMode & READ_ASYNC) != READ_ASYNC)) return false;
+
+	const TilePageEntry* entry = Entry(index);
+	if (!entry) return false;
+
+	overlapped->Offset = (DWORD)(entry->Offset & 0xFFFFFFFFull);
+	overlapped->OffsetHigh = (DWORD)(entry->Offset >> 32);
+	if (ReadFile(mFile, data, entry->Size, nullptr, overlapped))
+	{
+		return true;
+	}
+	return GetLastError() == ERROR_IO_PENDING;
+}
+
+bool ProTerGen::VT::TileDataFile::DecodePage(PageIndex index, const uint8_t* stored, data_ptr data, uint32_t formatSize) const
+{
+	const TilePageEntry* entry = Entry(index);
+	if (!entry) return false;
+
+	const size_t pageTotalSize = PageTotalSize();
+	const size_t texelCount = pageTotalSize / mFormatSize;
+	if (formatSize == 0) formatSize = mFormatSize;
+
+	if (formatSize == mFormatSize)
+	{
+		return DecodeStored(*entry, stored, (uint8_t*)data);
+	}
+	else if (formatSize > mFormatSize)
+	{
+		// Decode into the tail of the destination and widen in place, no temporary buffer needed.
+		uint8_t* tail = (uint8_t*)data + texelCount * (formatSize - mFormatSize);
+		if (!DecodeStored(*entry, stored, tail)) return false;
+		ConvertTexels(tail, (uint8_t*)data, texelCount, mFormatSize, formatSize);
+		return true;
+	}
+	else
+	{
+		thread_local std::vector<uint8_t> page;
+		page.resize(pageTotalSize);
+		if (!DecodeStored(*entry, stored, page.data())) return false;
+		ConvertTexels(page.data(), (uint8_t*)data, texelCount, mFormatSize, formatSize);
+		return true;
+	}
+}
+
+bool ProTerGen::VT::TileDataFile::Map(AccessPattern pattern)
+{
+	if (IsMapped()) return true;
+	if (!mFile || mMode != READ) return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0) return false;
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mMapping) return false;
+
+	mView = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mView)
+	{
+		CloseHandle(mMapping);
+		mMapping = nullptr;
+		return false;
+	}
+	mViewSize = (size_t)fileSize.QuadPart;
+
+	// Windows has no madvise for views. Random access is what a view does by default; a sequential
+	// walk prefetches the whole file up front.
+	if (pattern == AccessPattern::SEQUENTIAL)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range = { .VirtualAddress = (PVOID)mView, .NumberOfBytes = mViewSize };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+	return true;
+}
+
+void ProTerGen::VT::TileDataFile::Unmap()
+{
+	if (mView)
+	{
+		UnmapViewOfFile(mView);
+		mView = nullptr;
+		mViewSize = 0;
+	}
+	if (mMapping)
+	{
+		CloseHandle(mMapping);
+		mMapping = nullptr;
+	}
+}
+
+const uint8_t* ProTerGen::VT::TileDataFile::PageView(PageIndex index) const
+{
+	const TilePageEntry* entry = Entry(index);
+	if (!mView || !entry || entry->Offset + entry->Size > mViewSize) return nullptr;
+	return mView + entry->Offset;
+}
+
+void ProTerGen::VT::TileDataFile::Prefetch(PageIndex first, size_t count) const
+{
+	if (!mView) return;
+
+	// Pages are stored in the order they were generated, so neighbours in the index may be apart in the file.
+	std::vector<WIN32_MEMORY_RANGE_ENTRY> ranges;
+	ranges.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (const uint8_t* stored = PageView((PageIndex)(first + i)))
 		{
-			if (_fseeki64(mFile, index * pageTotalSize + 1, SEEK_SET) != 0)
-			{
-				perror("fseek");
-				return false;
-			}
-			if (fread_s(data, pageTotalSize, 1, pageTotalSize, mFile) != pageTotalSize)
-			{
-				perror("fread");
-				return false;
-			}
+			ranges.push_back({ .VirtualAddress = (PVOID)stored, .NumberOfBytes = Entry((PageIndex)(first + i))->Size });
+		}
+	}
+	if (!ranges.empty())
+	{
+		PrefetchVirtualMemory(GetCurrentProcess(), ranges.size(), ranges.data(), 0);
+	}
+}
+
+size_t ProTerGen::VT::TileDataFile::PageTotalSize() const
+{
+	return (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFormatSize;
+}
+
+size_t ProTerGen::VT::TileDataFile::StoredPageSize(PageIndex index) const
+{
+	const TilePageEntry* entry = Entry(index);
+	return entry ? entry->Size : 0;
+}
 
-			return true;
+uint64_t ProTerGen::VT::TileDataFile::ContentId(PageIndex index) const
+{
+	// Stored bytes are never shared by different contents, so their offset identifies the content.
+	const TilePageEntry* entry = Entry(index);
+	return entry ? entry->Offset : 0;
+}
+
+bool ProTerGen::VT::TileDataFile::IsShared(PageIndex index) const
+{
+	const TilePageEntry* entry = Entry(index);
+	return entry && mSharedOffsets.contains(entry->Offset);
+}
+
+uint64_t ProTerGen::VT::TileDataFile::PageCount() const
+{
+	// Every mip has a quarter of the pages of the one below: (4^mips - 1) / 3.
+	const uint64_t mipCount = (uint64_t)mInfo->VTTilesPerRowExp + 1;
+	return ((1ull << (2 * mipCount)) - 1) / 3;
+}
+
+const ProTerGen::VT::TilePageEntry* ProTerGen::VT::TileDataFile::Entry(PageIndex index) const
+{
+	return (index < mIndex.size() && mIndex[index].Size > 0) ? &mIndex[index] : nullptr;
+}
+
+bool ProTerGen::VT::TileDataFile::DecodeStored(const TilePageEntry& entry, const uint8_t* stored, uint8_t* data) const
+{
+	const size_t pageTotalSize = PageTotalSize();
+	switch (entry.Encoding)
+	{
+	case TilePageEncoding::RAW:
+		if (entry.Size != pageTotalSize) return false;
+		memcpy(data, stored, pageTotalSize);
+		return true;
+	case TilePageEncoding::DELTA_LZ:
+		if (!TileCompression::Decompress(stored, entry.Size, data, pageTotalSize)) return false;
+		TileCompression::DeltaDecode(data, pageTotalSize, mFormatSize);
+		return true;
+	default:
+		return false;
+	}
+}
+
+uint64_t ProTerGen::VT::TileDataFile::BitmapOffset() const
+{
+	return TileFileBitmapOffset(mIndex.size());
+}
+
+uint64_t ProTerGen::VT::TileDataFile::DataOffset() const
+{
+	return TileFileDataOffset(mIndex.size());
+}
+
+void ProTerGen::VT::TileDataFile::MarkComplete(PageIndex index)
+{
+	// Release: a checkpoint that sees the bit also sees the entry written before it.
+	mCompletePages[index >> 6].fetch_or(1ull << (index & 63), std::memory_order_release);
+
+	const uint32_t pending = mPagesSinceCheckpoint.fetch_add(1) + 1;
+	if (pending >= CHECKPOINT_PAGES || NowNanoseconds() - mLastCheckpointNanoseconds.load() >= CHECKPOINT_NANOSECONDS)
+	{
+		// Whoever gets the lock checkpoints; the other writers carry on instead of waiting for it.
+		std::unique_lock<std::mutex> lock(mCheckpointMutex, std::try_to_lock);
+		if (lock.owns_lock()) WriteCheckpoint();
+	}
+}
+
+void ProTerGen::VT::TileDataFile::WriteCheckpoint()
+{
+	mPagesSinceCheckpoint.store(0);
+	mLastCheckpointNanoseconds.store(NowNanoseconds());
+
+	// Only the entries of marked pages are read, the others may be in the middle of being written.
+	std::vector<uint64_t> bitmap(mCompletePages.size());
+	std::vector<TilePageEntry> index(mIndex.size());
+	for (size_t w = 0; w < bitmap.size(); ++w)
+	{
+		bitmap[w] = mCompletePages[w].load(std::memory_order_acquire);
+		for (uint64_t bits = bitmap[w]; bits != 0; bits &= bits - 1)
+		{
+			const size_t page = (w << 6) + std::countr_zero(bits);
+			index[page] = mIndex[page];
 		}
 	}
 
+	// The pages reach the disk before the index that points to them, so a crash at any point leaves a file
+	// whose marked pages can all be read.
+	if (!FlushFileBuffers(mFile) || !WriteIndex(index, bitmap) || !FlushFileBuffers(mFile))
+	{
+		perror("Checkpoint");
+	}
+}
+
+bool ProTerGen::VT::TileDataFile::ResumeIndex()
+{
+	if (!ReadIndex()) return false;
 
-	return false;
+	// Pages are appended after the last one kept; anything after it was never checkpointed.
+	uint64_t dataEnd = DataOffset();
+	std::vector<uint8_t> stored;
+	std::unordered_set<uint64_t> hashed;
+	for (const TilePageEntry& entry : mIndex)
+	{
+		if (entry.Size == 0) continue;
+		dataEnd = max(dataEnd, entry.Offset + entry.Size);
+
+		// The kept pages can still be shared by the new ones.
+		if (hashed.insert(entry.Offset).second)
+		{
+			stored.resize(entry.Size);
+			if (!ReadAt(entry.Offset, stored.data(), entry.Size)) return false;
+			mWrittenContent.emplace(HashContent(stored.data(), entry.Size), entry);
+		}
+	}
+	mDataEnd.store(dataEnd);
+
+	printf("Resuming the tile file with %zu of %zu pages.\n", CompletePages(), mIndex.size());
+	return true;
 }
 
-bool ProTerGen::VT::TileDataFile::ReadTile(PageIndex index, data_ptr data) const
+bool ProTerGen::VT::TileDataFile::ReadIndex()
 {
-	if (mFile && ((mMode & READ) == READ))
+	TileFileHeader header = {};
+	if (!ReadAt(1, &header, sizeof(header))) return false;
+	if (header.Magic != FILE_MAGIC || header.Version != FILE_VERSION ||
+		header.FormatSize != mFormatSize || header.BorderedTileSize != mInfo->BorderedTileSize() ||
+		header.PageCount != PageCount())
 	{
-		const size_t pageTotalSize = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFormatSize;
-		const size_t pageBorderXOffset = (size_t)mInfo->BorderSize * mFormatSize;
-		const size_t pageBorderYOffset = (size_t)mInfo->BorderedTileSize() * pageBorderXOffset;
-		const size_t tileByteSize = (size_t)mInfo->TileSize() * mFormatSize;
+		return false;
+	}
 
-		if (_fseeki64(mFile, index * pageTotalSize + pageBorderYOffset + 1, SEEK_SET) != 0)
+	mIndex.resize(header.PageCount);
+	if (!ReadAt(1 + sizeof(header), mIndex.data(), mIndex.size() * sizeof(TilePageEntry))) return false;
+
+	std::vector<uint64_t> bitmap((mIndex.size() + 63) >> 6);
+	if (!ReadAt(BitmapOffset(), bitmap.data(), bitmap.size() * sizeof(uint64_t))) return false;
+	mCompletePages = std::vector<std::atomic<uint64_t>>(bitmap.size());
+	for (size_t i = 0; i < mIndex.size(); ++i)
+	{
+		if ((bitmap[i >> 6] & (1ull << (i & 63))) == 0)
 		{
-			perror("fseek");
-			return false;
+			mIndex[i] = TilePageEntry{};
 		}
+	}
+	for (size_t w = 0; w < bitmap.size(); ++w)
+	{
+		mCompletePages[w].store(bitmap[w]);
+	}
 
-		for (uint32_t i = 0; i < mInfo->TileSize(); ++i)
+	std::unordered_set<uint64_t> offsets;
+	for (const TilePageEntry& entry : mIndex)
+	{
+		if (entry.Size > 0 && !offsets.insert(entry.Offset).second)
 		{
-			if (_fseeki64(mFile, pageBorderXOffset, SEEK_CUR) != 0)
-			{
-				perror("fseek");
-				return false;
-			}
+			mSharedOffsets.insert(entry.Offset);
+		}
+	}
+	return true;
+}
 
-			char* dst = (char*)data + i * tileByteSize;
-			if (fread_s(dst, tileByteSize, 1, tileByteSize, mFile) != tileByteSize)
-			{
-				return false;
-			}
+bool ProTerGen::VT::TileDataFile::WriteIndex(const std::vector<TilePageEntry>& index, const std::vector<uint64_t>& bitmap)
+{
+	const TileFileHeader header =
+	{
+		.Magic            = FILE_MAGIC,
+		.Version          = FILE_VERSION,
+		.FormatSize       = mFormatSize,
+		.BorderedTileSize = mInfo->BorderedTileSize(),
+		.PageCount        = index.size(),
+	};
+	return WriteAt(1, &header, sizeof(header))
+		&& WriteAt(1 + sizeof(header), index.data(), index.size() * sizeof(TilePageEntry))
+		&& WriteAt(BitmapOffset(), bitmap.data(), bitmap.size() * sizeof(uint64_t));
+}
 
-			if (_fseeki64(mFile, pageBorderXOffset, SEEK_CUR) != 0)
-			{
-				perror("fseek");
-				return false;
-			}
+bool ProTerGen::VT::TileDataFile::ReadAt(uint64_t offset, void* data, size_t size) const
+{
+	// ReadFile with an OVERLAPPED offset on a synchronous handle is a positional read: it does not
+	// depend on the file pointer, so any number of threads can read at the same time.
+	// An ASYNC handle waits on an event instead; its low bit set keeps the read out of the completion port.
+	const bool async = (mMode & ASYNC) == ASYNC;
+	HANDLE event = async ? CreateEventW(nullptr, TRUE, FALSE, nullptr) : nullptr;
+	if (async && !event) return false;
+
+	uint8_t* dst = (uint8_t*)data;
+	bool result = true;
+	while (size > 0)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset & 0xFFFFFFFFull);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		overlapped.hEvent = async ? (HANDLE)((uintptr_t)event | 1) : nullptr;
+
+		const DWORD chunk = (DWORD)min(size, (size_t)MAXDWORD);
+		DWORD read = 0;
+		if (!ReadFile(mFile, dst, chunk, &read, &overlapped))
+		{
+			result = async && GetLastError() == ERROR_IO_PENDING && GetOverlappedResult(mFile, &overlapped, &read, TRUE);
 		}
-		return true;
+		if (!result || read == 0)
+		{
+			result = false;
+			break;
+		}
+		dst += read;
+		offset += read;
+		size -= read;
 	}
-	return false;
+
+	if (event) CloseHandle(event);
+	return result;
+}
+
+bool ProTerGen::VT::TileDataFile::WriteAt(uint64_t offset, const void* data, size_t size)
+{
+	const uint8_t* src = (const uint8_t*)data;
+	while (size > 0)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset & 0xFFFFFFFFull);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		const DWORD chunk = (DWORD)min(size, (size_t)MAXDWORD);
+		DWORD written = 0;
+		if (!WriteFile(mFile, src, chunk, &written, &overlapped) || written == 0)
+		{
+			return false;
+		}
+		src += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
 }
 
 ProTerGen::VT::PageLoaderFromDisk::~PageLoaderFromDisk()
@@ -181,70 +677,368 @@ ProTerGen::VT::PageLoaderFromDisk::~PageLoaderFromDisk()
 	Dispose();
 }
 
-void ProTerGen::VT::PageLoaderFromDisk::Init(const std::wstring& fileName, PageIndexer* indexer, const VTDesc* info)
+void ProTerGen::VT::PageLoaderFromDisk::Init(const std::wstring& fileName, PageIndexer* indexer, const VTDesc* info, bool useMapping, IOBackend backend)
 {
 	mInfo = info;
 	mIndexer = indexer;
+	mBackend = backend;
+
+	if (mBackend == IOBackend::COMPLETION_PORT)
+	{
+		mFile.Open(fileName, info, 3, TileDataFile::AccessMode::READ_ASYNC);
+		if (!InitCompletionPort())
+		{
+			printf("Can't create the completion port, reading pages on the JobSystem.\n");
+			mFile.Close();
+			mBackend = IOBackend::JOBS;
+		}
+	}
+
+	if (mBackend == IOBackend::JOBS)
+	{
+		mFile.Open(fileName, info, 3, TileDataFile::AccessMode::READ);
+		if (useMapping && !mFile.Map(TileDataFile::AccessPattern::RANDOM))
+		{
+			printf("Can't map the tile file, reading pages with positional reads.\n");
+		}
 
-	mFile.Open(fileName, info, 3, TileDataFile::AccessMode::READ);
+		JobSystem::Initialize();
+		mCompleteQueue.SetMaxSize(MAX_QUEUE_DEPTH);
+		mPageBuffers.Init((size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * 4, mQueueDepth);
+	}
 
-	mReadThread.OnComplete([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const ReadState& state) { PageLoadComplete(commandList, state); });
-	mReadThread.OnRun([&](ReadState& state) { return LoadPage(state); });
-	mReadThread.Init();
+	mSharedPages.Resize(SHARED_PAGES_CACHED);
+
+	int64_t expected = 0;
+	sMetricWindowStartNanoseconds.compare_exchange_strong(expected, NowNanoseconds());
+	mIsRunning.store(true);
 }
 
 void ProTerGen::VT::PageLoaderFromDisk::Dispose()
 {
-	mReadThread.Dispose();
+	Clear();
 	mFile.Close();
+	if (mCompletionPort)
+	{
+		CloseHandle(mCompletionPort);
+		mCompletionPort = nullptr;
+	}
 }
 
 void ProTerGen::VT::PageLoaderFromDisk::Update(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t uploads)
 {
-	mReadThread.Update(commandList, uploads);
+	if (mBackend == IOBackend::COMPLETION_PORT)
+	{
+		UpdateAsync(commandList, uploads);
+		return;
+	}
+
+	for (uint32_t i = 0; i < uploads && !mCompleteQueue.IsEmpty(); ++i)
+	{
+		ReadState state = {};
+		if (!mCompleteQueue.TryDequeue(state))
+		{
+			break;
+		}
+		mOnLoadComplete(commandList, state.page, state.data.Data());
+	}
 }
 
 void ProTerGen::VT::PageLoaderFromDisk::Submit(const Page& request)
 {
-	ReadState state = {};
-	state.page = request;
+	if (mBackend == IOBackend::COMPLETION_PORT)
+	{
+		SubmitAsync(request);
+		return;
+	}
+
+	// Like a full request queue, pages over the limit are dropped and asked again by the next feedback.
+	if (!mIsRunning.load())
+	{
+		return;
+	}
+	if (mPendingPages.fetch_add(1) >= mQueueDepth)
+	{
+		mPendingPages.fetch_sub(1);
+		return;
+	}
 
-	mReadThread.Enqueue(state);
+	const auto submitTime = std::chrono::steady_clock::now();
+	JobSystem::Execute(mJobs, [this, request, submitTime](JobSystem::JobDesc)
+		{
+			ReadState state = {};
+			state.page = request;
+			// Requests still queued when the loader is cleared are discarded.
+			if (mIsRunning.load() && LoadPage(state))
+			{
+				MetricRecordPageLoad(submitTime);
+				mCompleteQueue.Enqueue(state);
+			}
+			mPendingPages.fetch_sub(1);
+		});
 }
 
 void ProTerGen::VT::PageLoaderFromDisk::Clear()
 {
-	mReadThread.Dispose();
+	mIsRunning.store(false);
+	if (mBackend == IOBackend::COMPLETION_PORT)
+	{
+		CancelAsync();
+		mSharedHits.clear();
+	}
+	else
+	{
+		JobSystem::Wait(mJobs);
+	}
 }
 
 void ProTerGen::VT::PageLoaderFromDisk::Restart()
 {
-	mReadThread.Init();
+	mIsRunning.store(true);
 }
 
-bool ProTerGen::VT::PageLoaderFromDisk::LoadPage(ReadState& state)
+ProTerGen::VT::PageLoaderFromDisk::shared_page_ptr ProTerGen::VT::PageLoaderFromDisk::FindSharedPage(PageIndex index)
 {
-	bool result = true;
+	shared_page_ptr page = nullptr;
+	std::lock_guard<std::mutex> lg(mSharedPagesMutex);
+	if (mSharedPages.TryGet(mFile.ContentId(index), page, true))
+	{
+		sMetricSharedPageHits.fetch_add(1);
+	}
+	return page;
+}
 
-	uint32_t size = mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * 4;
+void ProTerGen::VT::PageLoaderFromDisk::KeepSharedPage(PageIndex index, const uint8_t* data)
+{
+	const size_t size = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * 4;
+	shared_page_ptr page = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+	std::lock_guard<std::mutex> lg(mSharedPagesMutex);
+	mSharedPages.Add(mFile.ContentId(index), page);
+}
 
-	state.data = malloc(size);
-	if (!state.data) return false;
+bool ProTerGen::VT::PageLoaderFromDisk::InitCompletionPort()
+{
+	if (!mFile.NativeHandle()) return false;
 
-	const size_t pageIndex = mIndexer->PageIndex(state.page);
-	result &= mFile.ReadPage(pageIndex, state.data, 4);
+	mCompletionPort = CreateIoCompletionPort(mFile.NativeHandle(), nullptr, 0, 1);
+	if (!mCompletionPort) return false;
 
-	if (mShowBorders)
+	// Every read owns a slice of one allocation for its whole life, like registered buffers: no allocation
+	// per page and nothing to free on completion.
+	const size_t pageTotalSize = mFile.PageTotalSize();
+	mAsyncBuffers.resize(pageTotalSize * MAX_QUEUE_DEPTH);
+	mAsyncReads.resize(MAX_QUEUE_DEPTH);
+	mFreeAsyncReads.resize(MAX_QUEUE_DEPTH);
+	for (uint32_t i = 0; i < MAX_QUEUE_DEPTH; ++i)
+	{
+		mAsyncReads[i].Buffer = mAsyncBuffers.data() + i * pageTotalSize;
+		mFreeAsyncReads[i] = MAX_QUEUE_DEPTH - 1 - i;
+	}
+	mUploadBuffers.resize((size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * 4 * ASYNC_BATCH_SIZE);
+	JobSystem::Initialize();
+	return true;
+}
+
+void ProTerGen::VT::PageLoaderFromDisk::SubmitAsync(const Page& request)
+{
+	const size_t inFlight = mAsyncReads.size() - mFreeAsyncReads.size();
+	if (!mIsRunning.load() || inFlight >= mQueueDepth)
 	{
-		result &= CopyBorder(state.data);
+		return;
 	}
 
-	return result;
+	const PageIndex pageIndex = mIndexer->PageIndex(request);
+	if (shared_page_ptr shared = mFile.IsShared(pageIndex) ? FindSharedPage(pageIndex) : nullptr)
+	{
+		mSharedHits.push_back({ .page = request, .SubmitTime = std::chrono::steady_clock::now(), .data = shared });
+		return;
+	}
+
+	const uint32_t slot = mFreeAsyncReads.back();
+	AsyncRead& read = mAsyncReads[slot];
+	read.Overlapped = {};
+	read.page = request;
+	read.SubmitTime = std::chrono::steady_clock::now();
+
+	// Queued or completed right away, the completion is posted to the port either way.
+	if (mFile.BeginReadPage(pageIndex, read.Buffer, &read.Overlapped))
+	{
+		mFreeAsyncReads.pop_back();
+	}
 }
 
-void ProTerGen::VT::PageLoaderFromDisk::PageLoadComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const ReadState& state)
+void ProTerGen::VT::PageLoaderFromDisk::UpdateAsync(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t uploads)
 {
-	mOnLoadComplete(commandList, state.page, state.data);
+	const size_t uploadPageSize = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * 4;
+
+	// Pages found decoded already go first, they cost a copy.
+	size_t sharedHits = 0;
+	for (; sharedHits < mSharedHits.size() && uploads > 0; ++sharedHits, --uploads)
+	{
+		const SharedHit& hit = mSharedHits[sharedHits];
+		data_ptr data = mUploadBuffers.data();
+		memcpy(data, hit.data->data(), uploadPageSize);
+		if (mShowBorders)
+		{
+			CopyBorder(data);
+		}
+		MetricRecordPageLoad(hit.SubmitTime);
+		mOnLoadComplete(commandList, hit.page, data);
+	}
+	mSharedHits.erase(mSharedHits.begin(), mSharedHits.begin() + sharedHits);
+
+	OVERLAPPED_ENTRY entries[ASYNC_BATCH_SIZE] = {};
+	std::array<bool, ASYNC_BATCH_SIZE> decoded = {};
+	JobSystem::Context ctx;
+	while (uploads > 0 && mFreeAsyncReads.size() < mAsyncReads.size())
+	{
+		ULONG removed = 0;
+		if (!GetQueuedCompletionStatusEx(mCompletionPort, entries, min(uploads, ASYNC_BATCH_SIZE), &removed, 0, FALSE) || removed == 0)
+		{
+			break;
+		}
+
+		// The pages of a batch are decompressed by the workers, then handed over in order.
+		JobSystem::Dispatch(ctx, removed, 1, [&](JobSystem::JobDesc desc)
+			{
+				const OVERLAPPED_ENTRY& entry = entries[desc.JobIndex];
+				const AsyncRead& read = *(const AsyncRead*)entry.lpOverlapped;
+				const PageIndex pageIndex = mIndexer->PageIndex(read.page);
+				data_ptr data = mUploadBuffers.data() + desc.JobIndex * uploadPageSize;
+
+				decoded[desc.JobIndex] = mIsRunning.load()
+					&& entry.dwNumberOfBytesTransferred == mFile.StoredPageSize(pageIndex)
+					&& mFile.DecodePage(pageIndex, read.Buffer, data, 4);
+				if (decoded[desc.JobIndex] && mFile.IsShared(pageIndex))
+				{
+					KeepSharedPage(pageIndex, (const uint8_t*)data);
+				}
+				if (decoded[desc.JobIndex] && mShowBorders)
+				{
+					CopyBorder(data);
+				}
+			});
+		JobSystem::Wait(ctx);
+
+		for (ULONG i = 0; i < removed; ++i)
+		{
+			const AsyncRead& read = *(const AsyncRead*)entries[i].lpOverlapped;
+			if (decoded[i])
+			{
+				MetricRecordPageLoad(read.SubmitTime);
+				mOnLoadComplete(commandList, read.page, mUploadBuffers.data() + i * uploadPageSize);
+			}
+			mFreeAsyncReads.push_back((uint32_t)(&read - mAsyncReads.data()));
+		}
+		uploads -= min(uploads, (uint32_t)removed);
+	}
+}
+
+void ProTerGen::VT::PageLoaderFromDisk::CancelAsync()
+{
+	if (!mCompletionPort) return;
+
+	CancelIoEx(mFile.NativeHandle(), nullptr);
+
+	// Cancelled reads still post a completion, and their buffers are busy until it arrives.
+	OVERLAPPED_ENTRY entries[64] = {};
+	while (mFreeAsyncReads.size() < mAsyncReads.size())
+	{
+		ULONG removed = 0;
+		if (!GetQueuedCompletionStatusEx(mCompletionPort, entries, 64, &removed, INFINITE, FALSE))
+		{
+			break;
+		}
+		for (ULONG i = 0; i < removed; ++i)
+		{
+			mFreeAsyncReads.push_back((uint32_t)((AsyncRead*)entries[i].lpOverlapped - mAsyncReads.data()));
+		}
+	}
+}
+
+double ProTerGen::VT::PageLoaderFromDisk::MetricGetPageLoadsPerSecond()
+{
+	const int64_t start = sMetricWindowStartNanoseconds.load();
+	const int64_t elapsed = NowNanoseconds() - start;
+	return start != 0 && elapsed > 0 ? (double)sMetricPagesLoaded.load() * 1e9 / (double)elapsed : 0.0;
+}
+
+double ProTerGen::VT::PageLoaderFromDisk::MetricGetLatencyMs(double percentile)
+{
+	std::vector<float> latencies;
+	{
+		std::lock_guard<std::mutex> lg(sMetricLatencyMutex);
+		latencies = sMetricLatenciesMs;
+	}
+	if (latencies.empty()) return 0.0;
+
+	const size_t n = (size_t)(ProTerGen_clamp(0.0, 1.0, percentile) * (double)(latencies.size() - 1));
+	std::nth_element(latencies.begin(), latencies.begin() + n, latencies.end());
+	return (double)latencies[n];
+}
+
+uint64_t ProTerGen::VT::PageLoaderFromDisk::MetricGetSharedPageHits()
+{
+	return sMetricSharedPageHits.load();
+}
+
+void ProTerGen::VT::PageLoaderFromDisk::MetricResetPageLoads()
+{
+	sMetricPagesLoaded.store(0);
+	sMetricSharedPageHits.store(0);
+	sMetricWindowStartNanoseconds.store(NowNanoseconds());
+
+	std::lock_guard<std::mutex> lg(sMetricLatencyMutex);
+	sMetricLatenciesMs.clear();
+	sMetricNextLatency = 0;
+}
+
+void ProTerGen::VT::PageLoaderFromDisk::MetricRecordPageLoad(std::chrono::steady_clock::time_point submitTime)
+{
+	const std::chrono::duration<float, std::milli> latency = std::chrono::steady_clock::now() - submitTime;
+	sMetricPagesLoaded.fetch_add(1);
+
+	std::lock_guard<std::mutex> lg(sMetricLatencyMutex);
+	if (sMetricLatenciesMs.size() < METRIC_LATENCY_SAMPLES)
+	{
+		sMetricLatenciesMs.push_back(latency.count());
+	}
+	else
+	{
+		sMetricLatenciesMs[sMetricNextLatency] = latency.count();
+	}
+	sMetricNextLatency = (sMetricNextLatency + 1) % METRIC_LATENCY_SAMPLES;
+}
+
+bool ProTerGen::VT::PageLoaderFromDisk::LoadPage(ReadState& state)
+{
+	bool result = true;
+
+	const size_t size = mPageBuffers.BufferSize();
+	state.data = mPageBuffers.Acquire();
+	data_ptr data = state.data.Data();
+
+	const PageIndex pageIndex = mIndexer->PageIndex(state.page);
+	const bool shared = mFile.IsShared(pageIndex);
+	if (shared_page_ptr sharedPage = shared ? FindSharedPage(pageIndex) : nullptr)
+	{
+		memcpy(data, sharedPage->data(), size);
+	}
+	else
+	{
+		result &= mFile.ReadPage(pageIndex, data, 4);
+		if (result && shared)
+		{
+			KeepSharedPage(pageIndex, (const uint8_t*)data);
+		}
+	}
+
+	if (mShowBorders)
+	{
+		result &= CopyBorder(data);
+	}
+
+	return result;
 }
 
 bool ProTerGen::VT::PageLoaderFromDisk::CopyBorder(data_ptr& imgData)
@@ -1,13 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "VirtualTextureCommon.h"
-#include "PageThread.h"
+#include "TileFileFormat.h"
+#include "ConcurrentQueue.h"
+#include "JobSystem.h"
+#include "LRUCache.h"
+#include "MathHelpers.h"
 
 namespace ProTerGen
 {
 	namespace VT
 	{		
-		// Represents a tiled disk file containing virtual texture with the order described in a previously specified indexer
+		// Represents a tiled disk file containing virtual texture with the order described in a previously specified indexer.
+		// Reads and writes are positional, so one open file can be shared by any number of threads.
+		// Layout: the complete mark char, a TileFileHeader, one TilePageEntry per page in indexer order, a bitmap with
+		// a bit per page, and the pages appended in the order they were written, each one compressed unless that does
+		// not make it smaller. Pages with the same content are stored once, and their entries point to the same bytes.
+		// Only the pages with their bit set exist. The bitmap and the index are written by checkpoints, after the pages
+		// they describe are flushed, so a file that was interrupted can be opened with RESUME to finish it.
 		class TileDataFile
 		{
 		public:
@@ -16,29 +35,119 @@ namespace ProTerGen
 				_NULL = 0,
 				WRITE = 1 << 0,
 				READ = 1 << 1,
-				READ_WRITE = WRITE | READ
+				READ_WRITE = WRITE | READ,
+				ASYNC = 1 << 2, // Opened for overlapped reads, see BeginReadPage.
+				READ_ASYNC = READ | ASYNC,
+				RESUME = 1 << 3, // With WRITE, keeps the checkpointed pages of an existing file instead of truncating it.
+				READ_WRITE_RESUME = READ_WRITE | RESUME
+			};
+
+			enum class AccessPattern : uint32_t
+			{
+				RANDOM     = 0, // Pages streamed in the order the feedback asks for them.
+				SEQUENTIAL = 1, // The whole file walked in order, like a mip build.
 			};
 
+			static constexpr uint32_t FILE_MAGIC   = TILE_FILE_MAGIC;
+			static constexpr uint32_t FILE_VERSION = TILE_FILE_VERSION;
+
 			~TileDataFile();
 
+			// The file starts with completeChar and has a header of this version.
+			static bool IsComplete(const std::wstring& filename, char completeChar);
+			static bool IsComplete(const std::string& filename, char completeChar);
+
 			void Open(const std::wstring& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode);
 			void Open(const std::string& filename, const VTDesc* info, uint32_t formatSize, AccessMode accessMode);
 			void Close();
+			// Can be called from many threads at once, every page is compressed by the thread writing it. A page equal
+			// to one already written only gets an entry. Every few pages, one of the writers checkpoints the file.
 			void WritePage(PageIndex index, const data_ptr data);
+			// Checkpoints first, so a mark always describes a file with all its pages in place.
 			void WriteCharOnBeginning(char c);
+			// Flushes the pages written so far, then the index and bitmap that describe them.
+			void Checkpoint();
+			inline bool IsPageComplete(PageIndex index) const
+			{
+				return index < mIndex.size() && (mCompletePages[index >> 6].load(std::memory_order_acquire) & (1ull << (index & 63))) != 0;
+			}
+			size_t CompletePages() const;
 			bool ReadPage(PageIndex index, data_ptr data, uint32_t formatSize) const;
 			bool ReadTile(PageIndex index, data_ptr data) const;
+			// Starts an overlapped read of the page as stored on a READ_ASYNC file, StoredPageSize bytes that DecodePage
+			// turns into texels. The completion goes to the event or completion port of the OVERLAPPED, which must live
+			// until then.
+			bool BeginReadPage(PageIndex index, data_ptr data, OVERLAPPED* overlapped) const;
+			bool DecodePage(PageIndex index, const uint8_t* stored, data_ptr data, uint32_t formatSize) const;
+			inline HANDLE NativeHandle() const { return mFile; }
+			// Size of a decoded page, which is also the most a page can take in the file.
+			size_t PageTotalSize() const;
+			size_t StoredPageSize(PageIndex index) const;
+			// Same id for every page with the same content, 0 for pages not written.
+			uint64_t ContentId(PageIndex index) const;
+			// The content of the page is shared with some other page.
+			bool IsShared(PageIndex index) const;
+			inline size_t DeduplicatedPages() const { return mDeduplicatedPages.load(); }
+
+			// Maps a READ file. While mapped, reads copy from the view instead of seeking the FILE.
+			bool Map(AccessPattern pattern = AccessPattern::RANDOM);
+			void Unmap();
+			inline bool IsMapped() const { return mView != nullptr; }
+			// The stored page inside the mapping, without copies. nullptr if not mapped or not written.
+			const uint8_t* PageView(PageIndex index) const;
+			// Asks the OS to bring the pages [first, first + count) into memory ahead of their use.
+			void Prefetch(PageIndex first, size_t count) const;
 		private:
+			uint64_t PageCount() const;
+			const TilePageEntry* Entry(PageIndex index) const;
+			bool DecodeStored(const TilePageEntry& entry, const uint8_t* stored, uint8_t* data) const;
+			uint64_t BitmapOffset() const;
+			uint64_t DataOffset() const;
+			void MarkComplete(PageIndex index);
+			void WriteCheckpoint();
+			bool ResumeIndex();
+			bool ReadIndex();
+			bool WriteIndex(const std::vector<TilePageEntry>& index, const std::vector<uint64_t>& bitmap);
+			bool ReadAt(uint64_t offset, void* data, size_t size) const;
+			bool WriteAt(uint64_t offset, const void* data, size_t size);
+
 			const VTDesc* mInfo = nullptr;
 			uint32_t mFormatSize = 0;
-			mutable FILE* mFile = nullptr;
+			HANDLE mFile = nullptr;
 			AccessMode mMode = AccessMode::_NULL;
+
+			std::vector<TilePageEntry> mIndex;
+			std::atomic<uint64_t> mDataEnd = 0;
+
+			// Set once the page and its entry are written; writers never take a lock to mark them.
+			std::vector<std::atomic<uint64_t>> mCompletePages;
+			std::mutex mCheckpointMutex;
+			std::atomic<uint32_t> mPagesSinceCheckpoint = 0;
+			std::atomic<int64_t> mLastCheckpointNanoseconds = 0;
+
+			std::mutex mWrittenContentMutex;
+			std::unordered_map<uint64_t, TilePageEntry> mWrittenContent; // Content hash of the stored bytes.
+			std::atomic<size_t> mDeduplicatedPages = 0;
+			std::unordered_set<uint64_t> mSharedOffsets;
+
+			HANDLE mMapping = nullptr;
+			const uint8_t* mView = nullptr;
+			size_t mViewSize = 0;
 		};
 
-		// Loads tile format files from disk in a different thread.
+		// Loads tile format files from disk. By default the reads are overlapped and reaped by Update, like a ring of
+		// asynchronous requests; without a completion port every request is a job of the JobSystem instead.
 		class PageLoaderFromDisk
 		{
 		public:
+			enum class IOBackend : uint32_t
+			{
+				COMPLETION_PORT = 0, // Overlapped reads, completions reaped by Update. Submit and Update from one thread.
+				JOBS            = 1, // Blocking positional reads spread over the JobSystem.
+			};
+
+			static constexpr uint32_t MAX_QUEUE_DEPTH = 256;
+
 			~PageLoaderFromDisk();
 
 			inline void OnLoadComplete(const std::function<void(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Page&, const data_ptr&)>& func) { mOnLoadComplete = func; }
@@ -47,15 +156,56 @@ namespace ProTerGen
 			inline void BordersColor(float color[4]) { *((float*)&mBorderColor) = *color; }
 			inline bool IsShowBordersEnabled() { return mShowBorders; }
 
-			void Init(const std::wstring& fileName, PageIndexer* indexer, const VTDesc* info);
+			// Falls back to JOBS when the completion port can't be created. With JOBS, the file is memory mapped unless
+			// useMapping is false, which keeps the positional reads for comparison.
+			void Init(const std::wstring& fileName, PageIndexer* indexer, const VTDesc* info, bool useMapping = true, IOBackend backend = IOBackend::COMPLETION_PORT);
 			void Dispose();
 			void Update(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t updateCount);
 			void Submit(const Page& request);
 			void Clear();
 			void Restart();
+
+			inline IOBackend Backend() const { return mBackend; }
+			// Pages read at the same time, up to MAX_QUEUE_DEPTH. Requests over it are dropped.
+			inline void QueueDepth(uint32_t depth) { mQueueDepth = ProTerGen_clamp(1u, MAX_QUEUE_DEPTH, depth); }
+			inline uint32_t QueueDepth() const { return mQueueDepth; }
+
+			// Pages delivered since the last reset, over the time elapsed since then.
+			static double MetricGetPageLoadsPerSecond();
+			// Time from Submit to the page being ready, over the last pages loaded. percentile in [0, 1].
+			static double MetricGetLatencyMs(double percentile);
+			// Pages served from the decoded copy of another page with the same content, without reading the file.
+			static uint64_t MetricGetSharedPageHits();
+			static void MetricResetPageLoads();
 		private:
+			struct AsyncRead
+			{
+				OVERLAPPED Overlapped = {}; // First member, the OVERLAPPED of a completion is its AsyncRead.
+				Page page = {};
+				std::chrono::steady_clock::time_point SubmitTime = {};
+				uint8_t* Buffer = nullptr;
+			};
+
+			using shared_page_ptr = std::shared_ptr<const std::vector<uint8_t>>;
+
+			struct SharedHit
+			{
+				Page page = {};
+				std::chrono::steady_clock::time_point SubmitTime = {};
+				shared_page_ptr data = nullptr;
+			};
+
+			// Decoded pages of shared content, before borders, so the pages that share it skip the disk.
+			shared_page_ptr FindSharedPage(PageIndex index);
+			void KeepSharedPage(PageIndex index, const uint8_t* data);
+
+			bool InitCompletionPort();
+			void SubmitAsync(const Page& request);
+			void UpdateAsync(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, uint32_t updateCount);
+			void CancelAsync();
+			static void MetricRecordPageLoad(std::chrono::steady_clock::time_point submitTime);
+
 			bool LoadPage(ReadState& state);
-			void PageLoadComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const ReadState& state);
 			bool CopyBorder(data_ptr& imgData);
 
 			const VTDesc* mInfo = nullptr;
@@ -66,7 +216,30 @@ namespace ProTerGen
 			std::function<void(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Page&, const data_ptr&)> mOnLoadComplete
 				= [](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Page&, const data_ptr&) {};
 
-			PageThread<ReadState> mReadThread;
+			std::mutex mSharedPagesMutex;
+			LRUCache<uint64_t, shared_page_ptr> mSharedPages;
+			std::vector<SharedHit> mSharedHits; // Completion port backend, delivered by Update.
+
+			JobSystem::Context mJobs;
+			PageBufferPool mPageBuffers; // Before the queue, the pages in it are given back on destruction.
+			NBConcurrentQueue<ReadState> mCompleteQueue;
+			std::atomic_bool mIsRunning = false;
+			std::atomic<uint32_t> mPendingPages = 0;
+			uint32_t mQueueDepth = MAX_QUEUE_DEPTH;
+			IOBackend mBackend = IOBackend::JOBS;
+
+			HANDLE mCompletionPort = nullptr;
+			std::vector<AsyncRead> mAsyncReads;
+			std::vector<uint32_t> mFreeAsyncReads;
+			std::vector<uint8_t> mAsyncBuffers; // One stored page per AsyncRead, allocated once.
+			std::vector<uint8_t> mUploadBuffers; // Decoded pages of a batch of completions, 4 bytes per texel.
+
+			static std::atomic<uint64_t> sMetricPagesLoaded;
+			static std::atomic<uint64_t> sMetricSharedPageHits;
+			static std::atomic<int64_t> sMetricWindowStartNanoseconds;
+			static std::mutex sMetricLatencyMutex;
+			static std::vector<float> sMetricLatenciesMs;
+			static size_t sMetricNextLatency;
 
 			bool mShowBorders = false;
 			struct
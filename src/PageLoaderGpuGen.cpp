@@ -8,6 +8,12 @@
 #endif
 
 const char GPU_THREADS[] = "1";
+// Page buffers allocated up front for each generated texture.
+const size_t PAGE_BUFFERS_PREALLOCATED = 16;
+// Generated Sdh pages kept in memory before spilling to disk.
+const size_t PAGE_CACHE_MEMORY_PAGES = 32;
+// Bytes of spilled Sdh pages kept on disk, the least recently used ones are removed past it.
+const uint64_t PAGE_CACHE_DISK_BYTES = 4ull << 30;
 
 ProTerGen::VT::PageGpuGen_HNC::~PageGpuGen_HNC()
 {
@@ -27,6 +33,12 @@ void ProTerGen::VT::PageGpuGen_HNC::Init
 	mComputeContext = std::move(computeContext);;
 	mTilesPerDispatch = tilesPerFrame;
 
+	for (uint32_t i = 0; i < GenerationTextures::COUNT; ++i)
+	{
+		const size_t textureSize = mInfo->BorderedTileSize();
+		mPageBuffers[i].Init(textureSize * textureSize * _TEXTURES_BYTES_PER_TEXEL()[i], PAGE_BUFFERS_PREALLOCATED);
+	}
+
 	// Create new compute pipeline.
 	// 1 structured buffer for page settings. 
 	// 1 constant buffer for terrain config -> noise and color layers.
@@ -171,6 +183,8 @@ void ProTerGen::VT::PageGpuGen_HNC::Init
 
 	pipeline.CommandList->ResourceBarrier(GenerationTextures::COUNT, barriers);
 
+	// A page is queued once until it loads, so the queues never hold more than every page.
+	mPageThread.MaxQueueSize(mIndexer->GetCount());
 	mPageThread.OnRun([&](MultiPage& readState) { return LoadPage(readState); });
 	mPageThread.OnComplete([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& rs) { OnProcessingComplete(commandList, rs); });
 	mPageThread.Init();
@@ -321,18 +335,16 @@ bool ProTerGen::VT::PageGpuGen_HNC::LoadPage(MultiPage& readState)
 	ThrowIfFailed(pipeline.CommandList->Reset(pipeline.CommandAllocator.Get(), pipeline.PSOs[(uint32_t)PSOs::DEFAULT].Get()));
 
 	// Copy image to buffer
-	readState.dataPtrs.resize(GenerationTextures::COUNT);
 	void* data = nullptr;
 	for (uint32_t i = 0; i < GenerationTextures::COUNT; ++i)
 	{
 		Texture*& texture = pipeline.Textures[i];
 		const size_t totalSize = (size_t)textureSize * textureSize * textureBytesPerTexel[i];
 		
-		readState.dataPtrs[i] = malloc(totalSize);
-		assert(readState.dataPtrs[i] != nullptr && "Not enough memory to complete operation");
+		readState.dataPtrs[i] = AcquirePageBuffer(i, mPageBuffers[i]);
 		const D3D12_RANGE range = { .Begin = 0, .End = totalSize };
 		ThrowIfFailed(texture->UploadHeap->Map(0, &range, &data));
-		memcpy(readState.dataPtrs[i], data, totalSize);
+		memcpy(readState.dataPtrs[i].Data(), data, totalSize);
 		texture->UploadHeap->Unmap(0, nullptr);
 	}
 
@@ -341,7 +353,7 @@ bool ProTerGen::VT::PageGpuGen_HNC::LoadPage(MultiPage& readState)
 		const size_t index = (size_t)GenerationTextures::COLOR;
 		ColorBorders
 		(
-			readState.dataPtrs[index],
+			readState.dataPtrs[index].Data(),
 			std::array<uint8_t,	TEXTURES_BYTES_PER_TEXEL()[index]>{ 0, 255, 0, 255 },
 			mInfo->TileSize(),
 			mInfo->BorderSize, 
@@ -382,6 +394,14 @@ void ProTerGen::VT::PageGpuGen_Sdh::Init
 	mInfo = info;
 	mComputeContext = std::move(computeContext);;
 	mTilesPerDispatch = tilesPerFrame;
+	mPageCache.Init(PAGE_CACHE_MEMORY_PAGES, gCachePath + L"TerrainPages\\", PAGE_CACHE_DISK_BYTES);
+
+	for (uint32_t i = 0; i < GenerationTextures::COUNT; ++i)
+	{
+		const size_t textureSize = mInfo->BorderedTileSize();
+		const size_t alignedWidth = Align(textureSize * _TEXTURES_BYTES_PER_TEXEL()[i], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+		mPageBuffers[i].Init(alignedWidth * textureSize, PAGE_BUFFERS_PREALLOCATED);
+	}
 
 	auto& device = (mComputeContext->device);
 	auto& shaders = (mComputeContext->shaders);
@@ -446,6 +466,9 @@ void ProTerGen::VT::PageGpuGen_Sdh::Init
 	shaders.CompileShaders(shaderNames, shaderPaths, shaderTypes, shaderMacro);
 	shaders.CreateComputePSO(computePSOName, device, computeRootSignatureName, shaderNames.back());
 	pipeline.PSOs.push_back(shaders.GetPSO(computePSOName));
+	// The cached pages are only valid for the bytecode that generated them, so it is part of their key.
+	const Microsoft::WRL::ComPtr<ID3DBlob> heightBytecode = shaders.GetShaderBlob(shaderNames.back());
+	mShaderHash = NoiseTileCache::HashBytes(0, heightBytecode->GetBufferPointer(), heightBytecode->GetBufferSize());
 
 	shaderNames[0] = "ComputeNhTileTerrain_SlopeDer";
 	shaderMacro[0] = D3D_SHADER_MACRO{ "SLOPE_DERIVATIVES" };
@@ -453,6 +476,8 @@ void ProTerGen::VT::PageGpuGen_Sdh::Init
 	shaders.CompileShaders(shaderNames, shaderPaths, shaderTypes, shaderMacro);
 	shaders.CreateComputePSO(computePSOName, device, computeRootSignatureName, shaderNames.back());
 	pipeline.PSOs.push_back(shaders.GetPSO(computePSOName));
+	const Microsoft::WRL::ComPtr<ID3DBlob> slopeBytecode = shaders.GetShaderBlob(shaderNames.back());
+	mShaderHash = NoiseTileCache::HashBytes(mShaderHash, slopeBytecode->GetBufferPointer(), slopeBytecode->GetBufferSize());
 
 	pipeline.RootSignature = shaders.GetRootSignature(computeRootSignatureName);
 
@@ -526,7 +551,8 @@ void ProTerGen::VT::PageGpuGen_Sdh::Init
 
 	pipeline.CommandList->ResourceBarrier(GenerationTextures::COUNT, barriers);
 
-	mPageThread.MaxQueueSize((size_t)width * height);
+	// A page is queued once until it loads, so the queues never hold more than every page.
+	mPageThread.MaxQueueSize(mIndexer->GetCount());
 	mPageThread.OnRun([&](MultiPage& readState) { return LoadPage(readState); });
 	mPageThread.OnComplete([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& rs) { OnProcessingComplete(commandList, rs); });
 	mPageThread.Init();
@@ -586,10 +612,62 @@ void ProTerGen::VT::PageGpuGen_Sdh::SetLayers(const std::vector<Layer>& layers)
 		noiseComputeConstants->CopyData((uint32_t)i, cncb);
 	}
 	mLayerCount = ProTerGen_clamp(1, MAX_LAYERS, layers.size());
+	const uint64_t layersHash = NoiseTileCache::HashLayers(std::vector<Layer>(layers.begin(), layers.begin() + mLayerCount), mInfo);
+	mLayersHash = NoiseTileCache::HashBytes(layersHash, &mShaderHash, sizeof(mShaderHash));
 }
 
 bool ProTerGen::VT::PageGpuGen_Sdh::LoadPage(MultiPage& readState)
-{	
+{
+	// Pages of a layer stack generated before, in this run or a previous one, skip the GPU.
+	static_assert(GenerationTextures::COUNT == 1, "The page cache only keeps the Sdh texture.");
+	const size_t index = (size_t)GenerationTextures::NORMAL_HEIGHTMAP;
+	const uint32_t textureSize = mInfo->BorderedTileSize();
+	const size_t rowBytes = (size_t)textureSize * TEXTURES_BYTES_PER_TEXEL()[index];
+	const size_t alignedRowPitch = Align(rowBytes, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
+	const NoiseTileKey key = { .LayerHash = mLayersHash.load(), .page = readState.page };
+	NoiseTileCache::tile_ptr cached = nullptr;
+	if (key.LayerHash != 0 && mPageCache.TryGet(key, rowBytes / sizeof(float) * textureSize, cached))
+	{
+		readState.dataPtrs[index] = AcquirePageBuffer((uint32_t)index, mPageBuffers[index]);
+		uint8_t* data = (uint8_t*)readState.dataPtrs[index].Data();
+		for (uint32_t y = 0; y < textureSize; ++y)
+		{
+			memcpy(data + alignedRowPitch * y, (const uint8_t*)cached->data() + rowBytes * y, rowBytes);
+		}
+	}
+	else
+	{
+		GeneratePage(readState);
+
+		// Not cached when the layers changed while the page was generated: it may mix both stacks.
+		if (key.LayerHash != 0 && key.LayerHash == mLayersHash.load())
+		{
+			std::shared_ptr<std::vector<float>> tile = std::make_shared<std::vector<float>>(rowBytes / sizeof(float) * textureSize);
+			const uint8_t* data = (const uint8_t*)readState.dataPtrs[index].Data();
+			for (uint32_t y = 0; y < textureSize; ++y)
+			{
+				memcpy((uint8_t*)tile->data() + rowBytes * y, data + alignedRowPitch * y, rowBytes);
+			}
+			mPageCache.Add(key, tile);
+		}
+	}
+
+	if (mShowBordersEnabled)
+	{
+		ColorBorders
+		(
+			readState.dataPtrs[index].Data(),
+			std::array<float, TEXTURES_BYTES_PER_TEXEL()[index] / sizeof(float)>{ 0.0f, 1.0f, 0.0f, 1.0f }, 
+			mInfo->TileSize(),
+			mInfo->BorderSize, 
+			alignedRowPitch / sizeof(float)
+		);
+	}
+	return true;
+}
+
+void ProTerGen::VT::PageGpuGen_Sdh::GeneratePage(MultiPage& readState)
+{
 	auto& pipeline = mComputeContext->pipeline;
 	auto& descriptorHeaps = mComputeContext->descriptorHeaps;
 	auto& materials = mComputeContext->materials;
@@ -695,7 +773,6 @@ bool ProTerGen::VT::PageGpuGen_Sdh::LoadPage(MultiPage& readState)
 	ThrowIfFailed(pipeline.CommandList->Reset(pipeline.CommandAllocator.Get(), pipeline.PSOs[(uint32_t)PSOs::HEIGHT].Get()));
 
 	// Copy image to buffer
-	readState.dataPtrs.resize(GenerationTextures::COUNT);
 	void* data = nullptr;
 	for (uint32_t i = 0; i < GenerationTextures::COUNT; ++i)
 	{
@@ -703,28 +780,12 @@ bool ProTerGen::VT::PageGpuGen_Sdh::LoadPage(MultiPage& readState)
 		const size_t alignedWidth = Align((size_t)textureSize * textureBytesPerTexel[i], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
 		const size_t totalSize = alignedWidth * (textureSize);
 		
-		readState.dataPtrs[i] = malloc(totalSize);
-		assert(readState.dataPtrs[i] != nullptr && "Not enough memory to complete operation");
+		readState.dataPtrs[i] = AcquirePageBuffer(i, mPageBuffers[i]);
 		const D3D12_RANGE range = { .Begin = 0, .End = totalSize };
 		ThrowIfFailed(texture->UploadHeap->Map(0, &range, &data));
-		memcpy(readState.dataPtrs[i], data, totalSize);
+		memcpy(readState.dataPtrs[i].Data(), data, totalSize);
 		texture->UploadHeap->Unmap(0, nullptr);
 	}
-
-	if (mShowBordersEnabled)
-	{
-		const size_t index = (size_t)GenerationTextures::NORMAL_HEIGHTMAP;
-		const size_t alignedRowPitch = Align((size_t)textureSize * TEXTURES_BYTES_PER_TEXEL()[index], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1);
-		ColorBorders
-		(
-			readState.dataPtrs[index],
-			std::array<float, TEXTURES_BYTES_PER_TEXEL()[index] / sizeof(float)>{ 0.0f, 1.0f, 0.0f, 1.0f }, 
-			mInfo->TileSize(),
-			mInfo->BorderSize, 
-			alignedRowPitch / sizeof(float)
-		);
-	}
-	return true;
 }
 
 void ProTerGen::VT::PageGpuGen_Sdh::OnProcessingComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& page)
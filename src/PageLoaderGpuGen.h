@@ -2,6 +2,7 @@
 
 #include "VirtualTextureCommon.h"
 
+#include <atomic>
 #include <functional>
 #include <condition_variable>
 #include <mutex>
@@ -9,6 +10,7 @@
 #include <memory>
 
 #include "PageThread.h"
+#include "NoiseTileCache.h"
 #include "GpuBatches.h"
 #include "Shaders.h"
 #include "Materials.h"
@@ -77,12 +79,28 @@ namespace ProTerGen
 
 			virtual bool IsShowBordersEnabled() const = 0;
 			virtual void EnableShowBorders(bool value) = 0;
+
+			// Staging rings of the atlas, one per texture. Pages are loaded straight into them while they have
+			// room. Set before the first Submit.
+			inline void StagingRings(const std::array<StagingRing*, MultiPage::MAX_TEXTURES>& rings) { mStagingRings = rings; }
 		protected:
 			virtual bool LoadPage(MultiPage& readState) = 0;
 			virtual void OnProcessingComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& page) = 0;
 
+			// A slice of the staging ring of the texture, or a buffer of the pool when the ring is full or not set.
+			PageBuffer AcquirePageBuffer(uint32_t texture, PageBufferPool& pool) const
+			{
+				StagingRing* ring = mStagingRings[texture];
+				if (ring && ring->SliceSize() >= pool.BufferSize())
+				{
+					PageBuffer buffer = ring->Acquire();
+					if (buffer) return buffer;
+				}
+				return pool.Acquire();
+			}
+
 			template<typename T, size_t _Size> 
-			void ColorBorders(void*& data, const std::array<T, _Size>& color, uint32_t tileSize, uint32_t borderSize, size_t alignedRowPitch) const
+			void ColorBorders(void* data, const std::array<T, _Size>& color, uint32_t tileSize, uint32_t borderSize, size_t alignedRowPitch) const
 			{
 				const size_t offsetHBytes = alignedRowPitch * borderSize;
 				const size_t offsetVBytes = (size_t)borderSize * _Size;
@@ -122,6 +140,8 @@ namespace ProTerGen
 				}
 			}
 
+		private:
+			std::array<StagingRing*, MultiPage::MAX_TEXTURES> mStagingRings = {};
 		};
 
 		class PageGpuGen_HNC;
@@ -136,6 +156,7 @@ namespace ProTerGen
 
 		class PageGpuGen_HNC : public GpuPageGenerator<PageGpuGen_HNC>
 		{
+			static_assert(GenerationTextures::COUNT <= MultiPage::MAX_TEXTURES);
 		public:
 				
 			static constexpr uint32_t _TEXTURES_COUNT() { return GenerationTextures::COUNT; }
@@ -213,6 +234,7 @@ namespace ProTerGen
 			const VTDesc* mInfo = nullptr;
 			std::unique_ptr<ComputeContext> mComputeContext = nullptr;
 			
+			std::array<PageBufferPool, GenerationTextures::COUNT> mPageBuffers; // Outlive the pages queued in mPageThread.
 			PageThread<MultiPage> mPageThread;
 
 			load_complete_f mOnLoadComplete
@@ -304,6 +326,8 @@ namespace ProTerGen
 			void OnProcessingComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage& page);
 
 		private:
+			void GeneratePage(MultiPage& readState);
+
 			bool mShowBordersEnabled = false;
 			uint32_t mTilesPerDispatch = 0;
 
@@ -311,7 +335,14 @@ namespace ProTerGen
 			const VTDesc* mInfo = nullptr;
 			std::unique_ptr<ComputeContext> mComputeContext = nullptr;
 			size_t mLayerCount = 1;
+			uint64_t mShaderHash = 0; // Of the bytecode of both compute passes.
+			std::atomic<uint64_t> mLayersHash = 0; // NoiseTileCache::HashLayers of the layers set and mShaderHash, 0 before any.
+			// Whole blended pages, before the borders are colored. The height pass accumulates every layer in one
+			// texture, so a page is only reused with the exact same stack: changing one layer or weight regenerates
+			// the pages. Reuse of single layers needs the CPU path (gCpuTerrainPages).
+			NoiseTileCache mPageCache;
 			
+			std::array<PageBufferPool, GenerationTextures::COUNT> mPageBuffers; // Outlive the pages queued in mPageThread.
 			PageThread<MultiPage> mPageThread;
 
 			load_complete_f mOnLoadComplete
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CommonHeaders.h"
+#include <atomic>
 #include <functional>
 #include <condition_variable>
 #include <mutex>
@@ -26,8 +28,10 @@ namespace ProTerGen
 			void OnRun(const std::function<bool(T&)>& function) { mOnRun = function; }
 			void OnComplete(const std::function<void(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const T&)>& function) { mOnComplete = function; }
 
+			// Elements accepted until their completion is handled. Both rings are allocated here, once; call it before Init.
 			void MaxQueueSize(size_t newSize)
 			{
+				mMaxQueued = newSize;
 				mActionQueue.SetMaxSize(newSize);
 				mCompleteQueue.SetMaxSize(newSize);
 			}
@@ -58,6 +62,7 @@ namespace ProTerGen
 					}
 
 					mOnRun(element);
+					// Never full: no more elements are accepted than fit in it.
 					mCompleteQueue.Enqueue(element);
 					mSemaphore.fetch_add(-1);
 				}
@@ -72,19 +77,39 @@ namespace ProTerGen
 					{
 						break;
 					}
+					mQueued.fetch_sub(1);
 					mOnComplete(commandList, element);
 				}
 			}
 
 			void Enqueue(T& value)
 			{
-				if (mActionQueue.Enqueue(value))
+				if (mQueued.fetch_add(1) >= mMaxQueued)
 				{
-					mSemaphore.fetch_add(1);
-					mCond.notify_one();
+					mQueued.fetch_sub(1);
+					return;
 				}
+				if (!mActionQueue.Enqueue(value))
+				{
+					mQueued.fetch_sub(1);
+					return;
+				}
+				mSemaphore.fetch_add(1);
+				mCond.notify_one();
+			}
+
+			// Drops the pending and the completed elements without stopping the thread. The element being
+			// processed, if any, finishes first and is dropped as well.
+			void Clear()
+			{
+				std::lock_guard<std::mutex> lg(mMutex);
+				T element = {};
+				while (mActionQueue.TryDequeue(element)) { mQueued.fetch_sub(1); }
+				while (mCompleteQueue.TryDequeue(element)) { mQueued.fetch_sub(1); }
 			}
 
+			inline bool IsRunning() const { return mIsRunning.load(); }
+
 			void Dispose() noexcept
 			{
 				mIsRunning.store(false);
@@ -106,6 +131,8 @@ namespace ProTerGen
 			std::atomic_int mSemaphore = 0;
 			std::mutex mMutex;
 
+			size_t mMaxQueued = 0;
+			std::atomic<size_t> mQueued = 0;
 			NBConcurrentQueue<T> mActionQueue;
 			NBConcurrentQueue<T> mCompleteQueue;
 		};
@@ -60,6 +60,22 @@ void ProTerGen::RenderSystem::Render(const RenderContext& ctx)
 
 		ctx.CommandList->SetGraphicsRootConstantBufferView(0, objCBAddress);
 
+		if (mLoc.DrawRanges != nullptr)
+		{
+			for (const SubmeshParameters& range : *mLoc.DrawRanges)
+			{
+				ctx.CommandList->DrawIndexedInstanced
+				(
+					(uint32_t)range.IndexCount,
+					1,
+					(uint32_t)range.StartIndexLocation,
+					(int32_t)range.BaseVertexLocation,
+					0
+				);
+			}
+			continue;
+		}
+
 		ctx.CommandList->DrawIndexedInstanced
 		(
 			(uint32_t)mLoc.MeshRenderValues.IndexCount,
@@ -10,6 +10,11 @@ Microsoft::WRL::ComPtr<ID3D12PipelineState> ProTerGen::Shaders::GetPSO(const std
 	return mPSOs.at(name);
 }
 
+Microsoft::WRL::ComPtr<ID3DBlob> ProTerGen::Shaders::GetShaderBlob(const std::string& name) const
+{
+	return mShaders.at(name).Blob;
+}
+
 void ProTerGen::Shaders::CreateRootSignature(const std::string& name)
 {
 	if (mRootSignatures.count(name) < 1)
@@ -25,6 +25,7 @@ namespace ProTerGen
 
       Microsoft::WRL::ComPtr<ID3D12RootSignature> GetRootSignature(const std::string& name) const;
       Microsoft::WRL::ComPtr<ID3D12PipelineState> GetPSO(const std::string& name);
+      Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob(const std::string& name) const;
 
       void CreateRootSignature(const std::string& name);
       void AddTableToRootSignature
@@ -0,0 +1,68 @@
+#pragma once
+
+// SSE2 float math shared by the noise batches. Only on x64, where SSE2 is always available.
+#if defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+
+namespace ProTerGen
+{
+	namespace SseMath
+	{
+		inline __m128 Floor4(__m128 x)
+		{
+			// Truncation is only valid below 2^23, where floats can still have a fractional part.
+			const __m128 t       = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+			const __m128 floored = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+			const __m128 small   = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), _mm_set1_ps(8388608.0f));
+			return _mm_or_ps(_mm_and_ps(small, floored), _mm_andnot_ps(small, x));
+		}
+
+		// Cephes logf/expf polynomials, good to a few ulp for the range of the Voronoi weights (0, 1].
+		inline __m128 Log4(__m128 x)
+		{
+			const __m128i bits = _mm_castps_si128(x);
+			__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+			__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000)));
+
+			const __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+			e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+			m = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(small, m)), _mm_set1_ps(1.0f));
+
+			const __m128 z = _mm_mul_ps(m, m);
+			__m128 y = _mm_set1_ps(7.0376836292E-2f);
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.1514610310E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(1.1676998740E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.2420140846E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(1.4249322787E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.6668057665E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(2.0000714765E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-2.4999993993E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(3.3333331174E-1f));
+			y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+			y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+			y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+			return _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+		}
+
+		inline __m128 Exp4(__m128 x)
+		{
+			x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+			const __m128 fx = Floor4(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f)));
+			x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+			x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+			const __m128 z = _mm_mul_ps(x, x);
+			__m128 y = _mm_set1_ps(1.9875691500E-4f);
+			y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507E-3f));
+			y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073E-3f));
+			y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894E-2f));
+			y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459E-1f));
+			y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201E-1f));
+			y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1.0f));
+
+			const __m128i pow2 = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23);
+			return _mm_mul_ps(y, _mm_castsi128_ps(pow2));
+		}
+	}
+}
+#endif
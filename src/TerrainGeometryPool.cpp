@@ -0,0 +1,152 @@
+#include "TerrainGeometryPool.h"
+#include <cassert>
+
+void ProTerGen::TerrainGeometryPool::Init(uint32_t slotCount, uint32_t verticesPerSlot, uint32_t indicesPerSlot)
+{
+	mSlotCount       = slotCount;
+	mVerticesPerSlot = verticesPerSlot;
+	mIndicesPerSlot  = indicesPerSlot;
+	mIndexFormat     = GetIndexFormat(verticesPerSlot);
+
+	mSlots.clear();
+	mSlots.resize(slotCount);
+	mFreeSlots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		// Reversed so the lower slots are handed out first.
+		mFreeSlots[i] = slotCount - 1 - i;
+	}
+	for (uint32_t f = 0; f < gNumFrames; ++f)
+	{
+		mDirty[f].clear();
+		mIsDirty[f].assign(slotCount, false);
+		mMappedVertices[f] = nullptr;
+		mMappedIndices[f]  = nullptr;
+	}
+}
+
+void ProTerGen::TerrainGeometryPool::Dispose()
+{
+	mSlots.clear();
+	mFreeSlots.clear();
+	for (uint32_t f = 0; f < gNumFrames; ++f)
+	{
+		mDirty[f].clear();
+		mIsDirty[f].clear();
+		mMappedVertices[f] = nullptr;
+		mMappedIndices[f]  = nullptr;
+	}
+	mSlotCount = 0;
+}
+
+uint32_t ProTerGen::TerrainGeometryPool::Acquire()
+{
+	if (mFreeSlots.empty()) return INVALID_SLOT;
+	const uint32_t slot = mFreeSlots.back();
+	mFreeSlots.pop_back();
+	return slot;
+}
+
+void ProTerGen::TerrainGeometryPool::Release(uint32_t slot)
+{
+	assert(slot < mSlotCount);
+	mSlots[slot].Vertices.clear();
+	mSlots[slot].Indices.clear();
+	mFreeSlots.push_back(slot);
+}
+
+void ProTerGen::TerrainGeometryPool::Write(uint32_t slot, TerrainMesh&& mesh)
+{
+	assert(slot < mSlotCount);
+	assert(mesh.Vertices.size() <= mVerticesPerSlot && mesh.Indices.size() <= mIndicesPerSlot);
+	mSlots[slot] = std::move(mesh);
+	MarkDirty(slot);
+}
+
+size_t ProTerGen::TerrainGeometryPool::Upload(Microsoft::WRL::ComPtr<ID3D12Device> device, uint32_t frame, MeshGpu& meshGpu)
+{
+	if (mMappedVertices[frame] == nullptr)
+	{
+		CreateBuffers(device, frame, meshGpu);
+	}
+
+	const size_t indexStride = GetIndexByteStride(mIndexFormat);
+	size_t copied = 0;
+	for (uint32_t slot : mDirty[frame])
+	{
+		const TerrainMesh& mesh = mSlots[slot];
+		uint8_t* vertexDst = mMappedVertices[frame] + (size_t)slot * mVerticesPerSlot * sizeof(TerrainVertex);
+		uint8_t* indexDst  = mMappedIndices[frame]  + (size_t)slot * mIndicesPerSlot  * indexStride;
+		memcpy(vertexDst, mesh.Vertices.data(), mesh.Vertices.size() * sizeof(TerrainVertex));
+		WriteIndices(indexDst, mesh.Indices.data(), mesh.Indices.size(), mIndexFormat);
+		copied += mesh.Vertices.size() * sizeof(TerrainVertex) + mesh.Indices.size() * indexStride;
+		mIsDirty[frame][slot] = false;
+	}
+	mDirty[frame].clear();
+	return copied;
+}
+
+ProTerGen::SubmeshParameters ProTerGen::TerrainGeometryPool::GetRange(uint32_t slot) const
+{
+	return SubmeshParameters
+	{
+		.IndexCount         = mSlots[slot].Indices.size(),
+		.StartIndexLocation = (size_t)slot * mIndicesPerSlot,
+		.BaseVertexLocation = (size_t)slot * mVerticesPerSlot,
+	};
+}
+
+void ProTerGen::TerrainGeometryPool::CreateBuffers(Microsoft::WRL::ComPtr<ID3D12Device> device, uint32_t frame, MeshGpu& meshGpu)
+{
+	meshGpu.VertexByteStride     = sizeof(TerrainVertex);
+	meshGpu.VertexBufferByteSize = (size_t)mSlotCount * mVerticesPerSlot * sizeof(TerrainVertex);
+	meshGpu.IndexFormat          = mIndexFormat;
+	meshGpu.IndexBufferByteSize  = (size_t)mSlotCount * mIndicesPerSlot * GetIndexByteStride(mIndexFormat);
+
+	CD3DX12_HEAP_PROPERTIES heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	CD3DX12_RESOURCE_DESC resDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.VertexBufferByteSize);
+	ThrowIfFailed(device->CreateCommittedResource
+	(
+		&heapProps,
+		D3D12_HEAP_FLAG_NONE,
+		&resDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(meshGpu.VertexBufferGPU.ReleaseAndGetAddressOf())
+	));
+	meshGpu.VertexBufferGPU->SetName((L"TerrainGeometryPool_VertexBuffer_" + std::to_wstring(frame)).c_str());
+
+	resDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.IndexBufferByteSize);
+	ThrowIfFailed(device->CreateCommittedResource
+	(
+		&heapProps,
+		D3D12_HEAP_FLAG_NONE,
+		&resDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(meshGpu.IndexBufferGPU.ReleaseAndGetAddressOf())
+	));
+	meshGpu.IndexBufferGPU->SetName((L"TerrainGeometryPool_IndexBuffer_" + std::to_wstring(frame)).c_str());
+
+	// Upload heap buffers stay mapped for the lifetime of the resource.
+	ThrowIfFailed(meshGpu.VertexBufferGPU->Map(0, nullptr, reinterpret_cast<void**>(&mMappedVertices[frame])));
+	ThrowIfFailed(meshGpu.IndexBufferGPU->Map(0, nullptr, reinterpret_cast<void**>(&mMappedIndices[frame])));
+
+	// A new buffer has none of the slots already written for the other frames.
+	mDirty[frame].clear();
+	for (uint32_t slot = 0; slot < mSlotCount; ++slot)
+	{
+		mIsDirty[frame][slot] = !mSlots[slot].Vertices.empty();
+		if (mIsDirty[frame][slot]) mDirty[frame].push_back(slot);
+	}
+}
+
+void ProTerGen::TerrainGeometryPool::MarkDirty(uint32_t slot)
+{
+	for (uint32_t f = 0; f < gNumFrames; ++f)
+	{
+		if (mIsDirty[f][slot]) continue;
+		mIsDirty[f][slot] = true;
+		mDirty[f].push_back(slot);
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include "CommonHeaders.h"
+#include "Config.h"
+#include "Mesh.h"
+#include "TerrainVertex.h"
+
+namespace ProTerGen
+{
+	// Fixed size geometry slots for terrain chunks. Every loaded chunk owns a slot until it is released, and
+	// each frame in flight keeps its own persistently mapped buffers that only receive the slots written since
+	// that frame was last uploaded. Not thread safe: callers must serialize Write/Release with Upload.
+	class TerrainGeometryPool
+	{
+	public:
+		static constexpr uint32_t INVALID_SLOT = 0xFFFFFFFF;
+
+		TerrainGeometryPool() = default;
+		virtual ~TerrainGeometryPool() = default;
+
+		void Init(uint32_t slotCount, uint32_t verticesPerSlot, uint32_t indicesPerSlot);
+		void Dispose();
+
+		uint32_t Acquire();
+		void     Release(uint32_t slot);
+		void     Write(uint32_t slot, TerrainMesh&& mesh);
+
+		// Copies the dirty slots of this frame into the frame buffers, creating them on first use. Returns the copied bytes.
+		size_t Upload(Microsoft::WRL::ComPtr<ID3D12Device> device, uint32_t frame, MeshGpu& meshGpu);
+
+		SubmeshParameters GetRange(uint32_t slot) const;
+
+		inline uint32_t GetSlotCount() const { return mSlotCount; }
+		inline uint32_t GetVerticesPerSlot() const { return mVerticesPerSlot; }
+		inline uint32_t GetIndicesPerSlot() const { return mIndicesPerSlot; }
+		inline size_t   GetFreeCount() const { return mFreeSlots.size(); }
+	protected:
+		void CreateBuffers(Microsoft::WRL::ComPtr<ID3D12Device> device, uint32_t frame, MeshGpu& meshGpu);
+		void MarkDirty(uint32_t slot);
+
+		uint32_t    mSlotCount       = 0;
+		uint32_t    mVerticesPerSlot = 0;
+		uint32_t    mIndicesPerSlot  = 0;
+		DXGI_FORMAT mIndexFormat     = DXGI_FORMAT_R16_UINT;
+
+		std::vector<TerrainMesh> mSlots{};
+		std::vector<uint32_t>    mFreeSlots{};
+
+		std::array<std::vector<uint32_t>, gNumFrames> mDirty{};
+		std::array<std::vector<bool>, gNumFrames>     mIsDirty{};
+		std::array<uint8_t*, gNumFrames>              mMappedVertices{};
+		std::array<uint8_t*, gNumFrames>              mMappedIndices{};
+	};
+}
@@ -5,6 +5,8 @@
 
 namespace ProTerGen
 {
+    struct Material;
+
     static const uint32_t MAX_LAYERS = 8;
     enum class LayerDesc : uint8_t
     {
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "TerrainPageGenerator.h"
+#include "LayerNoise.h"
+#include "JobSystem.h"
+
+namespace
+{
+	// Rows of a page handed to each job.
+	constexpr uint32_t ROWS_PER_JOB = 4;
+	// Unblended layer tiles kept in memory before spilling to disk. Gradient layers keep three planes per tile.
+	constexpr size_t NOISE_CACHE_MEMORY_TILES = 192;
+	// Bytes of spilled layer tiles kept on disk, the least recently used ones are removed past it.
+	constexpr uint64_t NOISE_CACHE_DISK_BYTES = 4ull << 30;
+
+#if _DEBUG
+	// Startup check of the analytic gradient against the stencil it replaces, on a layer the stencil resolves.
+	constexpr float    VALIDATION_STEP      = 3e-4f;
+	constexpr uint32_t VALIDATION_SAMPLES   = 16;
+	constexpr float    VALIDATION_TOLERANCE = 0.01f; // Of the largest derivative.
+#endif
+
+	inline float Saturate(float v)
+	{
+		return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+	}
+
+	// Lattice cells per texel above which a layer is differenced instead, like Voronoi layers. The stencil of the
+	// GPU pass flattens finer octaves, and past this both gradients differ by more than a few percent.
+	constexpr float MAX_CELLS_PER_TEXEL = 1.0f / 32.0f;
+
+	inline ProTerGen::LayerFBMParams FBMParams(const ProTerGen::Layer& layer)
+	{
+		return ProTerGen::LayerFBMParams
+		{
+			.Amplitude = layer.amplitude,
+			.Frecuency = layer.frecuency,
+			.Gain      = layer.gain,
+			.Octaves   = layer.octaves,
+		};
+	}
+
+	// Height per texel of a plane with the stencil of SLOPE_DERIVATIVES. The taps are clamped to [0, size], and
+	// the texel at size is outside of the texture, which reads as 0.
+	inline void StencilGradient(const float* plane, uint32_t size, int32_t x, int32_t y, float& hx, float& hy)
+	{
+		const auto height = [&](int32_t tx, int32_t ty)
+			{
+				tx = std::clamp(tx, 0, (int32_t)size);
+				ty = std::clamp(ty, 0, (int32_t)size);
+				return (tx == (int32_t)size || ty == (int32_t)size) ? 0.0f : plane[(size_t)ty * size + tx];
+			};
+		const float heights[9] =
+		{
+			height(x - 1, y + 1), height(x, y + 1), height(x + 1, y + 1),
+			height(x - 1, y    ), height(x, y    ), height(x + 1, y    ),
+			height(x - 1, y - 1), height(x, y - 1), height(x + 1, y - 1),
+		};
+		const ProTerGen::TerrainSample s = ProTerGen::LayerNoise::SlopeAndDerivativesFiniteDifferences(heights, 1.0f);
+		hx = -s.Dx;
+		hy = -s.Dy;
+	}
+}
+
+void ProTerGen::VT::TerrainPageGenerator::Init(const VTDesc* info, const std::wstring& noiseCacheDirectory)
+{
+	mInfo = info;
+
+	JobSystem::Initialize();
+	mNoiseCache.Init(NOISE_CACHE_MEMORY_TILES, noiseCacheDirectory, NOISE_CACHE_DISK_BYTES);
+
+#if _DEBUG
+	const LayerNoiseValidation validation = LayerNoise::ValidateAgainstFiniteDifferences(LayerFBMParams{ .Octaves = 4 }, 1.0f, VALIDATION_STEP, VALIDATION_SAMPLES);
+	assert(validation.MaxDerivativeError <= VALIDATION_TOLERANCE * validation.MaxDerivative && "LayerNoise gradient disagrees with finite differences.");
+#endif
+}
+
+void ProTerGen::VT::TerrainPageGenerator::SetLayers(const std::vector<Layer>& layers)
+{
+	assert(layers.size() > 0);
+	std::lock_guard<std::mutex> lg(mLayersMutex);
+	mLayers.assign(layers.begin(), layers.begin() + std::clamp<size_t>(layers.size(), 1, MAX_LAYERS));
+}
+
+void ProTerGen::VT::TerrainPageGenerator::GeneratePage(const Page& page, void* data, size_t rowPitch) const
+{
+	std::vector<Layer> layers;
+	{
+		std::lock_guard<std::mutex> lg(mLayersMutex);
+		layers = mLayers;
+	}
+
+	// Same rect as the constant buffer of PageGpuGen_Sdh.
+	const uint32_t scaleFactor = 1 << page.Mip;
+	const float mipTileSize = (float)scaleFactor * mInfo->TileSize();
+	const float mipBorderSize = (float)scaleFactor * mInfo->BorderSize;
+	const float minX = (float)page.X * mipTileSize - mipBorderSize;
+	const float minY = (float)page.Y * mipTileSize - mipBorderSize;
+	const float maxX = minX + mipTileSize + 2 * mipBorderSize;
+	const float maxY = minY + mipTileSize + 2 * mipBorderSize;
+
+	const uint32_t textureSize = mInfo->BorderedTileSize();
+	const PageRect rect =
+	{
+		.MinX        = minX,
+		.MinY        = minY,
+		.ScaleX      = (maxX - minX) / (float)textureSize,
+		.ScaleY      = (maxY - minY) / (float)textureSize,
+		.TerrainSize = (float)mInfo->VTSize,
+		.Size        = textureSize,
+	};
+
+	std::vector<NoiseTileCache::tile_ptr> tiles(layers.size());
+	for (size_t l = 0; l < layers.size(); ++l)
+	{
+		tiles[l] = LayerPass(layers[l], page, rect);
+	}
+
+	BlendedHeight blended;
+	HeightPass(layers, tiles, rect, blended);
+	SlopePass(blended, textureSize, page.Mip, (uint8_t*)data, rowPitch);
+}
+
+ProTerGen::VT::NoiseTileCache::tile_ptr ProTerGen::VT::TerrainPageGenerator::LayerPass(const Layer& layer, const Page& page, const PageRect& rect) const
+{
+	// The unblended noise of the layer, taken from the cache when that layer and page were generated before.
+	// Gradient layers are followed by the planes of their derivatives with respect to the terrain uv.
+	const size_t texelCount = (size_t)rect.Size * rect.Size;
+	const bool analytic = HasAnalyticGradient(layer, rect);
+	const size_t planes = analytic ? 3 : 1;
+	const NoiseTileKey key = { .LayerHash = NoiseTileCache::HashLayer(layer, mInfo), .page = page };
+	NoiseTileCache::tile_ptr cached = nullptr;
+	if (mNoiseCache.TryGet(key, texelCount * planes, cached))
+	{
+		return cached;
+	}
+
+	// The batches dispatch on fbm.Octaves, layer.octaves, to the kernel built for that count.
+	const LayerFBMParams fbm = FBMParams(layer);
+	std::shared_ptr<std::vector<float>> tile = std::make_shared<std::vector<float>>(texelCount * planes);
+	JobSystem::Context ctx;
+	JobSystem::Dispatch(ctx, rect.Size, ROWS_PER_JOB, [&](JobSystem::JobDesc desc)
+		{
+			const uint32_t y = desc.JobIndex;
+			std::vector<float> xs(rect.Size);
+			std::vector<float> ys(rect.Size);
+			for (uint32_t x = 0; x < rect.Size; ++x)
+			{
+				xs[x] = (((float)x * rect.ScaleX) + rect.MinX) / rect.TerrainSize;
+				ys[x] = (((float)y * rect.ScaleY) + rect.MinY) / rect.TerrainSize;
+			}
+
+			const size_t offset = (size_t)y * rect.Size;
+			float* row = tile->data() + offset;
+			if (analytic)
+			{
+				LayerNoise::FBMTerrain(xs.data(), ys.data(), rect.Size, fbm, layer.seed, row, row + texelCount, row + 2 * texelCount);
+			}
+			else
+			{
+				LayerNoise::FBMTerrainVoronoi(xs.data(), ys.data(), rect.Size, fbm, layer.seed, row);
+			}
+		});
+	JobSystem::Wait(ctx);
+
+	mNoiseCache.Add(key, tile);
+	return tile;
+}
+
+bool ProTerGen::VT::TerrainPageGenerator::HasAnalyticGradient(const Layer& layer, const PageRect& rect)
+{
+	if (layer.layerDesc == LayerDesc::VORONOI)
+	{
+		return false;
+	}
+	const float texelStep = (rect.ScaleX > rect.ScaleY ? rect.ScaleX : rect.ScaleY) / rect.TerrainSize;
+	return LayerNoise::MaxFrequency(FBMParams(layer)) * texelStep <= MAX_CELLS_PER_TEXEL;
+}
+
+void ProTerGen::VT::TerrainPageGenerator::HeightPass(const std::vector<Layer>& layers, const std::vector<NoiseTileCache::tile_ptr>& tiles, const PageRect& rect, BlendedHeight& blended) const
+{
+	// Every layer blended over the previous one, like the HEIGHT dispatches. The blend is linear, so the gradient
+	// of the result is the same blend of the layer gradients, in height per texel.
+	const uint32_t size = rect.Size;
+	const size_t texelCount = (size_t)size * size;
+	const float texelToUvX = rect.ScaleX / rect.TerrainSize;
+	const float texelToUvY = rect.ScaleY / rect.TerrainSize;
+	blended.Heights.resize(texelCount);
+	blended.Hx.resize(texelCount);
+	blended.Hy.resize(texelCount);
+
+	JobSystem::Context ctx;
+	JobSystem::Dispatch(ctx, size, ROWS_PER_JOB, [&](JobSystem::JobDesc desc)
+		{
+			const int32_t y = (int32_t)desc.JobIndex;
+			const size_t offset = (size_t)y * size;
+			float* row = blended.Heights.data() + offset;
+			float* hxRow = blended.Hx.data() + offset;
+			float* hyRow = blended.Hy.data() + offset;
+			for (size_t l = 0; l < layers.size(); ++l)
+			{
+				const float* plane = tiles[l]->data();
+				const float* h = plane + offset;
+				const bool analytic = HasAnalyticGradient(layers[l], rect);
+				const float weight = Saturate(layers[l].weight);
+				for (uint32_t x = 0; x < size; ++x)
+				{
+					float hx = 0.0f;
+					float hy = 0.0f;
+					if (analytic)
+					{
+						hx = h[texelCount + x] * texelToUvX;
+						hy = h[2 * texelCount + x] * texelToUvY;
+					}
+					else
+					{
+						StencilGradient(plane, size, (int32_t)x, y, hx, hy);
+					}
+
+					const float prevH = l == 0 ? 0.0f : row[x];
+					const float prevHx = l == 0 ? 0.0f : hxRow[x];
+					const float prevHy = l == 0 ? 0.0f : hyRow[x];
+					row[x] = prevH + weight * (h[x] - prevH);
+					hxRow[x] = prevHx + weight * (hx - prevHx);
+					hyRow[x] = prevHy + weight * (hy - prevHy);
+				}
+			}
+		});
+	JobSystem::Wait(ctx);
+}
+
+void ProTerGen::VT::TerrainPageGenerator::SlopePass(const BlendedHeight& blended, uint32_t size, uint32_t mip, uint8_t* data, size_t rowPitch) const
+{
+	// SLOPE_DERIVATIVES from the blended gradient instead of differencing the 3x3 neighbourhood of every texel.
+	const float derivativeScale = (float)size / (float)(1 << mip);
+	JobSystem::Context ctx;
+	JobSystem::Dispatch(ctx, size, ROWS_PER_JOB, [&](JobSystem::JobDesc desc)
+		{
+			const size_t offset = (size_t)desc.JobIndex * size;
+			float* row = (float*)(data + rowPitch * desc.JobIndex);
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				const TerrainSample s = LayerNoise::SlopeAndDerivatives(blended.Heights[offset + x], blended.Hx[offset + x], blended.Hy[offset + x], derivativeScale);
+				row[TEXEL_CHANNELS * x + 0] = s.Slope;
+				row[TEXEL_CHANNELS * x + 1] = s.Dx;
+				row[TEXEL_CHANNELS * x + 2] = s.Dy;
+				row[TEXEL_CHANNELS * x + 3] = s.Height;
+			}
+		});
+	JobSystem::Wait(ctx);
+}
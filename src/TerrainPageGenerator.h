@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "VirtualTextureTypes.h"
+#include "TerrainLayer.h"
+#include "NoiseTileCache.h"
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		// The passes of PageGpuGen_Sdh on the CPU: the layers are evaluated with LayerNoise and blended, and the slope and
+		// derivatives come from the analytic gradient of the result. The texels are split by rows over the JobSystem. It does not depend on D3D,
+		// so pages can be generated headless; PageCpuGen_Sdh feeds it to the virtual texture.
+		// Each layer is cached before blending, so changing one layer or a weight only recomputes that layer.
+		class TerrainPageGenerator
+		{
+		public:
+			// Floats per texel: slope, derivatives (2) and height, like the R32G32B32A32 page of PageGpuGen_Sdh.
+			static constexpr uint32_t TEXEL_CHANNELS = 4;
+
+			// An empty noise cache directory keeps the layer tiles in memory only.
+			void Init(const VTDesc* info, const std::wstring& noiseCacheDirectory);
+
+			void SetLayers(const std::vector<Layer>& layers);
+
+			// Writes the BorderedTileSize() rows of the page, rowPitch bytes apart. Can be called from any thread.
+			void GeneratePage(const Page& page, void* data, size_t rowPitch) const;
+
+		private:
+			struct PageRect
+			{
+				float MinX        = 0.0f;
+				float MinY        = 0.0f;
+				float ScaleX      = 0.0f;
+				float ScaleY      = 0.0f;
+				float TerrainSize = 1.0f;
+				uint32_t Size     = 0;
+			};
+			struct BlendedHeight
+			{
+				std::vector<float> Heights;
+				std::vector<float> Hx; // Height per texel.
+				std::vector<float> Hy;
+			};
+
+			// Gradient layers fine enough for the texels of the page carry their analytic gradient; the others are
+			// differenced with the stencil of SLOPE_DERIVATIVES.
+			static bool HasAnalyticGradient(const Layer& layer, const PageRect& rect);
+			NoiseTileCache::tile_ptr LayerPass(const Layer& layer, const Page& page, const PageRect& rect) const;
+			void HeightPass(const std::vector<Layer>& layers, const std::vector<NoiseTileCache::tile_ptr>& tiles, const PageRect& rect, BlendedHeight& blended) const;
+			void SlopePass(const BlendedHeight& blended, uint32_t size, uint32_t mip, uint8_t* data, size_t rowPitch) const;
+
+			const VTDesc* mInfo = nullptr;
+
+			mutable std::mutex mLayersMutex;
+			std::vector<Layer> mLayers = { Layer{} };
+			mutable NoiseTileCache mNoiseCache;
+		};
+	}
+}
@@ -3,12 +3,25 @@
 #include "MathHelpers.h"
 #include "ParticleSystem.h"
 #include "Noiser.h"
+#include "MeshOptimizer.h"
 #if _DEBUG && PRINT_PERFORMANCE_TIMES
 #include "Timer.h"
 #endif
 
 const uint32_t NUM_VERTICES_PER_MINIMAL_PATCH_SIDE = 3;
 const uint32_t NUM_VERTICES_PER_MINIMAL_PATCH = NUM_VERTICES_PER_MINIMAL_PATCH_SIDE * NUM_VERTICES_PER_MINIMAL_PATCH_SIDE;
+const uint32_t NUM_INDICES_PER_MINIMAL_PATCH = (NUM_VERTICES_PER_MINIMAL_PATCH_SIDE - 1) * (NUM_VERTICES_PER_MINIMAL_PATCH_SIDE - 1) * 6;
+
+#if _DEBUG
+// Startup check of the compact vertex encoding for the settings of each terrain.
+const uint32_t TERRAIN_VERTEX_VALIDATION_SAMPLES = 1024;
+
+void ValidateTerrainVertexEncoding(const ProTerGen::TerrainSettings& settings)
+{
+	const ProTerGen::TerrainVertexQuantization quant{ .TerrainWidth = settings.TerrainWidth, .Height = settings.Height };
+	assert(ProTerGen::TerrainVertexRoundTripError(quant, TERRAIN_VERTEX_VALIDATION_SAMPLES) <= 1.0f && "TerrainVertex round trip off by more than a quantization step.");
+}
+#endif
 
 constexpr uint32_t ComputeMipIncrement(uint32_t index, ProTerGen::RQuadTreeTerrain::Border border, ProTerGen::RQuadTreeTerrain::Corner corner) 
 {
@@ -83,6 +96,10 @@ ProTerGen::Mesh ComputeChunksBasedOnFrontier(ProTerGen::RQuadTreeTerrain::Border
 		result.Indices = { 0,3,1,1,3,4,1,4,2,0,5,3,3,5,6,3,6,4 };
 		break;
 	}
+
+	// Only the indices are reordered: ComputeMipIncrement and the morph offsets rely on the vertex order.
+	MeshOptimizer optimizer{};
+	optimizer.OptimizeVertexCache(result.Indices, result.Vertices.size());
 	
 	return result;
 }
@@ -109,6 +126,11 @@ constexpr ProTerGen::Mesh GetMinimalQuad() noexcept
 
 #pragma region TerrainChunksAsyncSystem
 
+double ProTerGen::TerrainChunksAsyncSystem::sMetricUploadedBytesAcc = 0.0;
+size_t ProTerGen::TerrainChunksAsyncSystem::sMetricNumTimes         = 0;
+std::atomic<uint64_t> ProTerGen::TerrainChunksAsyncSystem::sMetricChunkNanosecondsAcc = 0;
+std::atomic<uint64_t> ProTerGen::TerrainChunksAsyncSystem::sMetricChunksBuilt         = 0;
+
 ProTerGen::TerrainChunksAsyncSystem::~TerrainChunksAsyncSystem()
 {
 	for (const ECS::Entity& entity : mEntities)
@@ -120,6 +142,11 @@ ProTerGen::TerrainChunksAsyncSystem::~TerrainChunksAsyncSystem()
 
 void ProTerGen::TerrainChunksAsyncSystem::Init()
 {
+	mNoise.Generate(1);
+	mSampler.Init(&mNoise);
+	mDetailNoise.Generate(1);
+	mDetailBatch.Init(&mDetailNoise);
+
 	for (const ECS::Entity& entity : mEntities)
 	{
 		for (uint32_t i = 0; i < gNumFrames; ++i)
@@ -127,11 +154,22 @@ void ProTerGen::TerrainChunksAsyncSystem::Init()
 			mMeshes.CreateNewMeshGpu(BuildUniqueId(entity, i));
 		}
 		TerrainChunksAsyncComponent& tc = mRegister->GetComponent<TerrainChunksAsyncComponent>(entity);
+#if _DEBUG
+		ValidateTerrainVertexEncoding(tc.TerrainSettings);
+#endif
 		for (const RQuadTreeTerrain::Border& b : RQuadTreeTerrain::GetBorders())
 		{
 			tc.Chunks[RQuadTreeTerrain::ToNumeral(b)] = ComputeChunksBasedOnFrontier(b);
 		}
-		tc.Loaded.OnRemove([&](Chunk c, TerrainChunksAsyncComponent::MeshIdx idx) { RemoveChunk(entity, c, idx); });
+		// One spare slot: a new chunk is written before adding it to the cache evicts the oldest one.
+		const uint32_t patchesPerChunk = tc.TerrainSettings.ChunksPerSideExp * tc.TerrainSettings.ChunksPerSideExp;
+		tc.Geometry.Init
+		(
+			MAX_CHUNKS + 1,
+			patchesPerChunk * NUM_VERTICES_PER_MINIMAL_PATCH,
+			patchesPerChunk * NUM_INDICES_PER_MINIMAL_PATCH
+		);
+		tc.Loaded.OnRemove([this, entity](Chunk c, TerrainChunksAsyncComponent::Slot slot) { RemoveChunk(entity, c, slot); });
 		tc.Loaded.Resize(MAX_CHUNKS);
 		tc.Thread = std::make_unique<VT::PageThread<ChunkInfo>>();
 		tc.Thread->MaxQueueSize((size_t)MAX_CHUNKS * 2);
@@ -162,66 +200,27 @@ void ProTerGen::TerrainChunksAsyncSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3
 		TerrainChunksAsyncComponent& tc = mRegister->GetComponent<TerrainChunksAsyncComponent>(entity);
 		MeshGpu& mGpu = mMeshes.GetMeshGpu(BuildUniqueId(entity, currentFrame));
 		MeshRendererComponent& mRC = mRegister->GetComponent<MeshRendererComponent>(entity);
-		
-		Mesh finalMesh = {};
+
+		// Only the slots written since this frame buffers were last used are copied.
 		std::unique_lock lo(mMutex);
-		for (auto& [c, it] : tc.Loaded.Items())
+		sMetricUploadedBytesAcc += (double)tc.Geometry.Upload(device, currentFrame, mGpu);
+		++sMetricNumTimes;
+
+		mGpu.DrawRanges.clear();
+		for (const Chunk& c : tc.Requested)
 		{
-			if (!tc.Requested.contains(c.GetHash())) continue;
-			Mesh& chunk = *it;
-			finalMesh.Indices.insert(finalMesh.Indices.end(), chunk.Indices.begin(), chunk.Indices.end());
-			for (size_t i = 0; i < chunk.Indices.size(); ++i)
+			TerrainChunksAsyncComponent::Slot slot = TerrainGeometryPool::INVALID_SLOT;
+			if (tc.Loaded.TryGet(c, slot, false))
 			{
-				finalMesh.Indices[finalMesh.Indices.size() - 1 - i] += (uint32_t)finalMesh.Vertices.size();
+				mGpu.DrawRanges.push_back(tc.Geometry.GetRange(slot));
 			}
-			finalMesh.Vertices.insert(finalMesh.Vertices.end(), chunk.Vertices.begin(), chunk.Vertices.end());
 		}
 		lo.unlock();
 
-		if (finalMesh.Indices.size() == 0) finalMesh.Indices.push_back(0);
-		if (finalMesh.Vertices.size() == 0) finalMesh.Vertices.push_back(Vertex{});
-				
-		CD3DX12_HEAP_PROPERTIES heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC resDesc = CD3DX12_RESOURCE_DESC::Buffer(finalMesh.Indices.size() * sizeof(Index));
-		ThrowIfFailed(device->CreateCommittedResource
-		(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(mGpu.IndexBufferGPU.ReleaseAndGetAddressOf())
-		));
-		mGpu.IndexBufferGPU->SetName((L"Terrain_" + std::to_wstring(entity) + L"_IndexBuffer").c_str());
-		
-		resDesc = CD3DX12_RESOURCE_DESC::Buffer(finalMesh.Vertices.size() * sizeof(Vertex));
-		ThrowIfFailed(device->CreateCommittedResource
-		(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(mGpu.VertexBufferGPU.ReleaseAndGetAddressOf())
-		));
-		mGpu.VertexBufferGPU->SetName((L"Terrain_" + std::to_wstring(entity) + L"_VertexBuffer").c_str());
-
-		mGpu.IndexBufferByteSize = finalMesh.Indices.size() * sizeof(Index);
-		mGpu.VertexBufferByteSize = finalMesh.Vertices.size() * sizeof(Vertex);
-		mGpu.SubMesh[""].IndexCount = finalMesh.Indices.size();
-		mGpu.VertexByteStride = sizeof(Vertex);
-
-		void* indexPointer = nullptr;
-		void* vertexPointer = nullptr;
-		ThrowIfFailed(mGpu.IndexBufferGPU->Map(0, nullptr, &indexPointer));
-		ThrowIfFailed(mGpu.VertexBufferGPU->Map(0, nullptr, &vertexPointer));
-		
-		memcpy(indexPointer, finalMesh.Indices.data(), finalMesh.Indices.size() * sizeof(Index));
-		memcpy(vertexPointer, finalMesh.Vertices.data(), finalMesh.Vertices.size() * sizeof(Vertex));
+		std::sort(mGpu.DrawRanges.begin(), mGpu.DrawRanges.end(),
+			[](const SubmeshParameters& a, const SubmeshParameters& b) { return a.StartIndexLocation < b.StartIndexLocation; });
+		mGpu.SubMesh[""].IndexCount = 0;
 
-		mGpu.IndexBufferGPU->Unmap(0, nullptr);
-		mGpu.VertexBufferGPU->Unmap(0, nullptr);
-		
 		mRC.MeshGpuLocation = BuildUniqueId(entity, currentFrame);
 	}
 }
@@ -230,6 +229,7 @@ void ProTerGen::TerrainChunksAsyncSystem::OnEntityRemoved(ECS::Entity entity)
 {
 	TerrainChunksAsyncComponent& tc = mRegister->GetComponent<TerrainChunksAsyncComponent>(entity);
 	tc.Thread->Dispose();
+	tc.Geometry.Dispose();
 }
 
 
@@ -270,15 +270,15 @@ void ProTerGen::TerrainChunksAsyncSystem::RequestMesh(const std::vector<RQuadTre
 			.border = (uint8_t)qt->GetBorder(),
 			.corner = (uint8_t)0
 		};
-		TerrainChunksAsyncComponent::MeshIdx idx;
+		TerrainChunksAsyncComponent::Slot slot;
 		std::unique_lock lo(mMutex);
-		if (!tc.Loaded.TryGet(c, idx, true))
+		if (!tc.Loaded.TryGet(c, slot, true))
 		{
 			ChunkInfo ci(c, &tc);
 			tc.Thread->Enqueue(ci);
 		}
 		lo.unlock();
-		tc.Requested.insert(c.GetHash());
+		tc.Requested.push_back(c);
 	}
 }
 
@@ -295,9 +295,32 @@ bool ProTerGen::TerrainChunksAsyncSystem::ProcessGeometryFromHeightData(ChunkInf
 
 	const float minX = ((float)c.x * tc.TerrainSettings.TerrainWidth / chunkCount) - halfSize;
 	const float minY = ((float)c.y * tc.TerrainSettings.TerrainWidth / chunkCount) - halfSize;
-	PerlinNoise n = PerlinNoise();
-	n.Generate(1);
-	Mesh m{};
+	const TerrainVertexQuantization quant{ .TerrainWidth = tc.TerrainSettings.TerrainWidth, .Height = tc.TerrainSettings.Height };
+	const auto start = std::chrono::steady_clock::now();
+
+	// Patch templates only have vertices at 0, 0.5 and 1, so the whole chunk lies on a grid of half patches
+	// that is sampled once in batches instead of once per (shared) vertex.
+	const uint32_t gridSide = 2 * maxLod + 1;
+	const float gridStep = 0.5f * minScale;
+	std::vector<float> heights((size_t)gridSide * gridSide);
+	mSampler.SampleGrid((halfSize + minX) * invHalfSize, (halfSize + minY) * invHalfSize, gridStep * invHalfSize, gridSide, gridSide, mHeightFBM, heights.data());
+	if (tc.TerrainSettings.DetailHeight > 0.0f)
+	{
+		// The origin of the chunk in world units, in double, so far chunks keep the offsets of their samples.
+		const double worldMinX = (double)c.x * tc.TerrainSettings.TerrainWidth / chunkCount - halfSize;
+		const double worldMinY = (double)c.y * tc.TerrainSettings.TerrainWidth / chunkCount - halfSize;
+		const double cellsPerUnit = 1.0 / tc.TerrainSettings.DetailWavelength;
+		std::vector<float> detail(heights.size());
+		mDetailBatch.FBMGrid(worldMinX * cellsPerUnit, worldMinY * cellsPerUnit, gridStep * cellsPerUnit, gridSide, gridSide, mDetailFBM, detail.data());
+
+		const float detailScale = tc.TerrainSettings.DetailHeight / tc.TerrainSettings.Height;
+		for (size_t i = 0; i < heights.size(); ++i)
+		{
+			heights[i] = ProTerGen_clamp(0.0f, 1.0f, heights[i] + (detail[i] - 0.5f) * detailScale);
+		}
+	}
+
+	TerrainMesh m{};
 	for (size_t y = 0; y < maxLod; ++y)
 	{
 		for (size_t x = 0; x < maxLod; ++x)
@@ -315,6 +338,8 @@ bool ProTerGen::TerrainChunksAsyncSystem::ProcessGeometryFromHeightData(ChunkInf
 			for (size_t i = 0; i < d.Vertices.size(); ++i)
 			{
 				Vertex& v = d.Vertices[i];
+				const size_t gx = (size_t)std::lround(v.Position.x * 2.0f) + 2 * x;
+				const size_t gy = (size_t)std::lround(v.Position.z * 2.0f) + 2 * y;
 				v.Position.x = v.Position.x * minScale + x * minScale + minX;
 				v.Position.z = v.Position.z * minScale + y * minScale + minY;
 
@@ -324,43 +349,63 @@ bool ProTerGen::TerrainChunksAsyncSystem::ProcessGeometryFromHeightData(ChunkInf
 				v.TexC.x = (halfSize + v.Position.x) * invHalfSize;
 				v.TexC.y = (halfSize + v.Position.z) * invHalfSize;
 
-				// TODO: process noise
-				v.Position.y = (float)n.FBM(v.TexC.x, v.TexC.y, 6, 1.0f, 0.6f) * tc.TerrainSettings.Height - (tc.TerrainSettings.Height / 2);
+				v.Position.y = heights[gy * gridSide + gx] * tc.TerrainSettings.Height - (tc.TerrainSettings.Height / 2);
 				//v.Position.y = 15.0f * ((float)y * maxLod + x);
 			}
 			for (size_t i = 0; i < d.Indices.size(); ++i)
 			{
 				d.Indices[i] += (uint32_t)m.Vertices.size();
 			}
-			m.Vertices.insert(m.Vertices.end(), d.Vertices.begin(), d.Vertices.end());
+			for (const Vertex& v : d.Vertices)
+			{
+				m.Vertices.push_back(EncodeTerrainVertex(v, quant, (uint8_t)b));
+			}
 			m.Indices.insert(m.Indices.end(), d.Indices.begin(), d.Indices.end());
 		}
 	}
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	sMetricChunkNanosecondsAcc += (uint64_t)elapsed.count();
+	++sMetricChunksBuilt;
+
 	std::unique_lock lo(mMutex, std::defer_lock);
 	if(&mMutex != nullptr && !lo.try_lock_for(std::chrono::milliseconds(1000))) return false;
-	TerrainChunksAsyncComponent::MeshIdx idx;
-	if (tc.Loaded.TryGet(c, idx, false)) return false;
-	if (!tc.Offsets.empty())
-	{
-		idx = tc.Offsets.front();
-		idx->Indices = std::move(m.Indices);
-		idx->Vertices = std::move(m.Vertices);
-		tc.Offsets.pop();
-	}
-	else
-	{
-		tc.MemoryChunks.push_back(std::move(m));
-		idx = tc.MemoryChunks.end();
-		--idx;
-	}
-	tc.Loaded.Add(c, idx);
+	TerrainChunksAsyncComponent::Slot slot;
+	if (tc.Loaded.TryGet(c, slot, false)) return false;
+	slot = tc.Geometry.Acquire();
+	if (slot == TerrainGeometryPool::INVALID_SLOT) return false;
+	tc.Geometry.Write(slot, std::move(m));
+	tc.Loaded.Add(c, slot);
 	return true;
 }
 
-void ProTerGen::TerrainChunksAsyncSystem::RemoveChunk(ECS::Entity entity, Chunk& chunk, TerrainChunksAsyncComponent::MeshIdx index)
+void ProTerGen::TerrainChunksAsyncSystem::RemoveChunk(ECS::Entity entity, Chunk& chunk, TerrainChunksAsyncComponent::Slot slot)
 {
 	TerrainChunksAsyncComponent& tc = mRegister->GetComponent<TerrainChunksAsyncComponent>(entity);
-	tc.Offsets.emplace(index);
+	tc.Geometry.Release(slot);
+}
+
+double ProTerGen::TerrainChunksAsyncSystem::MetricGetUploadedBytesMean()
+{
+	return sMetricNumTimes == 0 ? 0.0 : sMetricUploadedBytesAcc / (double)sMetricNumTimes;
+}
+
+void ProTerGen::TerrainChunksAsyncSystem::MetricResetUploadedBytesMean()
+{
+	sMetricUploadedBytesAcc = 0.0;
+	sMetricNumTimes         = 0;
+}
+
+double ProTerGen::TerrainChunksAsyncSystem::MetricGetChunksPerSecond()
+{
+	// Geometry build time only, excluding the wait on the pool lock.
+	const uint64_t nanoseconds = sMetricChunkNanosecondsAcc;
+	return nanoseconds == 0 ? 0.0 : (double)sMetricChunksBuilt * 1e9 / (double)nanoseconds;
+}
+
+void ProTerGen::TerrainChunksAsyncSystem::MetricResetChunksPerSecond()
+{
+	sMetricChunkNanosecondsAcc = 0;
+	sMetricChunksBuilt         = 0;
 }
 
 #pragma endregion
@@ -376,6 +421,9 @@ void ProTerGen::TerrainQuadTreeSystem::Init()
 		{
 			mMeshes.CreateNewMeshGpu(BuildUniqueId(entity, i));
 		}
+#if _DEBUG
+		ValidateTerrainVertexEncoding(tc.TerrainSettings);
+#endif
 		for (const RQuadTreeTerrain::Border& b: RQuadTreeTerrain::GetBorders())
 		{
 			tc.Models[RQuadTreeTerrain::ToNumeral(b)] = ComputeChunksBasedOnFrontier(b);
@@ -397,7 +445,7 @@ void ProTerGen::TerrainQuadTreeSystem::Update(double dt)
 
 		if (tc.Mesh.Vertices.size() == 0)
 		{
-			tc.Mesh.Vertices = { {.Position = { 0.0f, 0.0f, 0.0f, 0.0f } } };
+			tc.Mesh.Vertices = { TerrainVertex{} };
 			tc.Mesh.Indices = { 0, 0, 0 };
 		}
 	}
@@ -415,7 +463,8 @@ void ProTerGen::TerrainQuadTreeSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12
 		const std::string id = BuildUniqueId(entity, currentFrame);
 		MeshGpu& meshGpu = mMeshes.GetMeshGpu(id);
 
-		meshGpu.IndexBufferByteSize = sizeof(Index) * static_cast<UINT64>(tc.Mesh.Indices.size());
+		meshGpu.IndexFormat = GetIndexFormat(tc.Mesh.Vertices.size());
+		meshGpu.IndexBufferByteSize = GetIndexByteStride(meshGpu.IndexFormat) * static_cast<UINT64>(tc.Mesh.Indices.size());
 		CD3DX12_HEAP_PROPERTIES heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 		CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.IndexBufferByteSize);
 		ThrowIfFailed(device->CreateCommittedResource
@@ -429,14 +478,14 @@ void ProTerGen::TerrainQuadTreeSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12
 		));
 		char* pIndices = nullptr;
 		ThrowIfFailed(meshGpu.IndexBufferGPU->Map(0, nullptr, reinterpret_cast<void**>(&pIndices)));
-		memcpy(pIndices, tc.Mesh.Indices.data(), meshGpu.IndexBufferByteSize);
+		WriteIndices(pIndices, tc.Mesh.Indices.data(), tc.Mesh.Indices.size(), meshGpu.IndexFormat);
 		meshGpu.IndexBufferGPU->Unmap(0, nullptr);
 		pIndices = nullptr;
 
 		meshGpu.SubMesh[""].IndexCount = tc.Mesh.Indices.size();
 		tc.Mesh.Indices.clear();
 
-		meshGpu.VertexBufferByteSize = sizeof(Vertex) * static_cast<UINT64>(tc.Mesh.Vertices.size());
+		meshGpu.VertexBufferByteSize = sizeof(TerrainVertex) * static_cast<UINT64>(tc.Mesh.Vertices.size());
 		heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 		resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.VertexBufferByteSize);
 		ThrowIfFailed(device->CreateCommittedResource
@@ -454,7 +503,7 @@ void ProTerGen::TerrainQuadTreeSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12
 		meshGpu.VertexBufferGPU->Unmap(0, nullptr);
 		pVertices = nullptr;
 
-		meshGpu.VertexByteStride = sizeof(Vertex);
+		meshGpu.VertexByteStride = sizeof(TerrainVertex);
 		tc.Mesh.Vertices.clear();
 
 		mrc.MeshGpuLocation = id;
@@ -493,7 +542,8 @@ void ProTerGen::TerrainQuadTreeSystem::RequestMesh(const std::vector<RQuadTreeTe
 	const uint32_t maxLod = tc.TerrainSettings.ChunksPerSideExp;//FastLog2(chunkCount);
 	const float invHalfSize = 1.0f / tc.TerrainSettings.TerrainWidth;
 	const float num = (float)tc.TerrainSettings.QuadsPerChunk;
-	Mesh& m = tc.Mesh;
+	const TerrainVertexQuantization quant{ .TerrainWidth = tc.TerrainSettings.TerrainWidth, .Height = tc.TerrainSettings.Height };
+	TerrainMesh& m = tc.Mesh;
 	for (size_t idx = 0; idx < requests.size(); ++idx)//(const auto& qt : leafNodes)
 	{
 		RQuadTreeTerrain& qt = *requests[idx];
@@ -537,7 +587,10 @@ void ProTerGen::TerrainQuadTreeSystem::RequestMesh(const std::vector<RQuadTreeTe
 				{
 					d.Indices[i] += (uint32_t)m.Vertices.size();
 				}
-				m.Vertices.insert(m.Vertices.end(), d.Vertices.begin(), d.Vertices.end());
+				for (const Vertex& v : d.Vertices)
+				{
+					m.Vertices.push_back(EncodeTerrainVertex(v, quant, (uint8_t)b, (uint8_t)c));
+				}
 				m.Indices.insert(m.Indices.end(), d.Indices.begin(), d.Indices.end());
 			}
 		}
@@ -560,12 +613,16 @@ void ProTerGen::TerrainQTMorphSystem::Init()
 			mMeshes.CreateNewMeshGpu(BuildUniqueId(entity, i));
 		}
 		TerrainQTComponent& tc = mRegister->GetComponent<TerrainQTComponent>(entity);
+#if _DEBUG
+		ValidateTerrainVertexEncoding(tc.TerrainSettings);
+#endif
 		for (const RQuadTreeTerrain::Border& b: RQuadTreeTerrain::GetBorders())
 		{
 			tc.Models[RQuadTreeTerrain::ToNumeral(b)] = ComputeChunksBasedOnFrontier(b);
 		}
 		
 		mIndexer.Init(mInfo.VTTilesPerRowExp);
+		mRequests.Init(mIndexer.GetCount());
 
 		for (ECS::Entity particleSystem : tc.ParticleSystems)
 		{
@@ -609,7 +666,7 @@ void ProTerGen::TerrainQTMorphSystem::Update(double dt)
 
 		if (tc.Mesh.Vertices.size() == 0)
 		{
-			tc.Mesh.Vertices = { {.Position = { 0.0f, 0.0f, 0.0f, 0.0f } } };
+			tc.Mesh.Vertices = { TerrainVertex{} };
 			tc.Mesh.Indices = { 0, 0, 0 };
 		}
 	}
@@ -631,7 +688,8 @@ void ProTerGen::TerrainQTMorphSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12D
 		const std::string id = BuildUniqueId(entity, currentFrame);
 		MeshGpu& meshGpu = mMeshes.GetMeshGpu(id);
 
-		meshGpu.IndexBufferByteSize = sizeof(Index) * static_cast<UINT64>(tc.Mesh.Indices.size());
+		meshGpu.IndexFormat = GetIndexFormat(tc.Mesh.Vertices.size());
+		meshGpu.IndexBufferByteSize = GetIndexByteStride(meshGpu.IndexFormat) * static_cast<UINT64>(tc.Mesh.Indices.size());
 		CD3DX12_HEAP_PROPERTIES heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 		CD3DX12_RESOURCE_DESC resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.IndexBufferByteSize);
 		ThrowIfFailed(device->CreateCommittedResource
@@ -645,14 +703,14 @@ void ProTerGen::TerrainQTMorphSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12D
 		));
 		char* pIndices = nullptr;
 		ThrowIfFailed(meshGpu.IndexBufferGPU->Map(0, nullptr, reinterpret_cast<void**>(&pIndices)));
-		memcpy(pIndices, tc.Mesh.Indices.data(), meshGpu.IndexBufferByteSize);
+		WriteIndices(pIndices, tc.Mesh.Indices.data(), tc.Mesh.Indices.size(), meshGpu.IndexFormat);
 		meshGpu.IndexBufferGPU->Unmap(0, nullptr);
 		pIndices = nullptr;
 
 		meshGpu.SubMesh[""].IndexCount = tc.Mesh.Indices.size();
 		tc.Mesh.Indices.clear();
 
-		meshGpu.VertexBufferByteSize = sizeof(Vertex) * static_cast<UINT64>(tc.Mesh.Vertices.size());
+		meshGpu.VertexBufferByteSize = sizeof(TerrainVertex) * static_cast<UINT64>(tc.Mesh.Vertices.size());
 		heapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
 		resourceDesc = CD3DX12_RESOURCE_DESC::Buffer(meshGpu.VertexBufferByteSize);
 		ThrowIfFailed(device->CreateCommittedResource
@@ -670,7 +728,7 @@ void ProTerGen::TerrainQTMorphSystem::UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12D
 		meshGpu.VertexBufferGPU->Unmap(0, nullptr);
 		pVertices = nullptr;
 
-		meshGpu.VertexByteStride = sizeof(Vertex);
+		meshGpu.VertexByteStride = sizeof(TerrainVertex);
 		tc.Mesh.Vertices.clear();
 
 		if (mrc.MeshGpuLocation != id)
@@ -731,14 +789,16 @@ std::vector<ProTerGen::RQuadTreeTerrain*> ProTerGen::TerrainQTMorphSystem::Compu
 
 void ProTerGen::TerrainQTMorphSystem::RequestMesh(const DirectX::XMFLOAT2& camPos, const std::vector<RQuadTreeTerrain*> requests, TerrainQTComponent& tc)
 {
-	mRequests.clear();
+	mRequests.Clear();
 	const float halfSize             = tc.TerrainSettings.TerrainWidth * 0.5f;
 	const uint32_t chunkCount        = 1 << tc.TerrainSettings.ChunksPerSideExp;
 	const uint32_t maxLod            = tc.TerrainSettings.ChunksPerSideExp;
 	const float invTerrWidth         = 1.0f / tc.TerrainSettings.TerrainWidth;
 	const float num                  = (float)tc.TerrainSettings.QuadsPerChunk;
 	const RQuadTreeTerrain::Border b = RQuadTreeTerrain::Border::NONE;
-	Mesh& m = tc.Mesh;
+	const RQuadTreeTerrain::Corner c = RQuadTreeTerrain::Corner::NONE;
+	const TerrainVertexQuantization quant{ .TerrainWidth = tc.TerrainSettings.TerrainWidth, .Height = tc.TerrainSettings.Height };
+	TerrainMesh& m = tc.Mesh;
 	for (size_t idx = 0; idx < requests.size(); ++idx)
 	{
 		RQuadTreeTerrain& qt = *requests[idx];
@@ -787,7 +847,10 @@ void ProTerGen::TerrainQTMorphSystem::RequestMesh(const DirectX::XMFLOAT2& camPo
 				{
 					d.Indices[i] += (uint32_t)m.Vertices.size();
 				}
-				m.Vertices.insert(m.Vertices.end(), d.Vertices.begin(), d.Vertices.end());
+				for (const Vertex& v : d.Vertices)
+				{
+					m.Vertices.push_back(EncodeTerrainVertex(v, quant, (uint8_t)b, (uint8_t)c));
+				}
 				m.Indices.insert(m.Indices.end(), d.Indices.begin(), d.Indices.end());
 			}
 		}
@@ -821,8 +884,7 @@ void ProTerGen::TerrainQTMorphSystem::RequestMesh(const DirectX::XMFLOAT2& camPo
 		{
 		    const uint32_t ix = (uint32_t)(((qt.GetMinX() + halfSize) * invTerrWidth) * (float)mInfo.VTTilesPerRow() / (1 << iLod));
 		    const uint32_t iy = (uint32_t)(((qt.GetMinY() + halfSize) * invTerrWidth) * (float)mInfo.VTTilesPerRow() / (1 << iLod));
-			const size_t index = mIndexer.PageIndex(VT::Page{ .X = ix, .Y = iy, .Mip = iLod });
-			mRequests[index] += iLod + 1;
+			mRequests.Add(mIndexer.PageIndex(VT::Page{ .X = ix, .Y = iy, .Mip = iLod }), iLod + 1);
 			iLod += 1;
 		}
 #endif
@@ -4,16 +4,22 @@
 #include <DirectXMath.h>
 #include <thread>
 #include <list>
+#include <atomic>
 #include "CommonHeaders.h"
 #include "Meshes.h"
 #include "QuadTree.h"
 #include "ShaderConstants.h"
 #include "Mesh.h"
+#include "TerrainVertex.h"
+#include "TerrainGeometryPool.h"
 #include "RenderSystem.h"
 #include "ECS.h"
 #include "CameraSystem.h"
 #include "VirtualTexture.h"
 #include "TerrainLayer.h"
+#include "Noiser.h"
+#include "HeightfieldSampler.h"
+#include "LatticeNoiseBatch.h"
 
 namespace ProTerGen
 {
@@ -87,6 +93,10 @@ namespace ProTerGen
         uint32_t ChunksPerSideExp = 8;
         uint32_t QuadsPerChunk    = 1;
         uint32_t GpuSubdivisions  = 1;
+        // World space detail added to the chunk heights, in world units; 0 disables it. It is sampled in world
+        // units rather than terrain uv, so it keeps its scale and does not repeat however wide the terrain is.
+        float    DetailHeight     = 0.0f;
+        float    DetailWavelength = 32.0f;
 
         std::vector<Layer>         Layers{};
         std::vector<MaterialLayer> MaterialLayers{};
@@ -102,11 +112,10 @@ namespace ProTerGen
 
         std::array<Mesh, RQuadTreeTerrain::BORDER_COUNT> Chunks{};
 
-        using MeshIdx = std::list<Mesh>::iterator;
-        std::list<Mesh> MemoryChunks{};
-        std::queue<MeshIdx> Offsets{};
-        std::unordered_set<size_t> Requested{};
-        LRUCache<Chunk, MeshIdx> Loaded {};
+        using Slot = uint32_t;
+        TerrainGeometryPool Geometry{};
+        std::vector<Chunk> Requested{};
+        LRUCache<Chunk, Slot> Loaded {};
         std::unique_ptr<VT::PageThread<ChunkInfo>> Thread = nullptr;
     };
 
@@ -117,7 +126,7 @@ namespace ProTerGen
         using Vertices = std::vector<Vertex>;
         
         TerrainSettings TerrainSettings{};
-        Mesh Mesh{};
+        TerrainMesh Mesh{};
         std::array<ProTerGen::Mesh, RQuadTreeTerrain::BORDER_COUNT> Models{};
         std::vector<ECS::Entity> ParticleSystems{};
     };
@@ -126,6 +135,11 @@ namespace ProTerGen
     {
     public:
         static const uint32_t MAX_CHUNKS = 256;
+
+        static void   MetricResetUploadedBytesMean();
+        static double MetricGetUploadedBytesMean();
+        static void   MetricResetChunksPerSecond();
+        static double MetricGetChunksPerSecond();
     public:
         TerrainChunksAsyncSystem(Meshes& meshes, CameraComponent& camera) : mMeshes(meshes), mCamera(camera) {};
         virtual ~TerrainChunksAsyncSystem();
@@ -151,7 +165,20 @@ namespace ProTerGen
         void RequestMesh(const std::vector<RQuadTreeTerrain*> requests, TerrainChunksAsyncComponent& tc);
         void OnEntityRemoved(ECS::Entity entity) override;
         bool ProcessGeometryFromHeightData(ChunkInfo& ci);
-        void RemoveChunk(ECS::Entity entity, Chunk& chunk, TerrainChunksAsyncComponent::MeshIdx index);
+        void RemoveChunk(ECS::Entity entity, Chunk& chunk, TerrainChunksAsyncComponent::Slot slot);
+
+        static double sMetricUploadedBytesAcc;
+        static size_t sMetricNumTimes;
+        static std::atomic<uint64_t> sMetricChunkNanosecondsAcc;
+        static std::atomic<uint64_t> sMetricChunksBuilt;
+
+        // Generated once and only read afterwards, so every chunk job shares it without locking.
+        PerlinNoise mNoise{};
+        HeightfieldSampler mSampler{};
+        FBMDesc mHeightFBM{};
+        LatticeNoise mDetailNoise{};
+        LatticeNoiseBatch mDetailBatch{};
+        FBMDesc mDetailFBM{ .Octaves = 4, .Frecuency = 1.0f, .Gain = 0.5f };
 
         std::timed_mutex mMutex;
         Meshes& mMeshes;
@@ -203,7 +230,7 @@ namespace ProTerGen
         void UpdateOnGpu(Microsoft::WRL::ComPtr<ID3D12Device> device, uint32_t currentFrame);
         void FillTerrainMaterialLayersStructuredBuffer(UploadBuffer<TerrainMaterialLayerConstants>* buffer);
 
-        const std::unordered_map<uint32_t, uint32_t>& GetLastRequests() const { return mRequests; }
+        const VT::PageRequests& GetLastRequests() const { return mRequests; }
        
         inline void SetMeshes(Meshes& meshes) { mMeshes = meshes; };
         inline void SetCamera(CameraComponent& camera) { mCamera = camera; };
@@ -228,7 +255,7 @@ namespace ProTerGen
 
         VT::LightPageIndexer mIndexer{};
         VT::VTDesc& mInfo;
-        std::unordered_map<uint32_t, uint32_t> mRequests;
+        VT::PageRequests mRequests{};
         Meshes& mMeshes;
         CameraComponent& mCamera;
     };
@@ -0,0 +1,80 @@
+#include "TerrainVertex.h"
+#include <cmath>
+#include <random>
+#include "MathHelpers.h"
+
+static inline uint16_t ToUnorm16(float v) noexcept
+{
+	const float c = ProTerGen_clamp(0.0f, 1.0f, v);
+	return (uint16_t)std::lround(c * 65535.0f);
+}
+
+static inline float FromUnorm16(uint16_t v) noexcept
+{
+	return (float)v / 65535.0f;
+}
+
+ProTerGen::TerrainVertex ProTerGen::EncodeTerrainVertex(const Vertex& v, const TerrainVertexQuantization& q, uint8_t border, uint8_t corner) noexcept
+{
+	const float invWidth  = 1.0f / q.TerrainWidth;
+	const float invHeight = 0.5f / q.Height;
+	const float lod       = ProTerGen_clamp(0.0f, 65535.0f, v.Position.w * TERRAIN_VERTEX_LOD_SCALE);
+
+	TerrainVertex tv
+	{
+		.X      = ToUnorm16(v.Position.x * invWidth  + 0.5f),
+		.Y      = ToUnorm16(v.Position.y * invHeight + 0.5f),
+		.Z      = ToUnorm16(v.Position.z * invWidth  + 0.5f),
+		.Lod    = (uint16_t)std::lround(lod),
+		.Border = border,
+		.Corner = corner,
+	};
+	return tv;
+}
+
+ProTerGen::Vertex ProTerGen::DecodeTerrainVertex(const TerrainVertex& tv, const TerrainVertexQuantization& q) noexcept
+{
+	const float x = FromUnorm16(tv.X);
+	const float y = FromUnorm16(tv.Y);
+	const float z = FromUnorm16(tv.Z);
+
+	Vertex v
+	{
+		.Position = { (x - 0.5f) * q.TerrainWidth, (y * 2.0f - 1.0f) * q.Height, (z - 0.5f) * q.TerrainWidth, (float)tv.Lod / TERRAIN_VERTEX_LOD_SCALE },
+		.Normal   = { 0.0f, 1.0f, 0.0f },
+		.TexC     = { x, z },
+		.TangentU = { 0.0f, 0.0f, -1.0f },
+	};
+	return v;
+}
+
+float ProTerGen::TerrainVertexRoundTripError(const TerrainVertexQuantization& q, uint32_t randomSamples) noexcept
+{
+	const float halfWidth = 0.5f * q.TerrainWidth;
+	const float maxLod    = 65535.0f / TERRAIN_VERTEX_LOD_SCALE;
+	const DirectX::XMFLOAT4 steps = { q.TerrainWidth / 65535.0f, 2.0f * q.Height / 65535.0f, q.TerrainWidth / 65535.0f, 1.0f / TERRAIN_VERTEX_LOD_SCALE };
+
+	std::vector<DirectX::XMFLOAT4> positions =
+	{
+		{ -halfWidth, -q.Height, -halfWidth, 0.0f   },
+		{  halfWidth,  q.Height,  halfWidth, maxLod },
+		{  0.0f,       0.0f,      0.0f,      0.5f * maxLod },
+	};
+	std::mt19937 rng(0x7e44a1u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < randomSamples; ++i)
+	{
+		positions.push_back({ (unit(rng) - 0.5f) * q.TerrainWidth, (unit(rng) * 2.0f - 1.0f) * q.Height, (unit(rng) - 0.5f) * q.TerrainWidth, unit(rng) * maxLod });
+	}
+
+	float error = 0.0f;
+	for (const DirectX::XMFLOAT4& p : positions)
+	{
+		const Vertex decoded = DecodeTerrainVertex(EncodeTerrainVertex(Vertex{ .Position = p }, q), q);
+		error = std::fmax(error, std::fabs(decoded.Position.x - p.x) / steps.x);
+		error = std::fmax(error, std::fabs(decoded.Position.y - p.y) / steps.y);
+		error = std::fmax(error, std::fabs(decoded.Position.z - p.z) / steps.z);
+		error = std::fmax(error, std::fabs(decoded.Position.w - p.w) / steps.w);
+	}
+	return error;
+}
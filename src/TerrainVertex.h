@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CommonHeaders.h"
+#include "Mesh.h"
+
+namespace ProTerGen
+{
+	// Compact vertex for heightmap terrain. Normal and tangent are constant and the texture coordinates
+	// are the normalized XZ position, so only a quantized position and the lod level are stored.
+	// Layout must match "TerrainInputLayout" and TerrainVertex.hlsli.
+	struct TerrainVertex
+	{
+		uint16_t X      = 0; // unorm16 over [-TerrainWidth / 2, TerrainWidth / 2]
+		uint16_t Y      = 0; // unorm16 over [-Height, Height]
+		uint16_t Z      = 0; // unorm16 over [-TerrainWidth / 2, TerrainWidth / 2]
+		uint16_t Lod    = 0; // 8.8 fixed point lod level (Vertex::Position.w)
+		uint8_t  Border = 0; // RQuadTreeTerrain::Border of the source template
+		uint8_t  Corner = 0; // RQuadTreeTerrain::Corner of the source template
+		uint16_t _Pad0  = 0;
+	};
+	static_assert(sizeof(TerrainVertex) == 12, "TerrainVertex must be 12 bytes to match TerrainInputLayout");
+
+	struct TerrainMesh
+	{
+		std::string Name = "";
+
+		std::vector<TerrainVertex> Vertices{};
+		std::vector<Index> Indices{};
+	};
+
+	struct TerrainVertexQuantization
+	{
+		float TerrainWidth = 1024.0f;
+		float Height       = 1.0f;
+	};
+
+	constexpr float TERRAIN_VERTEX_LOD_SCALE = 256.0f;
+
+	TerrainVertex EncodeTerrainVertex(const Vertex& v, const TerrainVertexQuantization& q, uint8_t border = 0, uint8_t corner = 0) noexcept;
+	Vertex DecodeTerrainVertex(const TerrainVertex& v, const TerrainVertexQuantization& q) noexcept;
+	// Largest error of an encode/decode round trip, in quantization steps of each component: the corners and the
+	// center of the range, then randomSamples random vertices. Encoding rounds, so it stays at half a step.
+	float TerrainVertexRoundTripError(const TerrainVertexQuantization& q, uint32_t randomSamples) noexcept;
+}
@@ -0,0 +1,206 @@
+#include <cstring>
+#include <vector>
+
+#include "TileCompression.h"
+
+namespace
+{
+	constexpr uint32_t HASH_LOG      = 12;
+	constexpr uint32_t MIN_MATCH     = 4;
+	constexpr size_t   MAX_OFFSET    = 65535;
+	// The format ends with a run of literals: the last match starts at least 12 bytes before the end
+	// and stops 5 bytes before it.
+	constexpr size_t   MATCH_LIMIT   = 12;
+	constexpr size_t   LAST_LITERALS = 5;
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_LOG);
+	}
+
+	// Lengths of 15 or more continue in 255 valued bytes.
+	inline bool WriteLength(size_t length, uint8_t*& op, const uint8_t* end)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			if (op >= end) return false;
+			*op++ = 255;
+		}
+		if (op >= end) return false;
+		*op++ = (uint8_t)length;
+		return true;
+	}
+
+	inline bool ReadLength(size_t& length, const uint8_t*& ip, const uint8_t* end)
+	{
+		uint8_t b = 0;
+		do
+		{
+			if (ip >= end) return false;
+			b = *ip++;
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+
+	// With 8 bytes of slack after both ends, copies whole words and writes a little past size.
+	inline void CopyWild(uint8_t* dst, const uint8_t* src, size_t size, bool slack)
+	{
+		if (!slack)
+		{
+			memcpy(dst, src, size);
+			return;
+		}
+		for (size_t i = 0; i < size; i += 8)
+		{
+			memcpy(dst + i, src + i, 8);
+		}
+	}
+
+	bool WriteSequence(const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength, uint8_t*& op, const uint8_t* end)
+	{
+		if (op >= end) return false;
+		uint8_t* token = op++;
+		const size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+		*token = (uint8_t)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+		if (literalCount >= 15 && !WriteLength(literalCount - 15, op, end)) return false;
+		if ((size_t)(end - op) < literalCount) return false;
+		memcpy(op, literals, literalCount);
+		op += literalCount;
+
+		// The last sequence carries only literals.
+		if (matchLength == 0) return true;
+
+		if (end - op < 2) return false;
+		*op++ = (uint8_t)(offset & 0xFF);
+		*op++ = (uint8_t)(offset >> 8);
+		return matchCode < 15 || WriteLength(matchCode - 15, op, end);
+	}
+}
+
+size_t ProTerGen::TileCompression::CompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t ProTerGen::TileCompression::Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+	uint8_t* op = dst;
+	const uint8_t* end = dst + capacity;
+	size_t anchor = 0;
+
+	if (size > MATCH_LIMIT)
+	{
+		// Position + 1, so 0 is an empty slot.
+		std::vector<uint32_t> table((size_t)1 << HASH_LOG, 0);
+		const size_t matchLimit = size - LAST_LITERALS;
+		const size_t searchLimit = size - MATCH_LIMIT;
+		size_t ip = 0;
+		uint32_t misses = 0;
+		while (ip < searchLimit)
+		{
+			const uint32_t sequence = Read32(src + ip);
+			const uint32_t h = Hash(sequence);
+			const size_t candidate = table[h];
+			table[h] = (uint32_t)(ip + 1);
+
+			if (candidate == 0 || ip + 1 - candidate > MAX_OFFSET || Read32(src + candidate - 1) != sequence)
+			{
+				// Incompressible stretches are skipped faster the longer they get.
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			const size_t ref = candidate - 1;
+			size_t length = MIN_MATCH;
+			while (ip + length < matchLimit && src[ref + length] == src[ip + length])
+			{
+				++length;
+			}
+
+			if (!WriteSequence(src + anchor, ip - anchor, ip - ref, length, op, end)) return 0;
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	if (!WriteSequence(src + anchor, size - anchor, 0, 0, op, end)) return 0;
+	return (size_t)(op - dst);
+}
+
+bool ProTerGen::TileCompression::Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+{
+	const uint8_t* ip = src;
+	const uint8_t* ipEnd = src + size;
+	uint8_t* op = dst;
+	const uint8_t* opEnd = dst + dstSize;
+
+	while (ip < ipEnd)
+	{
+		const uint8_t token = *ip++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !ReadLength(literalCount, ip, ipEnd)) return false;
+		if ((size_t)(ipEnd - ip) < literalCount || (size_t)(opEnd - op) < literalCount) return false;
+		CopyWild(op, ip, literalCount, (size_t)(ipEnd - ip) >= literalCount + 8 && (size_t)(opEnd - op) >= literalCount + 8);
+		ip += literalCount;
+		op += literalCount;
+
+		if (ip == ipEnd) break;
+
+		if (ipEnd - ip < 2) return false;
+		const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) return false;
+
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(length, ip, ipEnd)) return false;
+		length += MIN_MATCH;
+		if ((size_t)(opEnd - op) < length) return false;
+
+		const uint8_t* match = op - offset;
+		if (offset >= 8 && (size_t)(opEnd - op) >= length + 8)
+		{
+			CopyWild(op, match, length, true);
+			op += length;
+		}
+		else
+		{
+			// Copies may overlap and repeat the last offset bytes; every pass doubles what can be copied at once.
+			while (length > 0)
+			{
+				const size_t chunk = length < (size_t)(op - match) ? length : (size_t)(op - match);
+				memcpy(op, match, chunk);
+				op += chunk;
+				length -= chunk;
+			}
+		}
+	}
+
+	return op == opEnd;
+}
+
+void ProTerGen::TileCompression::DeltaEncode(uint8_t* data, size_t size, uint32_t stride)
+{
+	for (size_t i = size; i-- > stride;)
+	{
+		data[i] = (uint8_t)(data[i] - data[i - stride]);
+	}
+}
+
+void ProTerGen::TileCompression::DeltaDecode(uint8_t* data, size_t size, uint32_t stride)
+{
+	for (size_t i = stride; i < size; ++i)
+	{
+		data[i] = (uint8_t)(data[i] + data[i - stride]);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ProTerGen
+{
+	// Byte oriented LZ77 in the LZ4 block format: greedy matching over a hash of 4 bytes, no entropy stage,
+	// so decoding is little more than memcpy. Pages go through a delta filter first, which turns the smooth
+	// gradients of a terrain texture into long runs of repeated bytes the matcher can find.
+	class TileCompression
+	{
+	public:
+		// Worst case size of Compress for size input bytes.
+		static size_t CompressBound(size_t size);
+
+		// Returns the compressed size, or 0 if it does not fit in capacity.
+		static size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+		// Fails unless src decodes to exactly dstSize bytes.
+		static bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
+
+		// Every byte minus the same channel of the previous texel, and back. In place.
+		static void DeltaEncode(uint8_t* data, size_t size, uint32_t stride);
+		static void DeltaDecode(uint8_t* data, size_t size, uint32_t stride);
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On disk layout of a tile file, without the graphics API, so CPU only tools can write the files TileDataFile reads.
+namespace ProTerGen
+{
+	namespace VT
+	{
+		constexpr uint32_t TILE_FILE_MAGIC   = 0x54475450; // "PTGT"
+		constexpr uint32_t TILE_FILE_VERSION = 3;
+
+		enum class TilePageEncoding : uint32_t
+		{
+			RAW      = 0, // The bordered texels as they are.
+			DELTA_LZ = 1, // TileCompression::DeltaEncode, then TileCompression::Compress.
+		};
+
+		struct TileFileHeader
+		{
+			uint32_t Magic            = 0;
+			uint32_t Version          = 0;
+			uint32_t FormatSize       = 0;
+			uint32_t BorderedTileSize = 0;
+			uint64_t PageCount        = 0;
+		};
+
+		struct TilePageEntry
+		{
+			uint64_t         Offset   = 0;
+			uint32_t         Size     = 0; // 0 for pages never written.
+			TilePageEncoding Encoding = TilePageEncoding::RAW;
+		};
+
+		// The complete mark char, the header and the index come first, then the bitmap with a bit per page.
+		constexpr uint64_t TileFileBitmapOffset(size_t pageCount)
+		{
+			return 1 + sizeof(TileFileHeader) + pageCount * sizeof(TilePageEntry);
+		}
+
+		constexpr uint64_t TileFileDataOffset(size_t pageCount)
+		{
+			return TileFileBitmapOffset(pageCount) + ((pageCount + 63) >> 6) * sizeof(uint64_t);
+		}
+	}
+}
@@ -1,6 +1,13 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+
 #include "TileGenerator.h"
 #include "BMPSerializer.h"
 #include "MathHelpers.h"
+#include "JobSystem.h"
+
+double ProTerGen::VT::BMPTileGenerator::sMetricThroughputMBs = 0.0;
 
 ProTerGen::VT::BMPTileGenerator::~BMPTileGenerator()
 {
@@ -32,23 +39,13 @@ void ProTerGen::VT::BMPTileGenerator::Init(const std::wstring& filename, VTDesc*
 
 	}
 
-	bool completed = false;
-
-	if (FILE* f = _wfopen(tempFileName.c_str(), L"rb"))
-	{
-		char b = getc(f);
-		completed = b == CompleteChar;
-		fclose(f);
-	}
+	const bool completed = TileDataFile::IsComplete(tempFileName, CompleteChar);
 
 	if (!completed)
 	{
-		mTileDataFile.Open(tempFileName, desc, mFile.FormatSize, TileDataFile::READ_WRITE);
+		mTileDataFile.Open(tempFileName, desc, mFile.FormatSize, TileDataFile::READ_WRITE_RESUME);
 		mPageIndexer.Init(*desc);
 
-		mRawDataPage.Init(mInfo->BorderedTileSize(), mInfo->BorderedTileSize(), mFile.FormatSize);
-		mRawData2xTile.Init(mInfo->TileSize() << 1, mInfo->TileSize() << 1, mFile.FormatSize);
-
 		mRun.store(true);
 	}
 }
@@ -73,23 +70,13 @@ void ProTerGen::VT::BMPTileGenerator::Init(const std::string& filename, VTDesc*
 
 	}
 
-	bool completed = false;
-
-	if (FILE* f = fopen(tempFileName.c_str(), "rb"))
-	{
-		char b = getc(f);
-		completed = b == CompleteChar;
-		fclose(f);
-	}
+	const bool completed = TileDataFile::IsComplete(tempFileName, CompleteChar);
 
 	if (!completed)
 	{
-		mTileDataFile.Open(tempFileName, desc, mFile.FormatSize, TileDataFile::READ_WRITE);
+		mTileDataFile.Open(tempFileName, desc, mFile.FormatSize, TileDataFile::READ_WRITE_RESUME);
 		mPageIndexer.Init(*desc);
 
-		mRawDataPage.Init(mInfo->BorderedTileSize(), mInfo->BorderedTileSize(), mFile.FormatSize);
-		mRawData2xTile.Init(mInfo->TileSize() << 1, mInfo->TileSize() << 1, mFile.FormatSize);
-
 		mRun.store(true);
 	}
 	else
@@ -101,35 +88,89 @@ void ProTerGen::VT::BMPTileGenerator::Init(const std::string& filename, VTDesc*
 void ProTerGen::VT::BMPTileGenerator::Generate()
 {
 	if (mRun.load() == true) mTileDataFile.WriteCharOnBeginning(IncompleteChar);
+
+	// Pages are cut straight from the mapped image; if it can't be mapped it is read once into memory.
+	std::vector<uint8_t> sourceCopy;
+	const uint8_t* source = mFile.MapView() ? mFile.Pixels() : nullptr;
+	if (mRun.load() == true && source == nullptr)
+	{
+		sourceCopy.resize((size_t)mFile.Width * mFile.Height * mFile.FormatSize);
+		mFile.RewindPtr();
+		if (fread_s(sourceCopy.data(), sourceCopy.size(), 1, sourceCopy.size(), mFile.File) != sourceCopy.size())
+		{
+			perror("fread");
+			mRun.store(false);
+		}
+		source = sourceCopy.data();
+	}
+
+	JobSystem::Initialize();
+	const auto begin = std::chrono::steady_clock::now();
+	mBytesWritten.store(0);
+
+	// Each subtree is built by one job; roots are taken from the finest mip that still leaves a few
+	// of them per worker, and the mips above are built from the roots kept in memory. Pages left by
+	// an interrupted run are kept.
 	const uint32_t mipCount = mInfo->VTTilesPerRowExp + 1;
-	for (uint32_t i = 0; i < mipCount && mRun.load() == true; ++i)
+	const uint32_t workers = max(1u, std::thread::hardware_concurrency());
+	uint32_t rootMip = mipCount - 1;
+	while (rootMip > 0 && ((mInfo->VTTilesPerRow() >> rootMip) * (mInfo->VTTilesPerRow() >> rootMip)) < 4 * workers)
 	{
-		printf("Generating Mip %lu\n", i);
-		const uint32_t count = (mInfo->VTSize / mInfo->TileSize()) >> i;
-		for (uint32_t y = 0; y < count && mRun.load() == true; ++y)
+		--rootMip;
+	}
+
+	uint32_t count = mInfo->VTTilesPerRow() >> rootMip;
+	std::vector<std::vector<uint8_t>> level((size_t)count * count);
+	JobSystem::Context ctx;
+	printf("Generating Mips 0 to %lu\n", rootMip);
+	JobSystem::Dispatch(ctx, count * count, 1, [&](JobSystem::JobDesc desc)
 		{
+			const Page page = { .X = desc.JobIndex % count, .Y = desc.JobIndex / count, .Mip = rootMip };
+			BuildSubtree(source, page, &level[desc.JobIndex]);
+		});
+	JobSystem::Wait(ctx);
 
-			for (uint32_t x = 0; x < count && mRun.load() == true; ++x)
+	const size_t pageSize = (size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFile.FormatSize;
+	for (uint32_t i = rootMip + 1; i < mipCount && mRun.load() == true; ++i)
+	{
+		printf("Generating Mip %lu\n", i);
+		count = mInfo->VTTilesPerRow() >> i;
+		std::vector<std::vector<uint8_t>> next((size_t)count * count);
+		const uint32_t childCount = count << 1;
+		JobSystem::Dispatch(ctx, count * count, 1, [&](JobSystem::JobDesc desc)
 			{
-				const Page page = { .X = x, .Y = (uint32_t)y, .Mip = i };
+				const Page page = { .X = desc.JobIndex % count, .Y = desc.JobIndex / count, .Mip = i };
 				const PageIndex index = mPageIndexer.PageIndex(page);
-
-				CopyTile(mRawDataPage, page);
-
-				const size_t size = (size_t)mRawDataPage.Width * mRawDataPage.Height * mRawDataPage.FormatSize;
-				if (i == 0)
+				next[desc.JobIndex].resize(pageSize);
+				if (mTileDataFile.IsPageComplete(index) && mTileDataFile.ReadPage(index, next[desc.JobIndex].data(), mFile.FormatSize))
 				{
-					BMP::Invert3Channels(mRawDataPage.Data, size);
+					return;
 				}
 
-				mTileDataFile.WritePage(index, mRawDataPage.Data);
-			}
-		}
+				const size_t child = (size_t)(page.Y << 1) * childCount + (page.X << 1);
+				const std::array<const uint8_t*, 4> children =
+				{
+					level[child].data(),
+					level[child + 1].data(),
+					level[child + childCount].data(),
+					level[child + childCount + 1].data(),
+				};
+				DownsampleTile(children, next[desc.JobIndex].data());
+				WritePage(page, next[desc.JobIndex].data());
+			});
+		JobSystem::Wait(ctx);
+		level = std::move(next);
 	}
+
 	if (mRun.load() == true)
 	{
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		const double megabytes = (double)mBytesWritten.load() / (1024.0 * 1024.0);
+		sMetricThroughputMBs = seconds > 0.0 ? megabytes / seconds : 0.0;
+
 		mTileDataFile.WriteCharOnBeginning(CompleteChar);
-		printf("Generation done.\n");
+		printf("Generation done. %.1f MB in %.2f s (%.1f MB/s).\n", megabytes, seconds, sMetricThroughputMBs);
+		printf("%zu pages stored as copies of other pages.\n", mTileDataFile.DeduplicatedPages());
 		mOnFinish();
 	}
 	Close();
@@ -139,66 +180,137 @@ void ProTerGen::VT::BMPTileGenerator::Close()
 {
 	if (mFile.File)
 	{
+		mFile.UnmapView();
 		fclose(mFile.File);
 		mFile.File = nullptr;
 		mTileDataFile.Close();
 	}
 }
 
-void ProTerGen::VT::BMPTileGenerator::CopyTile(ImageRawData& image, const Page& request)
+double ProTerGen::VT::BMPTileGenerator::MetricGetThroughputMBs()
 {
-	if (request.Mip == 0)
-	{
-		int32_t indexX = (int32_t)request.X * mInfo->TileSize() - mInfo->BorderSize;
-		int32_t indexY = (int32_t)request.Y * mInfo->TileSize() - mInfo->BorderSize;
-
-		const uint32_t px = max(0, -(indexX));
-		const uint32_t py = max(0, -(indexY));
+	return sMetricThroughputMBs;
+}
 
-		const uint32_t rx = max(0, indexX);
-		const uint32_t ry = max(0, indexY);
+void ProTerGen::VT::BMPTileGenerator::CutTile(const uint8_t* source, const Page& request, uint8_t* data) const
+{
+	const uint32_t size = mInfo->BorderedTileSize();
+	const uint32_t formatSize = mFile.FormatSize;
+	const int32_t indexX = (int32_t)(request.X * mInfo->TileSize()) - (int32_t)mInfo->BorderSize;
+	const int32_t indexY = (int32_t)(request.Y * mInfo->TileSize()) - (int32_t)mInfo->BorderSize;
 
-		const Rectangle r = { .X = rx, .Y = ry, .Width = mInfo->BorderedTileSize() - px, .Height = mInfo->BorderedTileSize() - py };
-		const Point p = { .X = px, .Y = py };
+	// Columns inside of the image; the ones outside repeat the edge texel.
+	const uint32_t first = (uint32_t)max(0, -indexX);
+	const uint32_t last = (uint32_t)ProTerGen_clamp((int32_t)first, (int32_t)size, (int32_t)mFile.Width - indexX);
 
-		mFile.CopyTo(image.Data, p, r);
+	for (uint32_t y = 0; y < size; ++y)
+	{
+		const size_t sy = (size_t)ProTerGen_clamp(0, (int32_t)mFile.Height - 1, indexY + (int32_t)y);
+		const uint8_t* srcRow = source + sy * mFile.Width * formatSize;
+		uint8_t* dstRow = data + (size_t)y * size * formatSize;
 
+		memcpy(dstRow + (size_t)first * formatSize, srcRow + (size_t)(indexX + (int32_t)first) * formatSize, (size_t)(last - first) * formatSize);
+		for (uint32_t x = 0; x < first; ++x)
+		{
+			memcpy(dstRow + (size_t)x * formatSize, dstRow + (size_t)first * formatSize, formatSize);
+		}
+		for (uint32_t x = last; x < size; ++x)
+		{
+			memcpy(dstRow + (size_t)x * formatSize, dstRow + (size_t)(last - 1) * formatSize, formatSize);
+		}
 	}
-	else
+
+	BMP::Invert3Channels(data, (size_t)size * size * formatSize);
+}
+
+void ProTerGen::VT::BMPTileGenerator::DownsampleTile(const std::array<const uint8_t*, 4>& children, uint8_t* data) const
+{
+	const uint32_t size = mInfo->BorderedTileSize();
+	const uint32_t tileSize = mInfo->TileSize();
+	const uint32_t halfTile = tileSize >> 1;
+	const uint32_t border = mInfo->BorderSize;
+	const uint32_t formatSize = mFile.FormatSize;
+	const size_t rowPitch = (size_t)size * formatSize;
+
+	for (uint32_t y = 0; y < tileSize; ++y)
 	{
-		for (uint32_t y = 0; y < 2; ++y)
+		uint8_t* dstRow = data + (size_t)(y + border) * rowPitch;
+		for (uint32_t x = 0; x < tileSize; ++x)
 		{
-			for (uint32_t x = 0; x < 2; ++x)
+			const uint8_t* child = children[(x / halfTile) + 2 * (y / halfTile)];
+			const size_t cx = (size_t)((x % halfTile) << 1) + border;
+			const size_t cy = (size_t)((y % halfTile) << 1) + border;
+			const uint8_t* nw = child + cy * rowPitch + cx * formatSize;
+			const uint8_t* sw = nw + rowPitch;
+			uint8_t* dst = dstRow + (size_t)(x + border) * formatSize;
+			for (uint32_t c = 0; c < formatSize; ++c)
 			{
-				const Page page =
-				{
-					.X = (x + (request.X << 1)),
-					.Y = (y + (request.Y << 1)),
-					.Mip = request.Mip - 1
-				};
-				mTileDataFile.ReadPage(mPageIndexer.PageIndex(page), image.Data, 3);
-
-				const Point p =
-				{
-					.X = x * mInfo->TileSize(),
-					.Y = y * mInfo->TileSize()
-				};
-				const Rectangle r =
-				{
-					.X = mInfo->BorderSize,
-					.Y = mInfo->BorderSize,
-					.Width = mInfo->TileSize(),
-					.Height = mInfo->TileSize()
-				};
-				image.CopyTo(mRawData2xTile, p, r);
+				dst[c] = (uint8_t)(((uint32_t)nw[c] + nw[c + formatSize] + sw[c] + sw[c + formatSize]) >> 2);
 			}
 		}
+	}
 
-		const Point p =
+	// The neighbours of this page are not built yet, so the border repeats the edge of the interior.
+	for (uint32_t y = border; y < border + tileSize; ++y)
+	{
+		uint8_t* row = data + (size_t)y * rowPitch;
+		for (uint32_t x = 0; x < border; ++x)
 		{
-			.X = mInfo->BorderSize,
-			.Y = mInfo->BorderSize
+			memcpy(row + (size_t)x * formatSize, row + (size_t)border * formatSize, formatSize);
+			memcpy(row + (size_t)(border + tileSize + x) * formatSize, row + (size_t)(border + tileSize - 1) * formatSize, formatSize);
+		}
+	}
+	for (uint32_t y = 0; y < border; ++y)
+	{
+		memcpy(data + (size_t)y * rowPitch, data + (size_t)border * rowPitch, rowPitch);
+		memcpy(data + (size_t)(border + tileSize + y) * rowPitch, data + (size_t)(border + tileSize - 1) * rowPitch, rowPitch);
+	}
+}
+
+bool ProTerGen::VT::BMPTileGenerator::BuildSubtree(const uint8_t* source, const Page& request, std::vector<uint8_t>* data)
+{
+	if (mRun.load() == false) return false;
+
+	std::vector<uint8_t> local;
+	std::vector<uint8_t>& page = data ? *data : local;
+	const PageIndex index = mPageIndexer.PageIndex(request);
+	bool complete = mTileDataFile.IsPageComplete(index);
+	if (complete && data)
+	{
+		page.resize((size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFile.FormatSize);
+		complete = mTileDataFile.ReadPage(index, page.data(), mFile.FormatSize);
+	}
+
+	// The children are visited even under a complete page, the run may have stopped before them.
+	std::array<std::vector<uint8_t>, 4> children;
+	for (uint32_t i = 0; i < 4 && request.Mip > 0; ++i)
+	{
+		const Page child =
+		{
+			.X = (i & 1) + (request.X << 1),
+			.Y = (i >> 1) + (request.Y << 1),
+			.Mip = request.Mip - 1
 		};
-		mRawData2xTile.Mipmap(image.Data, p, mRawData2xTile.Width, image.FormatSize);
+		if (!BuildSubtree(source, child, complete ? nullptr : &children[i])) return false;
 	}
-}
\ No newline at end of file
+	if (complete) return true;
+
+	page.resize((size_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFile.FormatSize);
+	if (request.Mip == 0)
+	{
+		CutTile(source, request, page.data());
+	}
+	else
+	{
+		DownsampleTile({ children[0].data(), children[1].data(), children[2].data(), children[3].data() }, page.data());
+	}
+
+	WritePage(request, page.data());
+	return true;
+}
+
+void ProTerGen::VT::BMPTileGenerator::WritePage(const Page& page, const uint8_t* data)
+{
+	mTileDataFile.WritePage(mPageIndexer.PageIndex(page), (data_ptr)data);
+	mBytesWritten.fetch_add((uint64_t)mInfo->BorderedTileSize() * mInfo->BorderedTileSize() * mFile.FormatSize);
+}
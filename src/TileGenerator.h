@@ -1,6 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <array>
+#include <atomic>
+#include <vector>
 #include "CommonHeaders.h"
 
 #include "VirtualTextureCommon.h"
@@ -40,8 +43,19 @@ namespace ProTerGen
 			void Generate() override;
 
 			void Close() override;
+
+			// Bytes of pages written per second by the last Generate.
+			static double MetricGetThroughputMBs();
 		private:
-			void CopyTile(ImageRawData& image, const Page& request);
+			// Mip 0: the bordered page cut from the mapped source, clamped to the image edges.
+			void CutTile(const uint8_t* source, const Page& request, uint8_t* data) const;
+			// Mip > 0: box filter of the interiors of the four children (x + 2 * y order), borders clamped.
+			void DownsampleTile(const std::array<const uint8_t*, 4>& children, uint8_t* data) const;
+			// Builds and writes the page and every page under it depth first, so only one branch of
+			// children is kept in memory. Pages already in the file are skipped, and read back only if data
+			// asks for the page. Returns false if the generation was cancelled.
+			bool BuildSubtree(const uint8_t* source, const Page& request, std::vector<uint8_t>* data);
+			void WritePage(const Page& page, const uint8_t* data);
 
 		private:
 			const char IncompleteChar = 'i';
@@ -54,8 +68,9 @@ namespace ProTerGen
 			std::atomic_bool mRun;
 			std::function<void(void)> mOnFinish = []() {};
 
-			ImageRawData mRawDataPage;
-			ImageRawData mRawData2xTile;
+			std::atomic<uint64_t> mBytesWritten = 0;
+
+			static double sMetricThroughputMBs;
 		};
 
 		
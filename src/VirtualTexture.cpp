@@ -136,6 +136,13 @@ ProTerGen::VT::Quadtree* ProTerGen::VT::Quadtree::FindPage(const Page& request,
 
 ProTerGen::VT::StagingBufferPool::~StagingBufferPool()
 {
+	if (mMapped)
+	{
+		for (Microsoft::WRL::ComPtr<ID3D12Resource>& res : mResources)
+		{
+			res->Unmap(0, nullptr);
+		}
+	}
 }
 
 void ProTerGen::VT::StagingBufferPool::Init
@@ -182,6 +189,21 @@ void ProTerGen::VT::StagingBufferPool::Next()
 	mIndex = (++mIndex) % (mResources.size());
 }
 
+std::vector<ProTerGen::VT::data_ptr> ProTerGen::VT::StagingBufferPool::MapAll()
+{
+	assert(mAccess == WRITE_TO_GPU && "Only perform writing operations.");
+	assert(!mMapped && "Already mapped.");
+
+	std::vector<data_ptr> mapped(mResources.size(), nullptr);
+	const D3D12_RANGE noRead = { .Begin = 0, .End = 0 };
+	for (size_t i = 0; i < mResources.size(); ++i)
+	{
+		ThrowIfFailed(mResources[i]->Map(0, &noRead, &mapped[i]));
+	}
+	mMapped = true;
+	return mapped;
+}
+
 void ProTerGen::VT::StagingBufferPool::WriteFrom(const data_ptr src, const Rectangle& dstRegion)
 {
 	assert(mAccess == WRITE_TO_GPU && "Only perform writing operations.");
@@ -335,6 +357,22 @@ void ProTerGen::VT::StagingBufferPool::WriteTo(data_ptr dst)
 	res->Unmap(0, nullptr);
 }
 
+const void* ProTerGen::VT::StagingBufferPool::MapRead()
+{
+	assert(mAccess == READ_FROM_GPU && "Only perform reading operations.");
+
+	data_ptr map = nullptr;
+	const D3D12_RANGE range = { .Begin = 0, .End = RowPitch() * mHeight };
+	ThrowIfFailed(mResources[mIndex]->Map(0, &range, &map));
+	return map;
+}
+
+void ProTerGen::VT::StagingBufferPool::UnmapRead()
+{
+	const D3D12_RANGE noWrite = { .Begin = 0, .End = 0 };
+	mResources[mIndex]->Unmap(0, &noWrite);
+}
+
 void ProTerGen::VT::FeedbackBuffer::Init
 (
 	Microsoft::WRL::ComPtr<ID3D12Device> device,
@@ -346,7 +384,7 @@ void ProTerGen::VT::FeedbackBuffer::Init
 	mInfo = info;
 	mSize = size;
 
-	mIndexer.Init(*info);
+	mAnalyzer.Init(*info, (uint32_t)mSize, (uint32_t)mSize);
 
 	{
 		// Create a new resource for RT and DS.
@@ -354,7 +392,7 @@ void ProTerGen::VT::FeedbackBuffer::Init
 		CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_DEFAULT);
 		CD3DX12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Tex2D
 		(
-			DXGI_FORMAT_R32G32B32A32_FLOAT,
+			FORMAT,
 			mSize,
 			(uint32_t)mSize,
 			1,
@@ -363,7 +401,7 @@ void ProTerGen::VT::FeedbackBuffer::Init
 			0,
 			D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET
 		);
-		D3D12_CLEAR_VALUE clearColor = { .Format = DXGI_FORMAT_R32G32B32A32_FLOAT, .Color = { 0.0f, 0.0f, 0.0f, 0.0f } };
+		D3D12_CLEAR_VALUE clearColor = { .Format = FORMAT, .Color = { 0.0f, 0.0f, 0.0f, 0.0f } };
 		ThrowIfFailed(device->CreateCommittedResource
 		(
 			&heapProps,
@@ -409,7 +447,7 @@ void ProTerGen::VT::FeedbackBuffer::Init
 
 		D3D12_RENDER_TARGET_VIEW_DESC rtvDesc =
 		{
-			.Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
+			.Format = FORMAT,
 			.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D,
 			.Texture2D =
 			{
@@ -441,7 +479,7 @@ void ProTerGen::VT::FeedbackBuffer::Init
 		mDepthStencilBuffer->SetName(L"VT_FeedbackBufferDS");
 	}
 
-	mResources.Init(device, (uint32_t)mSize, (uint32_t)mSize, sizeof(float) * 4, 1, StagingBufferPool::Access::READ_FROM_GPU);
+	mResources.Init(device, (uint32_t)mSize, (uint32_t)mSize, sizeof(uint32_t), 1, StagingBufferPool::Access::READ_FROM_GPU);
 
 	mViewport =
 	{
@@ -473,7 +511,7 @@ void ProTerGen::VT::FeedbackBuffer::Clear
 	commandList->ClearRenderTargetView(rtHandle, color, 0, nullptr);
 	commandList->ClearDepthStencilView(dsHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 
-	mRequests.clear();
+	mAnalyzer.Clear();
 }
 
 void ProTerGen::VT::FeedbackBuffer::SetAsReadable(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList)
@@ -523,48 +561,10 @@ void ProTerGen::VT::FeedbackBuffer::Copy(Microsoft::WRL::ComPtr<ID3D12GraphicsCo
 }
 
 void ProTerGen::VT::FeedbackBuffer::Download()
-{	
-	_Color color = { 0.0f, 0.0f, 0.0f, 0.0f };
-	const uint32_t dataSize = sizeof(color);
-	data_ptr data = malloc(mSize * mSize * dataSize);
-	if (!data)
-	{
-		assert(data != nullptr && "Error in memory buffer creation for downloading feddback buffer.");
-		return;
-	}
-	mResources.WriteTo(data);
-
-	for (size_t i = 0; i < (size_t)mSize * mSize; ++i)
-	{
-		color = ((_Color*)data)[i];
-		if (color.w >= 0.99f)
-		{
-			Page request = { .X = (uint32_t)color.x, .Y = (uint32_t)color.y, .Mip = (uint32_t)color.z };
-			AddRequest(request);
-		}
-	}
-
-	free(data);
-}
-
-void ProTerGen::VT::FeedbackBuffer::AddRequest(Page request)
 {
-	const uint32_t pageTableSize = mInfo->VTTilesPerRowExp;
-	const uint32_t count = pageTableSize - request.Mip + 1;
-
-	for (uint32_t i = 0; i < count; ++i)
-	{
-		const uint32_t xpos = request.X >> i;
-		const uint32_t ypos = request.Y >> i;
-		Page page = { .X = xpos, .Y = ypos, .Mip = request.Mip + i };
-
-		if (!mIndexer.IsValid(page))
-		{
-			return;
-		}
-
-		++mRequests[mIndexer.PageIndex(page)];
-	}
+	const void* pixels = mResources.MapRead();
+	mAnalyzer.Analyze(pixels, mResources.RowPitch());
+	mResources.UnmapRead();
 }
 
 void ProTerGen::VT::PageTableIndirection::Init(Microsoft::WRL::ComPtr<ID3D12Device> device, const VTDesc* info, Texture* const& texture)
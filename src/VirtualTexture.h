@@ -14,6 +14,8 @@
 #include "PointerHelper.h"
 #include "LRUCache.h"
 #include "PageLoaderGpuGen.h"
+#include "FeedbackAnalyzer.h"
+#include "Config.h"
 
 #if _DEBUG && PRINT_PERFORMANCE_TIMES
 #include "Timer.h"
@@ -75,6 +77,10 @@ namespace ProTerGen
 			);
 
 			void Next();
+			inline void Select(uint32_t index) { mIndex = index; }
+			inline size_t BufferSize() const { return (size_t)mWidth * mHeight * mFormatSize; }
+			// Maps every buffer until the pool is destroyed, so they can be written without WriteFrom.
+			std::vector<data_ptr> MapAll();
 
 			void WriteFrom(const data_ptr src, const Rectangle& dstRegion);
 			void WriteFrom(const data_ptr src, const Rectangle& srcRegion, const Point& dstOffset);
@@ -98,6 +104,10 @@ namespace ProTerGen
 				Microsoft::WRL::ComPtr<ID3D12Resource> srcTexture
 			);
 			void WriteTo(data_ptr dst);
+			// The current buffer, readable until UnmapRead. Rows are RowPitch bytes apart.
+			const void* MapRead();
+			void UnmapRead();
+			inline size_t RowPitch() const { return Align((size_t)mWidth * mFormatSize, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1); }
 
 		private:
 			std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mResources;
@@ -106,6 +116,7 @@ namespace ProTerGen
 			uint32_t mHeight = 0;
 			uint32_t mFormatSize = 0;
 			Access mAccess = WRITE_TO_GPU;
+			bool mMapped = false;
 		};
 
 		// Physical Texture in GPU. Holds pages in GPU.
@@ -138,6 +149,22 @@ namespace ProTerGen
 				{
 					const uint32_t alignedPageSize = (uint32_t)Align(mInfo->BorderedTileSize() * textureSizesPerTexel[i], D3D12_TEXTURE_DATA_PITCH_ALIGNMENT - 1) / textureSizesPerTexel[i];
 					mStagingBufferPool[i].Init(device, alignedPageSize, pageSize, textureSizesPerTexel[i], auxiliarBufferCount, StagingBufferPool::Access::WRITE_TO_GPU);
+
+					// Room for the uploads of the frames in flight and of the frames still loading.
+					const uint32_t sliceCount = auxiliarBufferCount * (gNumFrames + STAGING_RING_LOADING_FRAMES);
+					mStagingRingBuffers[i].Init(device, alignedPageSize, pageSize, textureSizesPerTexel[i], sliceCount, StagingBufferPool::Access::WRITE_TO_GPU);
+					mStagingRings[i].Init(mStagingRingBuffers[i].MapAll(), mStagingRingBuffers[i].BufferSize(), gNumFrames);
+				}
+			}
+
+			inline StagingRing* GetStagingRing(uint32_t id) { return &mStagingRings[id]; }
+
+			// Once per frame, before the uploads.
+			void Retire()
+			{
+				for (uint32_t i = 0; i < _Size; ++i)
+				{
+					mStagingRings[i].Retire();
 				}
 			}
 
@@ -158,7 +185,7 @@ namespace ProTerGen
 				}
 			}
 
-			void UploadPage(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const Point& position, std::vector<data_ptr>& data)
+			void UploadPage(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const Point& position, const std::array<PageBuffer, MultiPage::MAX_TEXTURES>& data)
 			{
 				CD3DX12_RESOURCE_BARRIER barriers[_Size] = {};
 				for (uint32_t i = 0; i < _Size; ++i)
@@ -184,10 +211,21 @@ namespace ProTerGen
 				for (uint32_t i = 0; i < _Size; ++i)
 				{
 					Texture*& texture = mTextures[i];
-					StagingBufferPool& bufferPool = mStagingBufferPool[i];
-					bufferPool.WriteFrom(data[i], alignedPageRect);
-					bufferPool.CopyTo(commandList, texture->Resource, pageRect, sizeInPoint);
-					bufferPool.Next();
+					const int32_t slice = mStagingRings[i].SliceIndex(data[i]);
+					if (slice >= 0)
+					{
+						// Loaded straight into the staging memory, only the copy is left.
+						StagingBufferPool& ringBuffers = mStagingRingBuffers[i];
+						ringBuffers.Select((uint32_t)slice);
+						ringBuffers.CopyTo(commandList, texture->Resource, pageRect, sizeInPoint);
+					}
+					else
+					{
+						StagingBufferPool& bufferPool = mStagingBufferPool[i];
+						bufferPool.WriteFrom(data[i].Data(), alignedPageRect);
+						bufferPool.CopyTo(commandList, texture->Resource, pageRect, sizeInPoint);
+						bufferPool.Next();
+					}
 
 					barriers[i] = CD3DX12_RESOURCE_BARRIER::Transition
 					(
@@ -267,6 +305,7 @@ namespace ProTerGen
 			}
 
 		private:
+			static constexpr uint32_t STAGING_RING_LOADING_FRAMES = 2;
 
 			uint32_t mColumns = 0;
 			uint32_t mRows = 0;
@@ -275,6 +314,8 @@ namespace ProTerGen
 
 			std::array<Texture*, _Size> mTextures = {};
 			std::array<StagingBufferPool, _Size> mStagingBufferPool = {};
+			std::array<StagingBufferPool, _Size> mStagingRingBuffers = {}; // Mapped memory behind mStagingRings.
+			std::array<StagingRing, _Size> mStagingRings = {};
 		};		
 
 		// Manages texture atlas and tracks page loading
@@ -282,7 +323,7 @@ namespace ProTerGen
 		{
 		private:
 			using submit_func_t = std::function<void(const Page&)>;
-			using upload_func_t = std::function<void(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Point&, std::vector<void*>&)>;
+			using upload_func_t = std::function<void(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Point&, const std::array<PageBuffer, MultiPage::MAX_TEXTURES>&)>;
 			using add_func_t    = std::function<void(const Page&, const Point&)>;
 			using remove_func_t = std::function<void(const Page&, const Point&)>;
 		public:
@@ -299,7 +340,7 @@ namespace ProTerGen
 			void LoadComplete(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const MultiPage&data);
 		private:
 			submit_func_t mSubmit = [](const Page&) {};
-			upload_func_t mUploadData = [](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Point&, std::vector<void*>&) {};
+			upload_func_t mUploadData = [](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Point&, const std::array<PageBuffer, MultiPage::MAX_TEXTURES>&) {};
 			add_func_t mOnPageAdded = [](const Page&, const Point&) {};
 			remove_func_t mOnRemove = [](const Page&, const Point&) {};
 
@@ -350,6 +391,8 @@ namespace ProTerGen
 		public:
 			static const uint32_t RTVCount = 1;
 			static const uint32_t DSVCount = 1;
+			// One packed pixel per request, see FeedbackAnalyzer.
+			static const DXGI_FORMAT FORMAT = DXGI_FORMAT_R32_UINT;
 
 			void Init
 			(
@@ -369,47 +412,19 @@ namespace ProTerGen
 			void Copy(Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList);
 			void Download();
 
-			const std::unordered_map<uint32_t, uint32_t>& Requests() { return mRequests; }
+			const PageRequests& Requests() { return mAnalyzer.Requests(); }
 		private:
-			struct _Color { float x; float y; float z; float w; };
-
-			void AddRequest(Page request);
-
 			Microsoft::WRL::ComPtr<ID3D12Resource> mRenderTargetBuffer = nullptr;
 			Microsoft::WRL::ComPtr<ID3D12Resource> mDepthStencilBuffer = nullptr;
 			const VTDesc* mInfo = nullptr;
 			D3D12_VIEWPORT mViewport{};
 			size_t mSize = 0;
 
-			PageIndexer mIndexer{};
-
-			std::unordered_map<uint32_t, uint32_t> mRequests{};
+			FeedbackAnalyzer mAnalyzer{};
 
 			StagingBufferPool mResources{};
 		};		
 
-		struct PageCount
-		{
-			Page page;
-			uint32_t count;
-
-			static bool Comparator(const PageCount& lhs, const PageCount& rhs)
-			{
-				if (rhs.page.Mip == lhs.page.Mip)
-				{
-					if (rhs.count < lhs.count)
-					{
-						return true;
-					}
-				}
-				if (rhs.page.Mip < lhs.page.Mip)
-				{
-					return true;
-				}
-				return false;
-			}
-		};
-
 		template<typename Generator>
 		// All the data management relating to Virtual Textures
 		class VirtualTexture
@@ -461,6 +476,7 @@ namespace ProTerGen
 
 				mIndexer = std::make_unique<PageIndexer>();
 				mIndexer->Init(*mInfo);
+				mToLoad.resize((size_t)mInfo->VTTilesPerRowExp + 1);
 
 				mLoader = std::make_unique<Generator>();
 				mLoader->Init(mIndexer.get(), mInfo, std::move(computeContext), 1);
@@ -477,9 +493,16 @@ namespace ProTerGen
 					mInfo->AtlasTilesPerRow
 				);
 
+				std::array<StagingRing*, MultiPage::MAX_TEXTURES> stagingRings = {};
+				for (uint32_t i = 0; i < Generator::TEXTURES_COUNT(); ++i)
+				{
+					stagingRings[i] = mTextureAtlas->GetStagingRing(i);
+				}
+				mLoader->StagingRings(stagingRings);
+
 				mCache = std::make_unique<PageCache>();
 				mCache->OnPageRequestedToAdd([&](const Page& p) { mLoader->Submit(p); });
-				mCache->OnPageDataComputedUpload([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const Point& position, std::vector<data_ptr>& data)
+				mCache->OnPageDataComputedUpload([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList, const Point& position, const std::array<PageBuffer, MultiPage::MAX_TEXTURES>& data)
 					{
 						mTextureAtlas->UploadPage(commandList, position, data);
 					});
@@ -492,38 +515,43 @@ namespace ProTerGen
 				mPageTable->Init(device, info, indirectionTexture);
 			}
 
+			// Once per frame, before any Update. Staging memory of the uploads the GPU is done with can be reused.
+			inline void BeginFrame()
+			{
+				mTextureAtlas->Retire();
+			}
+
 			inline virtual void Update
 			(
 				Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList,
-				const std::unordered_map<uint32_t, uint32_t>& requests
+				const PageRequests& requests
 			)
 			{
 				const size_t atlas2 = (size_t)mInfo->AtlasTilesPerRow * mInfo->AtlasTilesPerRow;
-				std::vector<PageCount> toLoad{};
+				for (std::vector<PageCount>& bucket : mToLoad)
+				{
+					bucket.clear();
+				}
 
-				//size_t updated = 0;
-				for (const auto& [page_index, num_requests] : requests)
+				size_t toLoadCount = 0;
+				for (const PageIndex page_index : requests.Touched())
 				{
+					const uint32_t num_requests = requests.Count(page_index);
 					const Page p = mIndexer->GetPage(page_index);
 
 					// Not updated is the same as say that not contains. If the cache updates the page is because it's contained.
 					if (!mCache->UpdatePagePosition(p))
 					{
-						toLoad.push_back(PageCount{ .page = std::move(p), .count = num_requests });
+						mToLoad[p.Mip].push_back(PageCount{ .page = std::move(p), .count = num_requests });
+						++toLoadCount;
 					}
 				}
 
-				const size_t updated = requests.size() - toLoad.size();
+				const size_t updated = requests.Size() - toLoadCount;
 				if (updated < atlas2)
 				{
-					std::sort(toLoad.begin(), toLoad.end(), PageCount::Comparator);
-
-					const uint32_t loadCount = (uint32_t)min(min(toLoad.size(), (size_t)mUploadsPerFrame), atlas2);
-
-					for (uint32_t i = 0; i < loadCount; ++i)
-					{
-						mCache->Request(toLoad[i].page);
-					}
+					const size_t loadCount = min(min(toLoadCount, (size_t)mUploadsPerFrame), atlas2);
+					SelectPageLoads(mToLoad, loadCount, [&](const Page& page) { mCache->Request(page); });
 				}
 				else
 				{
@@ -552,6 +580,8 @@ namespace ProTerGen
 			std::unique_ptr<PageCache>                                                   mCache        = nullptr;
 			uint32_t mMipBias = 0;
 			uint32_t mUploadsPerFrame = 0;
+
+			std::vector<std::vector<PageCount>> mToLoad{}; // Pages to load per mip, reused every frame.
 		};
 
 	}
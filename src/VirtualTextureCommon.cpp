@@ -1,91 +1,6 @@
 #include "VirtualTextureCommon.h"
 #include "MathHelpers.h"
-
-void ProTerGen::VT::PageIndexer::Init(const VTDesc& desc)
-{
-	/*
-	*  Page: Coords(x, y) at mip N.
-	*
-	*  Mip 0 (size = 4 * 4, offset = 0) :
-	*  +----------+-----------+-----------+-----------+
-	*  |          |           |           |           |
-	*  |    0     |     1     |     2     |     3     |
-	*  |          |           |           |           |
-	*  +----------+-----------+-----------+-----------+
-	*  |          |           |           |           |
-	*  |    4     |     5     |     6     |     7     |
-	*  |          |           |           |           |
-	*  +----------+-----------+-----------+-----------+
-	*  |          |           |           |           |
-	*  |    8     |     9     |    10     |    11     |
-	*  |          |           |           |           |
-	*  +----------+-----------+-----------+-----------+
-	*  |          |           |           |           |
-	*  |    12    |     13    |     14    |     15    |
-	*  |          |           |           |           |
-	*  +----------+-----------+-----------+-----------+
-	*
-	*  Mip 1 (size = 2 * 2, offset = 16) :
-	*  +----------+-----------+
-	*  |          |           |
-	*  |    16    |     17    |
-	*  |          |           |
-	*  +----------+-----------+
-	*  |          |           |
-	*  |    18    |     19    |
-	*  |          |           |
-	*  +----------+-----------+
-	*
-	*  Mip 2 (size = 1 * 1, offset = 20):
-	*  +----------+
-	*  |          |
-	*  |    20    |
-	*  |          |
-	*  +----------+
-	*/
-
-
-	mMipCount = desc.VTTilesPerRowExp + 1;
-
-	mSizes.resize(mMipCount);
-	mOffsets.resize(mMipCount);
-	mCount = 0;
-	for (uint32_t i = 0; i < mMipCount; ++i)
-	{
-		mSizes[i] = (desc.VTSize / desc.TileSize()) >> i;
-		mOffsets[i] = mCount;
-		mCount += (size_t)mSizes[i] * mSizes[i];
-	}
-
-	mReverse.resize(mCount);
-	for (uint32_t i = 0; i < mMipCount; ++i)
-	{
-		size_t size = mSizes[i];
-		for (size_t y = 0; y < size; ++y)
-		{
-			for (size_t x = 0; x < size; ++x)
-			{
-				Page p = { .X = (uint32_t)x, .Y = (uint32_t)y, .Mip = i };
-				mReverse[PageIndex(p)] = p;
-			}
-		}
-	}
-}
-
-ProTerGen::VT::PageIndex ProTerGen::VT::PageIndexer::PageIndex(const Page& page) const
-{
-	assert(page.Mip < mMipCount);
-
-	const size_t offset = mOffsets[page.Mip];
-	const size_t stride = mSizes[page.Mip];
-
-	return (uint32_t)(offset + page.Y * stride + page.X);
-}
-
-const ProTerGen::VT::Page& ProTerGen::VT::PageIndexer::GetPage(uint32_t idx) const
-{
-	return mReverse.at(idx);
-}
+#include "ConcurrentQueue.h"
 
 void ProTerGen::VT::LightPageIndexer::Init(uint32_t maxMipCount)
 {
@@ -115,3 +30,185 @@ ProTerGen::VT::Page ProTerGen::VT::LightPageIndexer::GetPage(uint32_t idx) const
 	return Page{ .X = (uint16_t)(newIndex % size), .Y = (uint16_t)(newIndex / size), .Mip = (uint8_t)(mMaxMip - lod) };
 }
 
+void ProTerGen::VT::PageRequests::Init(size_t pageCount)
+{
+	mCounts.assign(pageCount, 0);
+	mTouched.clear();
+}
+
+void ProTerGen::VT::PageRequests::Clear()
+{
+	for (const PageIndex index : mTouched)
+	{
+		mCounts[index] = 0;
+	}
+	mTouched.clear();
+}
+
+std::atomic<uint64_t> ProTerGen::VT::PageBufferPool::sMetricAllocations = 0;
+
+ProTerGen::VT::PageBuffer::PageBuffer(PageBuffer&& other) noexcept
+	: mSource(other.mSource), mData(other.mData)
+{
+	other.mSource = nullptr;
+	other.mData = nullptr;
+}
+
+ProTerGen::VT::PageBuffer& ProTerGen::VT::PageBuffer::operator=(PageBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		Reset();
+		mSource = other.mSource;
+		mData = other.mData;
+		other.mSource = nullptr;
+		other.mData = nullptr;
+	}
+	return *this;
+}
+
+ProTerGen::VT::PageBuffer::~PageBuffer()
+{
+	Reset();
+}
+
+void ProTerGen::VT::PageBuffer::Reset()
+{
+	if (mData)
+	{
+		mSource->Release(mData);
+		mSource = nullptr;
+		mData = nullptr;
+	}
+}
+
+ProTerGen::VT::PageBufferPool::~PageBufferPool()
+{
+	Free();
+}
+
+void ProTerGen::VT::PageBufferPool::Init(size_t bufferSize, size_t count)
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	if (bufferSize != mBufferSize)
+	{
+		assert(mFree.size() == mBuffers.size() && "Page buffers still in use");
+		Free();
+		mBufferSize = bufferSize;
+	}
+
+	mBuffers.reserve(count);
+	mFree.reserve(count);
+	while (mBuffers.size() < count)
+	{
+		data_ptr data = malloc(mBufferSize);
+		assert(data != nullptr && "Not enough memory to complete operation");
+		mBuffers.push_back(data);
+		mFree.push_back(data);
+		sMetricAllocations.fetch_add(1);
+	}
+}
+
+ProTerGen::VT::PageBuffer ProTerGen::VT::PageBufferPool::Acquire()
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	if (mFree.empty())
+	{
+		data_ptr data = malloc(mBufferSize);
+		assert(data != nullptr && "Not enough memory to complete operation");
+		mBuffers.push_back(data);
+		mFree.reserve(mBuffers.capacity());
+		sMetricAllocations.fetch_add(1);
+		return Wrap(data);
+	}
+
+	data_ptr data = mFree.back();
+	mFree.pop_back();
+	return Wrap(data);
+}
+
+uint64_t ProTerGen::VT::PageBufferPool::MetricGetAllocations()
+{
+	return sMetricAllocations.load() + ConcurrentQueueMetrics::sMetricAllocations.load();
+}
+
+void ProTerGen::VT::PageBufferPool::MetricResetAllocations()
+{
+	sMetricAllocations.store(0);
+	ConcurrentQueueMetrics::sMetricAllocations.store(0);
+}
+
+void ProTerGen::VT::PageBufferPool::Release(data_ptr data)
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	mFree.push_back(data);
+}
+
+void ProTerGen::VT::PageBufferPool::Free()
+{
+	for (data_ptr data : mBuffers)
+	{
+		free(data);
+	}
+	mBuffers.clear();
+	mFree.clear();
+}
+
+void ProTerGen::VT::StagingRing::Init(const std::vector<data_ptr>& slices, size_t sliceSize, uint32_t framesInFlight)
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	assert(mFree.size() + mRetired.size() == mSlices.size() && "Staging slices still in use");
+	mSliceSize = sliceSize;
+	mFramesInFlight = framesInFlight;
+	mSlices = slices;
+	mFree = slices;
+	mRetired.clear();
+	mRetired.reserve(slices.size());
+}
+
+ProTerGen::VT::PageBuffer ProTerGen::VT::StagingRing::Acquire()
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	if (mFree.empty())
+	{
+		return PageBuffer();
+	}
+
+	data_ptr data = mFree.back();
+	mFree.pop_back();
+	return Wrap(data);
+}
+
+int32_t ProTerGen::VT::StagingRing::SliceIndex(const PageBuffer& buffer) const
+{
+	if (buffer.Source() != this)
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < mSlices.size(); ++i)
+	{
+		if (mSlices[i] == buffer.Data()) return (int32_t)i;
+	}
+	return -1;
+}
+
+void ProTerGen::VT::StagingRing::Retire()
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	++mFrame;
+
+	size_t retired = 0;
+	while (retired < mRetired.size() && mRetired[retired].Frame + mFramesInFlight <= mFrame)
+	{
+		mFree.push_back(mRetired[retired].Data);
+		++retired;
+	}
+	mRetired.erase(mRetired.begin(), mRetired.begin() + retired);
+}
+
+void ProTerGen::VT::StagingRing::Release(data_ptr data)
+{
+	std::lock_guard<std::mutex> lg(mMutex);
+	mRetired.push_back({ .Data = data, .Frame = mFrame });
+}
@@ -1,42 +1,18 @@
 #pragma once
 
 #include "CommonHeaders.h"
+#include "VirtualTextureTypes.h"
 
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <unordered_set>
+#include <vector>
 
 namespace ProTerGen
 {
 	namespace VT
 	{
-		struct Page
-		{
-			uint32_t X = 0xffffffff;
-			uint32_t Y = 0xffffffff;
-			uint32_t Mip = 0xffffffff;
-
-			inline bool operator==(const Page& rhs) const { return X == rhs.X && Y == rhs.Y && Mip == rhs.Mip; };
-		};
-	}
-}
-
-template<>
-struct std::hash<ProTerGen::VT::Page>
-{
-	size_t operator()(ProTerGen::VT::Page const& page) const noexcept
-	{
-		const size_t s1 = std::hash<uint32_t>{}(page.X);
-		const size_t s2 = std::hash<uint32_t>{}(page.Y);
-		const size_t s3 = std::hash<uint32_t>{}(page.Mip);
-
-		return s3 ^ (s2 << 4) ^ (s1 << 32);
-	}
-};
-
-namespace ProTerGen
-{
-	namespace VT
-	{
-		typedef uint32_t PageIndex;
 		typedef void* data_ptr;
 		typedef unsigned char* byte_ptr;
 		typedef unsigned char byte;
@@ -50,118 +26,167 @@ namespace ProTerGen
 		const DXGI_FORMAT VT_NORMAL_FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
 		const uint32_t VT_NORMAL_BYTES_PER_PIXEL = 4;
 
-		struct VTDesc
+		class LightPageIndexer
 		{
-			uint32_t VTSize = 0;
-			uint32_t VTTilesPerRowExp = 0;
-			uint32_t AtlasTilesPerRow = 0;
-			uint32_t BorderSize = 0;
-
-			constexpr uint32_t VTTilesPerRow() const { return (1 << VTTilesPerRowExp); }
-			constexpr uint32_t TileSize() const { return VTSize / (1 << VTTilesPerRowExp); }
-			constexpr uint32_t BorderedTileSize() const { return TileSize() + 2 * BorderSize; }
-			constexpr uint32_t AtlasSize() const { return BorderedTileSize() * AtlasTilesPerRow; }
+		public:
+			void Init(uint32_t maxMipCount);
+			PageIndex PageIndex(const Page& page) const;
+			Page GetPage(uint32_t idx) const;
+
+			constexpr size_t GetCount() const { return (((size_t)1 << 2 * (mMaxMip + 1)) - 1) / 3; }
+		private:
+			uint32_t mMaxMip = 0;
 		};
 
-		class PageIndexer
+		// Requests per page over the dense index space of a page indexer. The first request of a page records it as
+		// touched, so iterating and clearing cost the pages requested instead of every page. Reused frame to frame.
+		class PageRequests
 		{
 		public:
-			void Init(const VTDesc& desc);
+			void Init(size_t pageCount);
+			void Clear();
 
-			PageIndex PageIndex(const Page& page) const;
-			const Page& GetPage(uint32_t idx) const;
-
-			constexpr bool IsValid(const Page& page) const
+			inline void Add(PageIndex index, uint32_t count = 1)
 			{
-				return (page.Mip < mMipCount) && (page.X < mSizes[page.Mip]) && (page.Y < mSizes[page.Mip]);
+				if (mCounts[index] == 0)
+				{
+					mTouched.push_back(index);
+				}
+				mCounts[index] += count;
 			}
+			inline uint32_t Count(PageIndex index) const { return mCounts[index]; }
+			// Every page with requests, in the order they were first requested.
+			inline const std::vector<PageIndex>& Touched() const { return mTouched; }
+			inline size_t Size() const { return mTouched.size(); }
 
-			constexpr size_t GetCount() const { return mCount; }
 		private:
-			uint32_t mMipCount = 0;
-			size_t mCount = 0;
-			std::vector<size_t> mOffsets;
-			std::vector<size_t> mSizes;
-			std::vector<Page> mReverse;
+			std::vector<uint32_t> mCounts;
+			std::vector<PageIndex> mTouched;
 		};
 
-		class LightPageIndexer
+
+		class PageBufferSource;
+
+		// A page sized buffer taken from a PageBufferSource, given back when the handle is destroyed. Move only, so
+		// every buffer has a single owner on its way from the loader to the upload.
+		class PageBuffer
 		{
 		public:
-			void Init(uint32_t maxMipCount);
-			PageIndex PageIndex(const Page& page) const;
-			Page GetPage(uint32_t idx) const;
+			PageBuffer() = default;
+			PageBuffer(PageBuffer&& other) noexcept;
+			PageBuffer& operator=(PageBuffer&& other) noexcept;
+			PageBuffer(const PageBuffer&) = delete;
+			PageBuffer& operator=(const PageBuffer&) = delete;
+			~PageBuffer();
+
+			inline data_ptr Data() const { return mData; }
+			inline const PageBufferSource* Source() const { return mSource; }
+			inline explicit operator bool() const { return mData != nullptr; }
+			void Reset();
+
 		private:
-			uint32_t mMaxMip = 0;
+			friend class PageBufferSource;
+			PageBuffer(PageBufferSource* source, data_ptr data) : mSource(source), mData(data) {}
+
+			PageBufferSource* mSource = nullptr;
+			data_ptr mData = nullptr;
 		};
 
+		// Where the memory of PageBuffers comes from. Must outlive the buffers it hands out.
+		class PageBufferSource
+		{
+		public:
+			virtual ~PageBufferSource() = default;
 
-		struct ReadState
+		protected:
+			friend class PageBuffer;
+			inline PageBuffer Wrap(data_ptr data) { return PageBuffer(this, data); }
+			virtual void Release(data_ptr data) = 0;
+		};
+
+		// Fixed size buffers recycled between the loaders and the uploads. Once the pool holds as many buffers as
+		// pages are in flight, streaming allocates nothing.
+		class PageBufferPool : public PageBufferSource
 		{
-			Page page = {};
-			mutable data_ptr data = nullptr;
+		public:
+			PageBufferPool() = default;
+			PageBufferPool(const PageBufferPool&) = delete;
+			PageBufferPool& operator=(const PageBufferPool&) = delete;
+			~PageBufferPool();
+
+			// Buffers of bufferSize bytes, count of them allocated now. Changing the size drops the buffers, so it
+			// can only be done while none is in use.
+			void Init(size_t bufferSize, size_t count);
+			// A free buffer, or a new one when all are in use. Can be called from any thread.
+			PageBuffer Acquire();
+			inline size_t BufferSize() const { return mBufferSize; }
+
+			// Allocations on the page path since the last reset: the buffers of every pool and the rings of the page
+			// queues. Once warm, loading pages adds none.
+			static uint64_t MetricGetAllocations();
+			static void MetricResetAllocations();
 
-			ReadState() : page(), data(nullptr) {}
+		private:
+			void Release(data_ptr data) override;
+			void Free();
 
-			ReadState(const ReadState& lhs)
-			{
-				page = lhs.page;
-				data = lhs.data;
-				lhs.data = nullptr;
-			}
+			std::mutex mMutex;
+			size_t mBufferSize = 0;
+			std::vector<data_ptr> mBuffers;
+			std::vector<data_ptr> mFree; // Capacity for every buffer, giving one back never allocates.
 
-			ReadState& operator=(const ReadState& lhs)
-			{
-				page = lhs.page;
-				data = lhs.data;
-				lhs.data = nullptr;
-				return *this;
-			}
+			static std::atomic<uint64_t> sMetricAllocations;
+		};
 
-			~ReadState()
+		// Slices of memory the GPU copies pages from, like mapped upload buffers, handed to the loaders so they write
+		// each page where the upload reads it. The memory belongs to the caller of Init. A slice given back is not
+		// handed out again until Retire was called framesInFlight times, the GPU may still be reading it.
+		class StagingRing : public PageBufferSource
+		{
+		public:
+			StagingRing() = default;
+			StagingRing(const StagingRing&) = delete;
+			StagingRing& operator=(const StagingRing&) = delete;
+
+			void Init(const std::vector<data_ptr>& slices, size_t sliceSize, uint32_t framesInFlight);
+			// A free slice, or an empty buffer when all of them are in use. Can be called from any thread.
+			PageBuffer Acquire();
+			// Position of the slice in the slices given to Init, -1 if the buffer is not a slice of this ring.
+			int32_t SliceIndex(const PageBuffer& buffer) const;
+			inline size_t SliceSize() const { return mSliceSize; }
+			// Once per frame, from the thread recording the copies.
+			void Retire();
+
+		private:
+			struct RetiredSlice
 			{
-				if (data)
-				{
-					free(data);
-					data = nullptr;
-				}
-			}
+				data_ptr Data = nullptr;
+				uint64_t Frame = 0;
+			};
+
+			void Release(data_ptr data) override;
+
+			std::mutex mMutex;
+			size_t mSliceSize = 0;
+			uint32_t mFramesInFlight = 0;
+			uint64_t mFrame = 0;
+			std::vector<data_ptr> mSlices;
+			std::vector<data_ptr> mFree;
+			std::vector<RetiredSlice> mRetired; // In release order, capacity for every slice.
 		};
 
-		struct MultiPage
+		struct ReadState
 		{
 			Page page = {};
-			mutable std::vector<data_ptr> dataPtrs;
-
-			MultiPage() : page(), dataPtrs() {};
-			MultiPage(const Page& p, std::vector<data_ptr>& dptrs) : page(p), dataPtrs(std::move(dptrs)) {}
-
-			MultiPage(const MultiPage& lhs)
-			{
-				page = lhs.page;
-				dataPtrs = std::move(lhs.dataPtrs);
-				lhs.dataPtrs.clear();
-			}
+			PageBuffer data;
+		};
 
-			MultiPage& operator=(const MultiPage& lhs)
-			{
-				page = lhs.page;
-				dataPtrs = std::move(lhs.dataPtrs);
-				lhs.dataPtrs.clear();
-				return *this;
-			}
+		struct MultiPage
+		{
+			static constexpr uint32_t MAX_TEXTURES = 3;
 
-			~MultiPage()
-			{
-				for (auto& i : dataPtrs)
-				{
-					if (i != nullptr)
-					{
-						free(i);
-						i = nullptr;
-					}
-				}
-			}
+			Page page = {};
+			std::array<PageBuffer, MAX_TEXTURES> dataPtrs;
 		};
 	}
 }
\ No newline at end of file
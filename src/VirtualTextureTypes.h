@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Page and layout of a virtual texture, without the graphics API, so CPU only code can include them.
+namespace ProTerGen
+{
+	namespace VT
+	{
+		struct Page
+		{
+			uint32_t X = 0xffffffff;
+			uint32_t Y = 0xffffffff;
+			uint32_t Mip = 0xffffffff;
+
+			inline bool operator==(const Page& rhs) const { return X == rhs.X && Y == rhs.Y && Mip == rhs.Mip; };
+		};
+	}
+}
+
+template<>
+struct std::hash<ProTerGen::VT::Page>
+{
+	size_t operator()(ProTerGen::VT::Page const& page) const noexcept
+	{
+		const size_t s1 = std::hash<uint32_t>{}(page.X);
+		const size_t s2 = std::hash<uint32_t>{}(page.Y);
+		const size_t s3 = std::hash<uint32_t>{}(page.Mip);
+
+		return s3 ^ (s2 << 4) ^ (s1 << 32);
+	}
+};
+
+namespace ProTerGen
+{
+	namespace VT
+	{
+		typedef uint32_t PageIndex;
+
+		struct VTDesc
+		{
+			uint32_t VTSize = 0;
+			uint32_t VTTilesPerRowExp = 0;
+			uint32_t AtlasTilesPerRow = 0;
+			uint32_t BorderSize = 0;
+
+			constexpr uint32_t VTTilesPerRow() const { return (1 << VTTilesPerRowExp); }
+			constexpr uint32_t TileSize() const { return VTSize / (1 << VTTilesPerRowExp); }
+			constexpr uint32_t BorderedTileSize() const { return TileSize() + 2 * BorderSize; }
+			constexpr uint32_t AtlasSize() const { return BorderedTileSize() * AtlasTilesPerRow; }
+		};
+
+		// Orders the pages of every mip in one index: mip 0 row by row, then mip 1, and so on. It is also the order of
+		// the pages in a tile file.
+		class PageIndexer
+		{
+		public:
+			void Init(const VTDesc& desc);
+
+			VT::PageIndex PageIndex(const Page& page) const;
+			const Page& GetPage(uint32_t idx) const;
+
+			constexpr bool IsValid(const Page& page) const
+			{
+				return (page.Mip < mMipCount) && (page.X < mSizes[page.Mip]) && (page.Y < mSizes[page.Mip]);
+			}
+
+			constexpr size_t GetCount() const { return mCount; }
+		private:
+			uint32_t mMipCount = 0;
+			size_t mCount = 0;
+			std::vector<size_t> mOffsets;
+			std::vector<size_t> mSizes;
+			std::vector<Page> mReverse;
+		};
+
+		struct PageCount
+		{
+			Page page;
+			uint32_t count;
+
+			static bool Comparator(const PageCount& lhs, const PageCount& rhs)
+			{
+				if (rhs.page.Mip == lhs.page.Mip)
+				{
+					if (rhs.count < lhs.count)
+					{
+						return true;
+					}
+				}
+				if (rhs.page.Mip < lhs.page.Mip)
+				{
+					return true;
+				}
+				return false;
+			}
+
+			// Comparator within a single mip.
+			static bool CountComparator(const PageCount& lhs, const PageCount& rhs)
+			{
+				return rhs.count < lhs.count;
+			}
+		};
+
+		// Requests the count pages that sorting every bucket by PageCount::Comparator would put first, with the pages
+		// bucketed by mip. Only those are ordered: whole buckets from the coarsest mip down, and the most requested of
+		// the last one. Reorders the buckets.
+		template<typename Request>
+		void SelectPageLoads(std::vector<std::vector<PageCount>>& mipBuckets, size_t count, Request&& request)
+		{
+			for (size_t mip = mipBuckets.size(); mip-- > 0 && count > 0;)
+			{
+				std::vector<PageCount>& bucket = mipBuckets[mip];
+				const size_t take = (std::min)(count, bucket.size());
+				std::partial_sort(bucket.begin(), bucket.begin() + take, bucket.end(), PageCount::CountComparator);
+
+				for (size_t i = 0; i < take; ++i)
+				{
+					request(bucket[i].page);
+				}
+				count -= take;
+			}
+		}
+	}
+}
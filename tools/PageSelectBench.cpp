@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "VirtualTextureTypes.h"
+
+using namespace ProTerGen::VT;
+
+// Times the page load selection of VirtualTexture::Update: the full sort by PageCount::Comparator it replaced,
+// against SelectPageLoads over mip buckets, on random request sets. The texture has 512 tiles per row, so even the
+// largest set is made of distinct pages.
+//
+// Usage: PageSelectBench [uploads=5] [repetitions=50]
+
+namespace
+{
+	constexpr uint32_t VT_TILES_PER_ROW_EXP = 9;
+	constexpr uint32_t MAX_REQUEST_COUNT    = 64;
+	constexpr size_t   REQUEST_SET_SIZES[]  = { 10000, 30000, 100000 };
+
+	uint32_t ArgOr(int argc, char** argv, int index, uint32_t fallback)
+	{
+		return index < argc ? (uint32_t)std::strtoul(argv[index], nullptr, 10) : fallback;
+	}
+
+	template<typename Function>
+	double MinMilliseconds(uint32_t repetitions, Function&& function)
+	{
+		double best = 1e30;
+		for (uint32_t r = 0; r < repetitions; ++r)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			function();
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			best = (std::min)(best, elapsed.count());
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t uploads = ArgOr(argc, argv, 1, 5);
+	const uint32_t repetitions = (std::max)(1u, ArgOr(argc, argv, 2, 50));
+
+	PageIndexer indexer = {};
+	indexer.Init(VTDesc{ .VTSize = 128u << VT_TILES_PER_ROW_EXP, .VTTilesPerRowExp = VT_TILES_PER_ROW_EXP, .AtlasTilesPerRow = 1, .BorderSize = 0 });
+	const uint32_t mipCount = VT_TILES_PER_ROW_EXP + 1;
+
+	std::mt19937 rng(1234);
+	bool allMatch = true;
+	printf("%10s %12s %12s\n", "requests", "sort (ms)", "buckets (ms)");
+	for (const size_t requestCount : REQUEST_SET_SIZES)
+	{
+		// Distinct pages, as the feedback touches each at most once per frame.
+		std::vector<PageIndex> indices(indexer.GetCount());
+		for (size_t i = 0; i < indices.size(); ++i) indices[i] = (PageIndex)i;
+		std::shuffle(indices.begin(), indices.end(), rng);
+		indices.resize(requestCount);
+
+		std::uniform_int_distribution<uint32_t> counts(1, MAX_REQUEST_COUNT);
+		std::vector<PageCount> requests;
+		for (const PageIndex i : indices)
+		{
+			requests.push_back(PageCount{ .page = indexer.GetPage(i), .count = counts(rng) });
+		}
+
+		std::vector<PageCount> sorted;
+		std::vector<PageCount> sortPicks;
+		const double sortTime = MinMilliseconds(repetitions, [&]()
+			{
+				sorted.assign(requests.begin(), requests.end());
+				std::sort(sorted.begin(), sorted.end(), PageCount::Comparator);
+				sortPicks.assign(sorted.begin(), sorted.begin() + (std::min)((size_t)uploads, sorted.size()));
+			});
+
+		std::vector<std::vector<PageCount>> buckets(mipCount);
+		std::vector<PageCount> bucketPicks;
+		const double bucketTime = MinMilliseconds(repetitions, [&]()
+			{
+				for (std::vector<PageCount>& bucket : buckets) bucket.clear();
+				for (const PageCount& request : requests) buckets[request.page.Mip].push_back(request);
+				bucketPicks.clear();
+				SelectPageLoads(buckets, uploads, [&](const Page& page) { bucketPicks.push_back(PageCount{ .page = page }); });
+			});
+
+		// Pages with the same mip and count may be picked in either order, so only those are compared.
+		bool match = sortPicks.size() == bucketPicks.size();
+		for (size_t i = 0; match && i < sortPicks.size(); ++i)
+		{
+			const std::vector<PageCount>& bucket = buckets[bucketPicks[i].page.Mip];
+			const auto picked = std::find_if(bucket.begin(), bucket.end(), [&](const PageCount& pc) { return pc.page == bucketPicks[i].page; });
+			match = picked != bucket.end() && picked->page.Mip == sortPicks[i].page.Mip && picked->count == sortPicks[i].count;
+		}
+		allMatch = allMatch && match;
+
+		printf("%10zu %12.3f %12.3f%s\n", requests.size(), sortTime, bucketTime, match ? "" : "  (different picks)");
+	}
+	return allMatch ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "PageLoaderFromDisk.h"
+
+using namespace ProTerGen;
+using namespace ProTerGen::VT;
+
+// Sweeps PageLoaderFromDisk::QueueDepth from 1 to MAX_QUEUE_DEPTH over a tile file and reports the pages per second
+// and the latency percentiles the loader measures. The pages are requested in random order, keeping as many in flight
+// as the depth allows, and the file is dropped from the system cache before each depth so the reads hit the disk.
+//
+// Usage: QueueDepthBench <tile file> [vtSize] [tilesPerRowExp] [borderSize] [backend] [pagesPerDepth]
+// backend is 0 for the completion port and 1 for the JobSystem.
+
+namespace
+{
+	// A depth gives up on the pages still in flight after this long without a page delivered.
+	constexpr std::chrono::seconds STALL_TIMEOUT = std::chrono::seconds(2);
+
+	uint32_t ArgOr(int argc, char** argv, int index, uint32_t fallback)
+	{
+		return index < argc ? (uint32_t)std::strtoul(argv[index], nullptr, 10) : fallback;
+	}
+
+	// Opening a file without buffering makes Windows drop its cached pages, as long as no other handle maps it.
+	bool EvictFromFileCache(const std::wstring& fileName)
+	{
+		HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		CloseHandle(file);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <tile file> [vtSize] [tilesPerRowExp] [borderSize] [backend] [pagesPerDepth]\n", argv[0]);
+		return 1;
+	}
+
+	// Same texture as MainEngine unless told otherwise.
+	const std::wstring fileName = std::filesystem::path(argv[1]).wstring();
+	VTDesc desc =
+	{
+		.VTSize           = ArgOr(argc, argv, 2, 32 * 1024),
+		.VTTilesPerRowExp = ArgOr(argc, argv, 3, 7),
+		.AtlasTilesPerRow = 1,
+		.BorderSize       = ArgOr(argc, argv, 4, 8),
+	};
+	const PageLoaderFromDisk::IOBackend backend = ArgOr(argc, argv, 5, 0) == 0
+		? PageLoaderFromDisk::IOBackend::COMPLETION_PORT
+		: PageLoaderFromDisk::IOBackend::JOBS;
+	const uint32_t pagesPerDepth = (std::max)(1u, ArgOr(argc, argv, 6, 4096));
+
+	PageIndexer indexer = {};
+	indexer.Init(desc);
+
+	// Only the pages written to the file can be loaded.
+	std::vector<PageIndex> pages;
+	{
+		TileDataFile file;
+		file.Open(fileName, &desc, 3, TileDataFile::AccessMode::READ);
+		for (PageIndex i = 0; i < indexer.GetCount(); ++i)
+		{
+			if (file.IsPageComplete(i)) pages.push_back(i);
+		}
+	}
+	if (pages.empty())
+	{
+		printf("No pages in %s for this texture.\n", argv[1]);
+		return 1;
+	}
+	std::shuffle(pages.begin(), pages.end(), std::mt19937(1234));
+	const size_t pageCount = (std::min)((size_t)pagesPerDepth, pages.size());
+
+	printf("%zu of %zu pages per depth, %s backend.\n", pageCount, pages.size(),
+		backend == PageLoaderFromDisk::IOBackend::COMPLETION_PORT ? "completion port" : "JobSystem");
+	printf("%6s %12s %10s %10s\n", "depth", "pages/s", "p50 (ms)", "p99 (ms)");
+	for (uint32_t depth = 1; depth <= PageLoaderFromDisk::MAX_QUEUE_DEPTH; depth *= 2)
+	{
+		if (!EvictFromFileCache(fileName))
+		{
+			printf("Can't drop %s from the file cache, the reads may not hit the disk.\n", argv[1]);
+		}
+
+		size_t delivered = 0;
+		auto loader = std::make_unique<PageLoaderFromDisk>();
+		loader->Init(fileName, &indexer, &desc, true, backend);
+		loader->QueueDepth(depth);
+		loader->OnLoadComplete([&](Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>, const Page&, const data_ptr&) { ++delivered; });
+		PageLoaderFromDisk::MetricResetPageLoads();
+
+		size_t submitted = 0;
+		auto lastDelivery = std::chrono::steady_clock::now();
+		while (delivered < pageCount)
+		{
+			for (; submitted < pageCount && submitted - delivered < depth; ++submitted)
+			{
+				loader->Submit(indexer.GetPage(pages[submitted]));
+			}
+
+			const size_t before = delivered;
+			loader->Update(nullptr, depth);
+			const auto now = std::chrono::steady_clock::now();
+			if (delivered != before)
+			{
+				lastDelivery = now;
+			}
+			else if (now - lastDelivery > STALL_TIMEOUT)
+			{
+				break;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		const double pagesPerSecond = PageLoaderFromDisk::MetricGetPageLoadsPerSecond();
+		printf("%6u %12.0f %10.3f %10.3f", depth, pagesPerSecond, PageLoaderFromDisk::MetricGetLatencyMs(0.5), PageLoaderFromDisk::MetricGetLatencyMs(0.99));
+		if (delivered < pageCount) printf("  (%zu pages never arrived)", pageCount - delivered);
+		printf("\n");
+		loader->Dispose();
+	}
+	return 0;
+}
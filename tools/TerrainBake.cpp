@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "TerrainPageGenerator.h"
+#include "TileCompression.h"
+#include "TileFileFormat.h"
+
+using namespace ProTerGen;
+using namespace ProTerGen::VT;
+
+// Bakes the pages of PageCpuGen_Sdh into a tile file without a GPU: the slope, derivatives and height of every
+// page, in the layout TileDataFile reads. Pages of mips below firstMip are left out of the file, as a tile file
+// can have pages never written.
+//
+// Usage: TerrainBake <output> [vtSize] [tilesPerRowExp] [borderSize] [firstMip]
+
+namespace
+{
+	constexpr char INCOMPLETE_CHAR = 'i';
+	constexpr char COMPLETE_CHAR   = 'c';
+
+	uint32_t ArgOr(int argc, char** argv, int index, uint32_t fallback)
+	{
+		return index < argc ? (uint32_t)std::strtoul(argv[index], nullptr, 10) : fallback;
+	}
+
+	bool WriteAt(std::fstream& file, uint64_t offset, const void* data, size_t size)
+	{
+		file.seekp((std::streamoff)offset);
+		file.write((const char*)data, (std::streamsize)size);
+		return !file.fail();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <output> [vtSize] [tilesPerRowExp] [borderSize] [firstMip]\n", argv[0]);
+		return 1;
+	}
+
+	// Same texture as MainEngine unless told otherwise.
+	const VTDesc desc =
+	{
+		.VTSize           = ArgOr(argc, argv, 2, 32 * 1024),
+		.VTTilesPerRowExp = ArgOr(argc, argv, 3, 7),
+		.AtlasTilesPerRow = 1,
+		.BorderSize       = ArgOr(argc, argv, 4, 8),
+	};
+	const uint32_t firstMip = ArgOr(argc, argv, 5, 0);
+
+	if (desc.VTSize == 0 || desc.TileSize() == 0 || desc.TileSize() << desc.VTTilesPerRowExp != desc.VTSize)
+	{
+		printf("The virtual texture size must be a multiple of its tiles per row.\n");
+		return 1;
+	}
+
+	JobSystem::Initialize();
+
+	PageIndexer indexer = {};
+	indexer.Init(desc);
+
+	TerrainPageGenerator generator = {};
+	generator.Init(&desc, L"");
+
+	const std::filesystem::path output = argv[1];
+	std::fstream file(output, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+	if (!file)
+	{
+		printf("Cannot open %s.\n", argv[1]);
+		return 1;
+	}
+
+	const size_t pageCount = indexer.GetCount();
+	const uint32_t size = desc.BorderedTileSize();
+	const uint32_t formatSize = TerrainPageGenerator::TEXEL_CHANNELS * sizeof(float);
+	const size_t pageTotalSize = (size_t)size * size * formatSize;
+
+	const TileFileHeader header =
+	{
+		.Magic            = TILE_FILE_MAGIC,
+		.Version          = TILE_FILE_VERSION,
+		.FormatSize       = formatSize,
+		.BorderedTileSize = size,
+		.PageCount        = pageCount,
+	};
+
+	std::vector<TilePageEntry> index(pageCount);
+	std::vector<uint64_t> bitmap((pageCount + 63) >> 6, 0);
+	std::vector<uint8_t> texels(pageTotalSize);
+	std::vector<uint8_t> filtered(pageTotalSize);
+	std::vector<uint8_t> compressed(TileCompression::CompressBound(pageTotalSize));
+
+	// Marked incomplete until the index and the bitmap are written, like TileGenerator does.
+	bool written = WriteAt(file, 0, &INCOMPLETE_CHAR, 1) && WriteAt(file, 1, &header, sizeof(header));
+
+	uint64_t dataEnd = TileFileDataOffset(pageCount);
+	size_t bakedPages = 0;
+	size_t storedBytes = 0;
+	for (PageIndex i = 0; written && i < pageCount; ++i)
+	{
+		const Page& page = indexer.GetPage(i);
+		if (page.Mip < firstMip) continue;
+
+		generator.GeneratePage(page, texels.data(), (size_t)size * formatSize);
+
+		// Encoded as TileDataFile::WritePage does; pages that don't get smaller are kept raw.
+		TilePageEntry& entry = index[i];
+		const uint8_t* bytes = texels.data();
+		entry.Encoding = TilePageEncoding::RAW;
+		entry.Size = (uint32_t)pageTotalSize;
+
+		filtered.assign(texels.begin(), texels.end());
+		TileCompression::DeltaEncode(filtered.data(), pageTotalSize, formatSize);
+		const size_t compressedSize = TileCompression::Compress(filtered.data(), pageTotalSize, compressed.data(), compressed.size());
+		if (compressedSize > 0 && compressedSize < pageTotalSize)
+		{
+			entry.Encoding = TilePageEncoding::DELTA_LZ;
+			entry.Size = (uint32_t)compressedSize;
+			bytes = compressed.data();
+		}
+
+		entry.Offset = dataEnd;
+		written = WriteAt(file, dataEnd, bytes, entry.Size);
+		dataEnd += entry.Size;
+		bitmap[i >> 6] |= 1ull << (i & 63);
+
+		++bakedPages;
+		storedBytes += entry.Size;
+	}
+
+	written = written
+		&& WriteAt(file, 1 + sizeof(header), index.data(), index.size() * sizeof(TilePageEntry))
+		&& WriteAt(file, TileFileBitmapOffset(pageCount), bitmap.data(), bitmap.size() * sizeof(uint64_t));
+	file.flush();
+	written = written && WriteAt(file, 0, &COMPLETE_CHAR, 1);
+	file.close();
+
+	if (!written || file.fail())
+	{
+		printf("Failed writing %s.\n", argv[1]);
+		return 1;
+	}
+
+	printf("Baked %zu of %zu pages, %zu bytes of page data (%.1f%% of raw).\n", bakedPages, pageCount, storedBytes,
+		bakedPages > 0 ? 100.0 * (double)storedBytes / ((double)bakedPages * pageTotalSize) : 0.0);
+	return 0;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "PageLoaderFromDisk.h"
+
+using namespace ProTerGen;
+using namespace ProTerGen::VT;
+
+// Pages per second on a cold system cache of a tile file against the raw layout it replaced, every page uncompressed
+// at index * pageTotalSize + 1. The raw copy is written next to the tile file from its decoded pages and removed at
+// the end. Both are read in the same random order, decoded to the format of the file.
+//
+// Usage: TileCacheBench <tile file> [vtSize] [tilesPerRowExp] [borderSize] [maxPages]
+
+namespace
+{
+	uint32_t ArgOr(int argc, char** argv, int index, uint32_t fallback)
+	{
+		return index < argc ? (uint32_t)std::strtoul(argv[index], nullptr, 10) : fallback;
+	}
+
+	// Opening a file without buffering makes Windows drop its cached pages, as long as no other handle maps it.
+	bool EvictFromFileCache(const std::wstring& fileName)
+	{
+		HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		CloseHandle(file);
+		return true;
+	}
+
+	bool AccessAt(HANDLE file, bool write, uint64_t offset, void* data, size_t size)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)(offset & 0xFFFFFFFFull);
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD done = 0;
+		const BOOL ok = write
+			? WriteFile(file, data, (DWORD)size, &done, &overlapped)
+			: ReadFile(file, data, (DWORD)size, &done, &overlapped);
+		return ok && done == size;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <tile file> [vtSize] [tilesPerRowExp] [borderSize] [maxPages]\n", argv[0]);
+		return 1;
+	}
+
+	// Same texture as MainEngine unless told otherwise.
+	const std::wstring fileName = std::filesystem::path(argv[1]).wstring();
+	const std::wstring rawName = fileName + L".raw";
+	VTDesc desc =
+	{
+		.VTSize           = ArgOr(argc, argv, 2, 32 * 1024),
+		.VTTilesPerRowExp = ArgOr(argc, argv, 3, 7),
+		.AtlasTilesPerRow = 1,
+		.BorderSize       = ArgOr(argc, argv, 4, 8),
+	};
+	const size_t maxPages = (std::max)(1u, ArgOr(argc, argv, 5, 4096));
+	constexpr uint32_t formatSize = 3;
+
+	PageIndexer indexer = {};
+	indexer.Init(desc);
+
+	std::vector<PageIndex> pages;
+	std::vector<uint8_t> page;
+	size_t storedBytes = 0;
+	{
+		TileDataFile file;
+		file.Open(fileName, &desc, formatSize, TileDataFile::AccessMode::READ);
+		page.resize(file.PageTotalSize());
+
+		HANDLE raw = CreateFileW(rawName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (raw == INVALID_HANDLE_VALUE)
+		{
+			printf("Can't create the raw copy of %s.\n", argv[1]);
+			return 1;
+		}
+		for (PageIndex i = 0; i < indexer.GetCount() && pages.size() < maxPages; ++i)
+		{
+			if (!file.IsPageComplete(i) || !file.ReadPage(i, page.data(), formatSize)) continue;
+			if (!AccessAt(raw, true, (uint64_t)i * page.size() + 1, page.data(), page.size()))
+			{
+				printf("Failed writing the raw copy of %s.\n", argv[1]);
+				CloseHandle(raw);
+				return 1;
+			}
+			pages.push_back(i);
+			storedBytes += file.StoredPageSize(i);
+		}
+		CloseHandle(raw);
+	}
+	if (pages.empty())
+	{
+		printf("No pages in %s for this texture.\n", argv[1]);
+		return 1;
+	}
+	std::shuffle(pages.begin(), pages.end(), std::mt19937(1234));
+
+	if (!EvictFromFileCache(fileName) || !EvictFromFileCache(rawName))
+	{
+		printf("Can't drop the files from the file cache, the reads may not hit the disk.\n");
+	}
+
+	size_t rawRead = 0;
+	auto start = std::chrono::steady_clock::now();
+	{
+		HANDLE raw = CreateFileW(rawName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		for (const PageIndex i : pages)
+		{
+			if (raw != INVALID_HANDLE_VALUE && AccessAt(raw, false, (uint64_t)i * page.size() + 1, page.data(), page.size())) ++rawRead;
+		}
+		if (raw != INVALID_HANDLE_VALUE) CloseHandle(raw);
+	}
+	const std::chrono::duration<double> rawElapsed = std::chrono::steady_clock::now() - start;
+
+	size_t tileRead = 0;
+	start = std::chrono::steady_clock::now();
+	{
+		TileDataFile file;
+		file.Open(fileName, &desc, formatSize, TileDataFile::AccessMode::READ);
+		for (const PageIndex i : pages)
+		{
+			if (file.ReadPage(i, page.data(), formatSize)) ++tileRead;
+		}
+	}
+	const std::chrono::duration<double> tileElapsed = std::chrono::steady_clock::now() - start;
+
+	std::filesystem::remove(std::filesystem::path(rawName));
+
+	const double rawPagesPerSecond = (double)rawRead / rawElapsed.count();
+	const double tilePagesPerSecond = (double)tileRead / tileElapsed.count();
+	printf("%zu pages, stored in %.1f%% of their raw size.\n", pages.size(), 100.0 * (double)storedBytes / ((double)pages.size() * page.size()));
+	printf("%-10s %12s\n", "", "pages/s");
+	printf("%-10s %12.0f%s\n", "raw", rawPagesPerSecond, rawRead < pages.size() ? "  (reads failed)" : "");
+	printf("%-10s %12.0f%s\n", "tile file", tilePagesPerSecond, tileRead < pages.size() ? "  (reads failed)" : "");
+	printf("%.2fx the raw pages per second.\n", rawPagesPerSecond > 0.0 ? tilePagesPerSecond / rawPagesPerSecond : 0.0);
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "PageLoaderFromDisk.h"
+
+using namespace ProTerGen;
+using namespace ProTerGen::VT;
+
+// Pages per second of TileDataFile::ReadPage with positional reads against the memory mapped file, in the random
+// order of streaming and the file order of a mip build, with the file in the system cache and out of it.
+//
+// Usage: TileReadBench <tile file> [vtSize] [tilesPerRowExp] [borderSize] [maxPages]
+
+namespace
+{
+	uint32_t ArgOr(int argc, char** argv, int index, uint32_t fallback)
+	{
+		return index < argc ? (uint32_t)std::strtoul(argv[index], nullptr, 10) : fallback;
+	}
+
+	// Opening a file without buffering makes Windows drop its cached pages, as long as no other handle maps it.
+	bool EvictFromFileCache(const std::wstring& fileName)
+	{
+		HANDLE file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return false;
+		CloseHandle(file);
+		return true;
+	}
+
+	struct Run
+	{
+		const char* Name = "";
+		bool Mapped = false;
+		TileDataFile::AccessPattern Pattern = TileDataFile::AccessPattern::RANDOM;
+		bool Cold = false;
+	};
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <tile file> [vtSize] [tilesPerRowExp] [borderSize] [maxPages]\n", argv[0]);
+		return 1;
+	}
+
+	// Same texture as MainEngine unless told otherwise.
+	const std::wstring fileName = std::filesystem::path(argv[1]).wstring();
+	VTDesc desc =
+	{
+		.VTSize           = ArgOr(argc, argv, 2, 32 * 1024),
+		.VTTilesPerRowExp = ArgOr(argc, argv, 3, 7),
+		.AtlasTilesPerRow = 1,
+		.BorderSize       = ArgOr(argc, argv, 4, 8),
+	};
+	const size_t maxPages = (std::max)(1u, ArgOr(argc, argv, 5, 4096));
+
+	PageIndexer indexer = {};
+	indexer.Init(desc);
+
+	// Only the pages written to the file can be read.
+	std::vector<PageIndex> inOrder;
+	{
+		TileDataFile file;
+		file.Open(fileName, &desc, 3, TileDataFile::AccessMode::READ);
+		for (PageIndex i = 0; i < indexer.GetCount() && inOrder.size() < maxPages; ++i)
+		{
+			if (file.IsPageComplete(i)) inOrder.push_back(i);
+		}
+	}
+	if (inOrder.empty())
+	{
+		printf("No pages in %s for this texture.\n", argv[1]);
+		return 1;
+	}
+	std::vector<PageIndex> shuffled = inOrder;
+	std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1234));
+
+	// Decoded to 4 bytes per texel, like the loader does for the uploads.
+	std::vector<uint8_t> page((size_t)desc.BorderedTileSize() * desc.BorderedTileSize() * 4);
+
+	const Run runs[] =
+	{
+		{ .Name = "read, random",      .Mapped = false, .Pattern = TileDataFile::AccessPattern::RANDOM,     .Cold = true  },
+		{ .Name = "read, random",      .Mapped = false, .Pattern = TileDataFile::AccessPattern::RANDOM,     .Cold = false },
+		{ .Name = "mapped, random",    .Mapped = true,  .Pattern = TileDataFile::AccessPattern::RANDOM,     .Cold = true  },
+		{ .Name = "mapped, random",    .Mapped = true,  .Pattern = TileDataFile::AccessPattern::RANDOM,     .Cold = false },
+		{ .Name = "read, in order",    .Mapped = false, .Pattern = TileDataFile::AccessPattern::SEQUENTIAL, .Cold = true  },
+		{ .Name = "read, in order",    .Mapped = false, .Pattern = TileDataFile::AccessPattern::SEQUENTIAL, .Cold = false },
+		{ .Name = "mapped, in order",  .Mapped = true,  .Pattern = TileDataFile::AccessPattern::SEQUENTIAL, .Cold = true  },
+		{ .Name = "mapped, in order",  .Mapped = true,  .Pattern = TileDataFile::AccessPattern::SEQUENTIAL, .Cold = false },
+	};
+
+	printf("%zu pages per run.\n", inOrder.size());
+	printf("%-18s %6s %12s %10s\n", "", "cache", "pages/s", "MB/s");
+	for (const Run& run : runs)
+	{
+		if (run.Cold && !EvictFromFileCache(fileName))
+		{
+			printf("Can't drop %s from the file cache, the reads may not hit the disk.\n", argv[1]);
+		}
+
+		TileDataFile file;
+		file.Open(fileName, &desc, 3, TileDataFile::AccessMode::READ);
+		if (run.Mapped && !file.Map(run.Pattern))
+		{
+			printf("Can't map %s.\n", argv[1]);
+			return 1;
+		}
+
+		const std::vector<PageIndex>& pages = run.Pattern == TileDataFile::AccessPattern::RANDOM ? shuffled : inOrder;
+		size_t read = 0;
+		size_t storedBytes = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (const PageIndex i : pages)
+		{
+			if (file.ReadPage(i, page.data(), 4))
+			{
+				++read;
+				storedBytes += file.StoredPageSize(i);
+			}
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		file.Close();
+
+		printf("%-18s %6s %12.0f %10.1f", run.Name, run.Cold ? "cold" : "warm", (double)read / elapsed.count(), (double)storedBytes / (1024.0 * 1024.0) / elapsed.count());
+		if (read < pages.size()) printf("  (%zu pages failed)", pages.size() - read);
+		printf("\n");
+	}
+	return 0;
+}